@@ -0,0 +1,39 @@
+#[[
+    This file is a part of KNOSSOS.
+
+    (C) Copyright 2007-2016
+    Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+
+    KNOSSOS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 of
+    the License as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+    For further information, visit https://knossostool.org
+    or contact knossos-team@mpimf-heidelberg.mpg.de
+]]
+
+# provides an imported target for the lz4 library
+
+find_library(LZ4_LIB lz4)
+find_path(LZ4_INCLUDE lz4.h)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4
+    REQUIRED_VARS LZ4_LIB LZ4_INCLUDE
+)
+
+if(LZ4_FOUND)
+    add_library(LZ4::LZ4 UNKNOWN IMPORTED)
+    set_target_properties(LZ4::LZ4 PROPERTIES
+        IMPORTED_LOCATION ${LZ4_LIB}
+        INTERFACE_INCLUDE_DIRECTORIES ${LZ4_INCLUDE}
+    )
+endif(LZ4_FOUND)
@@ -0,0 +1,39 @@
+#[[
+    This file is a part of KNOSSOS.
+
+    (C) Copyright 2007-2016
+    Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+
+    KNOSSOS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 of
+    the License as published by the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+    For further information, visit https://knossostool.org
+    or contact knossos-team@mpimf-heidelberg.mpg.de
+]]
+
+# provides an imported target for the zstd library
+
+find_library(ZSTD_LIB zstd)
+find_path(ZSTD_INCLUDE zstd.h)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(ZSTD
+    REQUIRED_VARS ZSTD_LIB ZSTD_INCLUDE
+)
+
+if(ZSTD_FOUND)
+    add_library(Zstd::Zstd UNKNOWN IMPORTED)
+    set_target_properties(Zstd::Zstd PROPERTIES
+        IMPORTED_LOCATION ${ZSTD_LIB}
+        INTERFACE_INCLUDE_DIRECTORIES ${ZSTD_INCLUDE}
+    )
+endif(ZSTD_FOUND)
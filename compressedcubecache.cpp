@@ -0,0 +1,116 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "compressedcubecache.h"
+
+#include "segmentation/compressedsegmentation.h"
+
+#include <snappy.h>
+
+#include <cmath>
+
+namespace {
+int segmentationEdge(const std::size_t cubeBytes) {
+    return std::round(std::cbrt(cubeBytes / sizeof(std::uint64_t)));
+}
+}
+
+std::string CompressedCubeCache::compress(const void * cube, const std::size_t cubeBytes, const Format format) {
+    if (format == Format::Segmentation) {
+        const auto encoded = CompressedSegmentation::encode(reinterpret_cast<const std::uint64_t *>(cube), segmentationEdge(cubeBytes));
+        if (!encoded.empty() && encoded.size() < cubeBytes) {
+            return static_cast<char>(Format::Segmentation) + encoded;
+        }
+    }
+    std::string compressedCube;
+    snappy::Compress(reinterpret_cast<const char *>(cube), cubeBytes, &compressedCube);
+    compressedCube.insert(std::begin(compressedCube), static_cast<char>(Format::Snappy));
+    compressedCube.shrink_to_fit();// snappy reserves for the worst case
+    return compressedCube;
+}
+
+void CompressedCubeCache::evict() {
+    while (usedBytes > maxBytes && !lru.empty()) {
+        const CompressedCubeKey victim = lru.back();
+        erase(victim);
+    }
+}
+
+void CompressedCubeCache::insert(const CompressedCubeKey & key, std::string && compressedCube) {
+    erase(key);
+    if (compressedCube.size() > maxBytes) {
+        return;
+    }
+    usedBytes += compressedCube.size();
+    cubes.emplace(key, std::move(compressedCube));
+    lru.emplace_front(key);
+    evict();
+}
+
+bool CompressedCubeCache::restore(const CompressedCubeKey & key, void * slot, const std::size_t cubeBytes) {
+    auto it = cubes.find(key);
+    if (it == std::end(cubes)) {
+        return false;
+    }
+    bool success{false};
+    const auto * data = it->second.data() + 1;// after the format
+    const auto size = it->second.size() - 1;
+    if (!it->second.empty() && it->second.front() == static_cast<char>(Format::Segmentation)) {
+        const auto edge = segmentationEdge(cubeBytes);
+        success = CompressedSegmentation::valid(data, size, edge);
+        if (success) {
+            CompressedSegmentation::decode(data, edge, reinterpret_cast<std::uint64_t *>(slot));
+        }
+    } else if (!it->second.empty()) {
+        std::size_t uncompressedSize;
+        success = snappy::GetUncompressedLength(data, size, &uncompressedSize)
+                && uncompressedSize == cubeBytes
+                && snappy::RawUncompress(data, size, reinterpret_cast<char *>(slot));
+    }
+    erase(key);// it’s in a slot now (or broken)
+    return success;
+}
+
+bool CompressedCubeCache::contains(const CompressedCubeKey & key) const {
+    return cubes.find(key) != std::end(cubes);
+}
+
+void CompressedCubeCache::erase(const CompressedCubeKey & key) {
+    auto it = cubes.find(key);
+    if (it != std::end(cubes)) {
+        usedBytes -= it->second.size();
+        cubes.erase(it);
+        lru.erase(key);
+    }
+}
+
+void CompressedCubeCache::clear() {
+    lru.clear();
+    cubes.clear();
+    usedBytes = 0;
+}
+
+void CompressedCubeCache::setMaxSize(const std::size_t bytes) {
+    maxBytes = bytes;
+    evict();
+}
@@ -0,0 +1,89 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef COMPRESSEDCUBECACHE_H
+#define COMPRESSEDCUBECACHE_H
+
+#include "coordinate.h"
+#include "hash_list.h"
+
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+struct CompressedCubeKey {
+    std::size_t layerId;
+    std::size_t magnification;// int_log of the magnification
+    CoordOfCube cube;
+    bool operator==(const CompressedCubeKey & other) const {
+        return std::tie(layerId, magnification, cube) == std::tie(other.layerId, other.magnification, other.cube);
+    }
+};
+
+namespace std {
+template<>
+struct hash<CompressedCubeKey> {
+    std::size_t operator()(const CompressedCubeKey & key) const {
+        return boost::hash_value(std::make_tuple(key.layerId, key.magnification, key.cube.x, key.cube.y, key.cube.z));
+    }
+};
+}
+
+/**
+ * @brief CompressedCubeCache keeps cubes that were evicted from the supercube compressed in RAM.
+ *
+ * Moving back and forth across a cube boundary then restores the cubes with a single uncompress
+ * instead of another download and decode. The least recently stored cubes are dropped when the size limit is hit.
+ * Segmentation cubes are stored as compressed_segmentation, which is many times smaller than snappy for supervoxel ids.
+ * Not synchronized, it’s owned and used by the loader thread. Hits and misses are counted in LoaderMetrics::caches.
+ */
+class CompressedCubeCache {
+    hash_list<CompressedCubeKey> lru;// front is the most recently stored cube
+    std::unordered_map<CompressedCubeKey, std::string> cubes;
+    std::size_t usedBytes{0};
+    std::size_t maxBytes{0};
+
+    void evict();
+public:
+    enum class Format : char {
+        Snappy, Segmentation// 64 bit ids
+    };
+
+    // the format is stored with the data, segmentation cubes fall back to snappy if they don’t shrink
+    static std::string compress(const void * cube, const std::size_t cubeBytes, const Format format = Format::Snappy);
+    void insert(const CompressedCubeKey & key, std::string && compressedCube);
+    bool restore(const CompressedCubeKey & key, void * slot, const std::size_t cubeBytes);// uncompresses into slot and removes the entry
+    bool contains(const CompressedCubeKey & key) const;
+    void erase(const CompressedCubeKey & key);
+    void clear();
+    void setMaxSize(const std::size_t bytes);
+    std::size_t maxSize() const {
+        return maxBytes;
+    }
+    std::size_t size() const {
+        return usedBytes;
+    }
+};
+
+#endif//COMPRESSEDCUBECACHE_H
@@ -0,0 +1,403 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+#include "cubecodec.h"
+
+#include "kernelbench.h"
+
+#include <quazip.h>
+#include <quazipfile.h>
+
+#include <snappy.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QImageReader>
+#include <QObject>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+CubeCodec::CubeCodec(const Dataset::CubeType type, const QString & name, const QString & extension, const bool segmentation, const bool available)
+    : type{type}, name{name}, extension{extension}, segmentation{segmentation}, available{available} {}
+
+QByteArray CubeCodec::encode(const void *, const int) const {
+    return {};
+}
+
+std::size_t CubeCodec::slotBytes(const int cubeEdgeLength) const {
+    return static_cast<std::size_t>(cubeEdgeLength) * cubeEdgeLength * cubeEdgeLength * (segmentation ? sizeof(std::uint64_t) : 1);
+}
+
+namespace {
+class UnavailableCodec : public CubeCodec {
+public:
+    UnavailableCodec(const Dataset::CubeType type, const QString & name, const QString & extension, const bool segmentation)
+        : CubeCodec(type, name, extension, segmentation, false) {}
+    bool decode(const char *, const std::size_t, void *, const int) const override {
+        return false;
+    }
+};
+
+class UncompressedCodec : public CubeCodec {
+public:
+    using CubeCodec::CubeCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        if (size != slotBytes(cubeEdgeLength)) {
+            return false;
+        }
+        std::memcpy(slot, data, size);
+        return true;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        return QByteArray(reinterpret_cast<const char *>(cube), slotBytes(cubeEdgeLength));
+    }
+};
+
+class Uncompressed16Codec : public CubeCodec {// 16 bit ids are widened
+public:
+    using CubeCodec::CubeCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        const auto voxels = slotBytes(cubeEdgeLength) / sizeof(std::uint64_t);
+        if (size != voxels * sizeof(std::uint16_t)) {
+            return false;
+        }
+        auto * ids = reinterpret_cast<std::uint64_t *>(slot);
+        for (std::size_t i{0}; i < voxels; ++i) {
+            std::uint16_t id;
+            std::memcpy(&id, data + i * sizeof(id), sizeof(id));
+            ids[i] = id;
+        }
+        return true;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        const auto voxels = slotBytes(cubeEdgeLength) / sizeof(std::uint64_t);
+        QByteArray data(voxels * sizeof(std::uint16_t), Qt::Uninitialized);
+        const auto * ids = reinterpret_cast<const std::uint64_t *>(cube);
+        for (std::size_t i{0}; i < voxels; ++i) {
+            const std::uint16_t id = ids[i];
+            std::memcpy(data.data() + i * sizeof(id), &id, sizeof(id));
+        }
+        return data;
+    }
+};
+
+// cubes are images of edge × edge² gray pixels
+class QImageCodec : public CubeCodec {
+    const char * format;// for encoding
+public:
+    QImageCodec(const Dataset::CubeType type, const QString & name, const QString & extension, const char * format)
+        : CubeCodec(type, name, extension, false), format{format} {}
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        auto bytes = QByteArray::fromRawData(data, size);
+        {// gray images are read straight into the slot
+            QBuffer buffer(&bytes);
+            QImageReader reader(&buffer);
+            QImage image(reinterpret_cast<uchar *>(slot), cubeEdgeLength, cubeEdgeLength * cubeEdgeLength, cubeEdgeLength, QImage::Format_Grayscale8);
+            if (reader.size() == image.size() && reader.imageFormat() == QImage::Format_Grayscale8 && reader.read(&image) && static_cast<const void *>(image.constBits()) == slot) {
+                return true;
+            }
+        }
+        const auto image = QImage::fromData(bytes).convertToFormat(QImage::Format_Indexed8);
+        if (static_cast<std::size_t>(image.byteCount()) != slotBytes(cubeEdgeLength)) {
+            return false;
+        }
+        std::copy(image.constBits(), image.constBits() + image.byteCount(), reinterpret_cast<std::uint8_t *>(slot));
+        return true;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        const QImage image(reinterpret_cast<const uchar *>(cube), cubeEdgeLength, cubeEdgeLength * cubeEdgeLength, cubeEdgeLength, QImage::Format_Grayscale8);
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        return image.save(&buffer, format, 90) ? data : QByteArray{};
+    }
+};
+
+#ifdef HAVE_TURBOJPEG
+class TurboJpegCodec : public CubeCodec {
+    using Handle = std::unique_ptr<void, decltype(&tjDestroy)>;
+public:
+    using CubeCodec::CubeCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        thread_local Handle decompressor{tjInitDecompress(), &tjDestroy};
+        const auto * jpeg = reinterpret_cast<const unsigned char *>(data);
+        int width, height, subsampling, colorspace;
+        if (tjDecompressHeader3(decompressor.get(), jpeg, size, &width, &height, &subsampling, &colorspace) != 0
+                || static_cast<std::size_t>(width) * height != slotBytes(cubeEdgeLength)) {
+            return false;
+        }
+        return tjDecompress2(decompressor.get(), jpeg, size, reinterpret_cast<unsigned char *>(slot), width, width, height, TJPF_GRAY, 0) == 0;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        Handle compressor{tjInitCompress(), &tjDestroy};
+        unsigned char * jpeg{nullptr};
+        unsigned long jpegSize{0};
+        QByteArray data;
+        if (tjCompress2(compressor.get(), reinterpret_cast<const unsigned char *>(cube), cubeEdgeLength, cubeEdgeLength, cubeEdgeLength * cubeEdgeLength, TJPF_GRAY, &jpeg, &jpegSize, TJSAMP_GRAY, 90, 0) == 0) {
+            data = QByteArray(reinterpret_cast<const char *>(jpeg), jpegSize);
+        }
+        tjFree(jpeg);
+        return data;
+    }
+};
+#endif
+
+class SnappyCodec : public CubeCodec {
+public:
+    using CubeCodec::CubeCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        std::size_t uncompressedSize;
+        return snappy::GetUncompressedLength(data, size, &uncompressedSize) && uncompressedSize == slotBytes(cubeEdgeLength)
+                && snappy::RawUncompress(data, size, reinterpret_cast<char *>(slot));
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        std::string data;
+        snappy::Compress(reinterpret_cast<const char *>(cube), slotBytes(cubeEdgeLength), &data);
+        return QByteArray(data.data(), data.size());
+    }
+};
+
+// a zip archive around a snappy stream, stored entries are uncompressed without QuaZip
+class SnappyZipCodec : public SnappyCodec {
+    static std::uint32_t little(const char * data, const int bytes) {
+        std::uint32_t value{0};
+        for (int i{bytes - 1}; i >= 0; --i) {
+            value = value << 8 | static_cast<std::uint8_t>(data[i]);
+        }
+        return value;
+    }
+public:
+    using SnappyCodec::SnappyCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        const std::size_t headerSize = 30;// local file header of the first entry
+        if (size >= headerSize && std::memcmp(data, "PK\x03\x04", 4) == 0) {
+            const auto flags = little(data + 6, 2);
+            const auto method = little(data + 8, 2);
+            const std::size_t compressedSize = little(data + 18, 4);
+            const auto offset = headerSize + little(data + 26, 2) + little(data + 28, 2);
+            const bool sizeInHeader = (flags & 0x8) == 0;// not in a data descriptor after the entry
+            if (method == 0 && sizeInHeader && offset + compressedSize <= size) {
+                return SnappyCodec::decode(data + offset, compressedSize, slot, cubeEdgeLength);
+            }
+        }
+        auto bytes = QByteArray::fromRawData(data, size);
+        QBuffer buffer(&bytes);
+        QuaZip archive(&buffer);//QuaZip needs a random access QIODevice
+        bool success{false};
+        if (archive.open(QuaZip::mdUnzip)) {
+            archive.goToFirstFile();
+            QuaZipFile file(&archive);
+            if (file.open(QIODevice::ReadOnly)) {
+                const auto snappyCube = file.readAll();
+                success = SnappyCodec::decode(snappyCube.data(), snappyCube.size(), slot, cubeEdgeLength);
+            }
+            archive.close();
+        }
+        return success;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        const auto snappyCube = SnappyCodec::encode(cube, cubeEdgeLength);
+        QByteArray data;
+        QBuffer buffer(&data);
+        QuaZip archive(&buffer);
+        if (!archive.open(QuaZip::mdCreate)) {
+            return {};
+        }
+        QuaZipFile file(&archive);
+        const bool success = file.open(QIODevice::WriteOnly, QuaZipNewInfo("cube.seg.sz"), nullptr, 0, 0) && file.write(snappyCube) == snappyCube.size();// stored, snappy doesn’t deflate
+        file.close();
+        archive.close();
+        return success ? data : QByteArray{};
+    }
+};
+
+#ifdef HAVE_ZSTD
+class ZstdCodec : public CubeCodec {
+public:
+    using CubeCodec::CubeCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context{ZSTD_createDCtx(), &ZSTD_freeDCtx};
+        const auto bytes = slotBytes(cubeEdgeLength);
+        const auto contentSize = ZSTD_getFrameContentSize(data, size);
+        return (contentSize == bytes || contentSize == ZSTD_CONTENTSIZE_UNKNOWN) && ZSTD_decompressDCtx(context.get(), slot, bytes, data, size) == bytes;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        const auto bytes = slotBytes(cubeEdgeLength);
+        QByteArray data(ZSTD_compressBound(bytes), Qt::Uninitialized);
+        const auto size = ZSTD_compress(data.data(), data.size(), cube, bytes, 3);
+        if (ZSTD_isError(size)) {
+            return {};
+        }
+        data.resize(size);
+        return data;
+    }
+};
+#endif
+
+#ifdef HAVE_LZ4
+class Lz4Codec : public CubeCodec {// raw lz4 blocks without a frame
+public:
+    using CubeCodec::CubeCodec;
+    bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const override {
+        const int bytes = slotBytes(cubeEdgeLength);
+        return LZ4_decompress_safe(data, reinterpret_cast<char *>(slot), size, bytes) == bytes;
+    }
+    QByteArray encode(const void * cube, const int cubeEdgeLength) const override {
+        const int bytes = slotBytes(cubeEdgeLength);
+        QByteArray data(LZ4_compressBound(bytes), Qt::Uninitialized);
+        const auto size = LZ4_compress_default(reinterpret_cast<const char *>(cube), data.data(), bytes, data.size());
+        if (size <= 0) {
+            return {};
+        }
+        data.resize(size);
+        return data;
+    }
+};
+#endif
+
+std::vector<std::unique_ptr<CubeCodec>> makeCodecs() {
+    using CubeType = Dataset::CubeType;
+    std::vector<std::unique_ptr<CubeCodec>> codecs;
+    codecs.emplace_back(new UncompressedCodec(CubeType::RAW_UNCOMPRESSED, "8 bit gray", "raw", false));
+#ifdef HAVE_TURBOJPEG
+    codecs.emplace_back(new TurboJpegCodec(CubeType::RAW_JPG, "jpg", "jpg", false));
+#else
+    codecs.emplace_back(new QImageCodec(CubeType::RAW_JPG, "jpg", "jpg", "JPG"));
+#endif
+    codecs.emplace_back(new QImageCodec(CubeType::RAW_J2K, "j2k", "j2k", "J2K"));
+    codecs.emplace_back(new QImageCodec(CubeType::RAW_JP2_6, "jp2", "6.jp2", "JP2"));
+    codecs.emplace_back(new Uncompressed16Codec(CubeType::SEGMENTATION_UNCOMPRESSED_16, "16 bit id", "", true));
+    codecs.emplace_back(new UncompressedCodec(CubeType::SEGMENTATION_UNCOMPRESSED_64, "64 bit id", "seg", true));
+    codecs.emplace_back(new SnappyZipCodec(CubeType::SEGMENTATION_SZ_ZIP, "sz.zip", "seg.sz.zip", true));
+    codecs.emplace_back(new UnavailableCodec(CubeType::SNAPPY, "snappy", "", true));// only the annotation has cubes
+    codecs.emplace_back(new SnappyCodec(CubeType::SEGMENTATION_SZ, "sz", "seg.sz", true));
+#ifdef HAVE_ZSTD
+    codecs.emplace_back(new ZstdCodec(CubeType::RAW_ZSTD, "zstd", "raw.zst", false));
+    codecs.emplace_back(new ZstdCodec(CubeType::SEGMENTATION_ZSTD, "seg zstd", "seg.zst", true));
+#else
+    codecs.emplace_back(new UnavailableCodec(CubeType::RAW_ZSTD, "zstd", "raw.zst", false));
+    codecs.emplace_back(new UnavailableCodec(CubeType::SEGMENTATION_ZSTD, "seg zstd", "seg.zst", true));
+#endif
+#ifdef HAVE_LZ4
+    codecs.emplace_back(new Lz4Codec(CubeType::RAW_LZ4, "lz4", "raw.lz4", false));
+    codecs.emplace_back(new Lz4Codec(CubeType::SEGMENTATION_LZ4, "seg lz4", "seg.lz4", true));
+#else
+    codecs.emplace_back(new UnavailableCodec(CubeType::RAW_LZ4, "lz4", "raw.lz4", false));
+    codecs.emplace_back(new UnavailableCodec(CubeType::SEGMENTATION_LZ4, "seg lz4", "seg.lz4", true));
+#endif
+    return codecs;
+}
+
+const std::vector<std::unique_ptr<CubeCodec>> & codecs() {
+    static const auto codecs = makeCodecs();
+    return codecs;
+}
+}
+
+const CubeCodec & CubeCodec::get(const Dataset::CubeType type) {
+    for (const auto & codec : codecs()) {
+        if (codec->type == type) {
+            return *codec;
+        }
+    }
+    throw std::runtime_error(QObject::tr("no codec for cube type %1").arg(static_cast<int>(type)).toStdString());
+}
+
+const CubeCodec * CubeCodec::find(const QString & extension) {
+    for (const auto & codec : codecs()) {
+        if (codec->available && !codec->extension.isEmpty() && codec->extension == extension) {
+            return codec.get();
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const CubeCodec *> CubeCodec::all() {
+    std::vector<const CubeCodec *> all;
+    for (const auto & codec : codecs()) {
+        all.emplace_back(codec.get());
+    }
+    return all;
+}
+
+std::vector<CubeCodec::BenchmarkResult> CubeCodec::benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions) {
+    std::vector<BenchmarkResult> results;
+    for (const auto edge : cubeEdgeLengths) {
+        const std::size_t width = edge;
+        const std::size_t voxels = width * width * width;
+        // gray gradients with some noise and supervoxels of 4³ voxels
+        std::vector<std::uint8_t> gray(voxels);
+        std::vector<std::uint64_t> ids(voxels);
+        for (std::size_t i{0}; i < voxels; ++i) {
+            const auto x = i % width, y = i / width % width, z = i / width / width;
+            gray[i] = static_cast<std::uint8_t>(x + y / 2 + z / 4 + (i * 2654435761u >> 28));
+            const std::uint64_t block = x / 4 + y / 4 * width + z / 4 * width * width;
+            ids[i] = 1 + (block * 2654435761u >> 8) % 4096;
+        }
+        std::vector<std::uint64_t> slot(voxels);// fits either
+        for (const auto * codec : all()) {
+            const void * cube = codec->segmentation ? static_cast<const void *>(ids.data()) : gray.data();
+            const auto data = codec->available ? codec->encode(cube, edge) : QByteArray{};
+            if (data.isEmpty()) {
+                continue;
+            }
+            const bool decodable = codec->decode(data.data(), data.size(), slot.data(), edge);
+            const bool lossless = decodable && std::memcmp(slot.data(), cube, codec->slotBytes(edge)) == 0;
+            QElapsedTimer timer;
+            timer.start();
+            for (int i{0}; i < repetitions; ++i) {
+                codec->decode(data.data(), data.size(), slot.data(), edge);
+            }
+            results.push_back({codec->name, edge, static_cast<double>(codec->slotBytes(edge)) / data.size(), lossless, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions)});
+        }
+    }
+    return results;
+}
+
+namespace {
+const KernelBench::Registration registration{"cube codecs", 10, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : CubeCodec::benchmark({64, 128}, repetitions)) {
+        results.append(QVariantMap{{"codec", result.codec}
+            , {"cube_edge_length", result.cubeEdgeLength}
+            , {"compression_ratio", result.compressionRatio}
+            , {"lossless", result.lossless}
+            , {"ns_per_cube", result.nsPerCube}});
+    }
+    return results;
+}};
+}
@@ -0,0 +1,74 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef CUBECODEC_H
+#define CUBECODEC_H
+
+#include "dataset.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief CubeCodec decodes the cubes of one Dataset::CubeType straight into their slot.
+ *
+ * There’s one codec for every cube type, get returns it. Codecs whose library wasn’t found
+ * at build time (zstd, lz4) are registered as unavailable and fail to decode.
+ * A dataset config selects the codec with »cube_format <extension>;«.
+ */
+class CubeCodec {
+public:
+    const Dataset::CubeType type;
+    const QString name;// shown to the user and in the loader metrics
+    const QString extension;// of knossos cube files (without the leading dot), empty if there are none
+    const bool segmentation;// slots hold 64 bit ids
+    const bool available;
+
+    CubeCodec(const Dataset::CubeType type, const QString & name, const QString & extension, const bool segmentation, const bool available = true);
+    virtual ~CubeCodec() = default;
+    // slot holds cubeEdgeLength³ voxels, data is only read
+    virtual bool decode(const char * data, const std::size_t size, void * slot, const int cubeEdgeLength) const = 0;
+    // for the benchmark, empty if the codec can’t encode
+    virtual QByteArray encode(const void * cube, const int cubeEdgeLength) const;
+
+    static const CubeCodec & get(const Dataset::CubeType type);
+    static const CubeCodec * find(const QString & extension);// nullptr for unknown or unavailable codecs
+    static std::vector<const CubeCodec *> all();
+
+    struct BenchmarkResult {
+        QString codec;
+        int cubeEdgeLength;
+        double compressionRatio;
+        bool lossless;// whether the decoded cube matches the encoded one
+        double nsPerCube;
+    };
+    // decodes synthetic cubes with every codec that can encode them
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions);
+protected:
+    std::size_t slotBytes(const int cubeEdgeLength) const;
+};
+
+#endif//CUBECODEC_H
@@ -0,0 +1,172 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "cubediskcache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+std::string CubeDiskCache::key(const QUrl & url, const int magnification, const Coordinate & globalCoord) {
+    const auto identifier = QString("%1|%2|%3,%4,%5").arg(url.toString(QUrl::FullyEncoded)).arg(magnification).arg(globalCoord.x).arg(globalCoord.y).arg(globalCoord.z);
+    return QCryptographicHash::hash(identifier.toUtf8(), QCryptographicHash::Sha1).toHex().toStdString();
+}
+
+QString CubeDiskCache::path(const std::string & key) const {
+    return directory + "/" + QString::fromStdString(key) + ".cube";
+}
+
+void CubeDiskCache::index() {
+    if (indexed) {
+        return;
+    }
+    indexed = true;
+    directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/cubes";
+    QDir dir;
+    if (!dir.mkpath(directory)) {
+        qWarning() << "cube disk cache unavailable:" << directory << "is not writable";
+        maxBytes = 0;
+        return;
+    }
+    dir.setPath(directory);
+    for (const auto & info : dir.entryInfoList({"*.cube"}, QDir::Files, QDir::Time)) {// newest first
+        const auto entry = info.completeBaseName().toStdString();
+        lru.emplace_back(entry);
+        entrySizes[entry] = info.size();
+        usedBytes += info.size();
+    }
+    evict();
+}
+
+void CubeDiskCache::evict() {
+    while (usedBytes > maxBytes && !lru.empty()) {
+        const std::string victim = lru.back();
+        lru.erase(victim);
+        usedBytes -= entrySizes[victim];
+        entrySizes.erase(victim);
+        QFile::remove(path(victim));
+    }
+}
+
+bool CubeDiskCache::enabled() {
+    QMutexLocker locker(&mutex);
+    return maxBytes > 0;
+}
+
+qint64 CubeDiskCache::maxSize() {
+    QMutexLocker locker(&mutex);
+    return maxBytes;
+}
+
+void CubeDiskCache::setMaxSize(const qint64 bytes) {
+    QMutexLocker locker(&mutex);
+    maxBytes = std::max(0ll, bytes);
+    if (indexed) {
+        evict();
+    }
+}
+
+qint64 CubeDiskCache::size() {
+    QMutexLocker locker(&mutex);
+    index();
+    return usedBytes;
+}
+
+bool CubeDiskCache::contains(const std::string & key) {
+    QMutexLocker locker(&mutex);
+    index();
+    return entrySizes.find(key) != std::end(entrySizes);
+}
+
+QByteArray CubeDiskCache::load(const std::string & key) {
+    {
+        QMutexLocker locker(&mutex);
+        index();
+        if (entrySizes.find(key) == std::end(entrySizes)) {
+            return {};
+        }
+        lru.erase(key);
+        lru.emplace_front(key);
+    }
+    QFile file(path(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        remove(key);
+        return {};
+    }
+    return file.readAll();
+}
+
+void CubeDiskCache::store(const std::string & key, const QByteArray & payload) {
+    {
+        QMutexLocker locker(&mutex);
+        index();
+        if (payload.size() > maxBytes) {
+            return;
+        }
+    }
+    // write outside the lock, the decompression pool shouldn’t queue up behind the disk
+    QSaveFile file(path(key));
+    if (!file.open(QIODevice::WriteOnly) || file.write(payload) != payload.size() || !file.commit()) {
+        qWarning() << "cube disk cache: writing" << file.fileName() << "failed:" << file.errorString();
+        return;
+    }
+    QMutexLocker locker(&mutex);
+    auto it = entrySizes.find(key);
+    if (it != std::end(entrySizes)) {
+        usedBytes -= it->second;
+        lru.erase(key);
+    }
+    lru.emplace_front(key);
+    entrySizes[key] = payload.size();
+    usedBytes += payload.size();
+    evict();
+}
+
+void CubeDiskCache::remove(const std::string & key) {
+    QMutexLocker locker(&mutex);
+    auto it = entrySizes.find(key);
+    if (it != std::end(entrySizes)) {
+        usedBytes -= it->second;
+        entrySizes.erase(it);
+        lru.erase(key);
+        QFile::remove(path(key));
+    }
+}
+
+void CubeDiskCache::clear() {
+    QMutexLocker locker(&mutex);
+    index();
+    for (const auto & entry : entrySizes) {
+        QFile::remove(path(entry.first));
+    }
+    lru.clear();
+    entrySizes.clear();
+    usedBytes = 0;
+}
@@ -0,0 +1,73 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef CUBEDISKCACHE_H
+#define CUBEDISKCACHE_H
+
+#include "coordinate.h"
+#include "hash_list.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QUrl>
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief CubeDiskCache keeps the still compressed payloads of downloaded cubes on the local disk.
+ *
+ * Entries are keyed by request url, magnification and cube coordinate and evicted least recently used
+ * first once the configured size is exceeded. The index is built from the cache directory on first use,
+ * so the cache survives restarts (ordered by write time then).
+ * All members may be called from the loader thread and the decompression pool concurrently.
+ */
+class CubeDiskCache {
+    QMutex mutex;
+    bool indexed{false};
+    QString directory;
+    qint64 maxBytes{2048ll * 1024 * 1024};
+    qint64 usedBytes{0};
+    hash_list<std::string> lru;// front is the most recently used entry
+    std::unordered_map<std::string, qint64> entrySizes;
+
+    void index();
+    void evict();
+    QString path(const std::string & key) const;
+public:
+    static std::string key(const QUrl & url, const int magnification, const Coordinate & globalCoord);
+
+    bool enabled();
+    qint64 maxSize();
+    void setMaxSize(const qint64 bytes);
+    qint64 size();
+
+    bool contains(const std::string & key);
+    QByteArray load(const std::string & key);// returns an empty array if there is no (readable) entry
+    void store(const std::string & key, const QByteArray & payload);
+    void remove(const std::string & key);
+    void clear();
+};
+
+#endif//CUBEDISKCACHE_H
@@ -22,6 +22,7 @@
 
 #include "dataset.h"
 
+#include "cubecodec.h"
 #include "network.h"
 #include "segmentation/segmentation.h"
 #include "skeleton/skeletonizer.h"
@@ -40,17 +41,7 @@
 Dataset::list_t Dataset::datasets;
 
 QString Dataset::compressionString() const {
-    switch (type) {
-    case Dataset::CubeType::RAW_UNCOMPRESSED: return "8 bit gray";
-    case Dataset::CubeType::RAW_JPG: return "jpg";
-    case Dataset::CubeType::RAW_J2K: return "j2k";
-    case Dataset::CubeType::RAW_JP2_6: return "jp2";
-    case Dataset::CubeType::SEGMENTATION_UNCOMPRESSED_16: return "16 bit id";
-    case Dataset::CubeType::SEGMENTATION_UNCOMPRESSED_64: return "64 bit id";
-    case Dataset::CubeType::SEGMENTATION_SZ_ZIP: return "sz.zip";
-    case Dataset::CubeType::SNAPPY: return "snappy";
-    }
-    throw std::runtime_error(QObject::tr("no compressions string for %1").arg(static_cast<int>(type)).toUtf8()); ;
+    return CubeCodec::get(type).name;
 }
 
 bool Dataset::isHeidelbrain(const QUrl & url) {
@@ -232,6 +223,15 @@ Dataset::list_t Dataset::fromLegacyConf(const QUrl & configUrl, QString config)
                 info.url.setPassword(tokenList.at(4));
             }
             // discarding ftpFileTimeout parameter
+        } else if (token == "cube_format") {// file extension of the cubes, for the dataset or its overlay
+            const auto * codec = CubeCodec::find(tokenList.at(1));
+            if (codec == nullptr) {
+                qDebug() << "Skipping unknown cube format" << tokenList.at(1);
+            } else if (codec->segmentation) {
+                info.overlayType = codec->type;
+            } else {
+                info.type = codec->type;
+            }
         } else if (token == "compression_ratio") {
             const auto compressionRatio = tokenList.at(1).toInt();
             info.type = compressionRatio == 0 ? Dataset::CubeType::RAW_UNCOMPRESSED
@@ -268,7 +268,7 @@ void Dataset::checkMagnifications() {
 
 Dataset Dataset::createCorrespondingOverlayLayer() {
     Dataset info = *this;
-    info.type = api == API::Heidelbrain ? CubeType::SEGMENTATION_SZ_ZIP : CubeType::SEGMENTATION_UNCOMPRESSED_64;
+    info.type = api == API::Heidelbrain ? overlayType : CubeType::SEGMENTATION_UNCOMPRESSED_64;
     return info;
 }
 
@@ -286,18 +286,9 @@ QUrl Dataset::knossosCubeUrl(const Coordinate coord) const {
             .arg(cubeCoord.y, 4, 10, QChar('0'))
             .arg(cubeCoord.z, 4, 10, QChar('0'));
 
-    if (type == Dataset::CubeType::RAW_UNCOMPRESSED) {
-        filename = filename.arg(".raw");
-    } else if (type == Dataset::CubeType::RAW_JPG) {
-        filename = filename.arg(".jpg");
-    } else if (type == Dataset::CubeType::RAW_J2K) {
-        filename = filename.arg(".j2k");
-    } else if (type == Dataset::CubeType::RAW_JP2_6) {
-        filename = filename.arg(".6.jp2");
-    } else if (type == Dataset::CubeType::SEGMENTATION_SZ_ZIP) {
-        filename = filename.arg(".seg.sz.zip");
-    } else if (type == Dataset::CubeType::SEGMENTATION_UNCOMPRESSED_64) {
-        filename = filename.arg(".seg");
+    const auto & extension = CubeCodec::get(type).extension;
+    if (!extension.isEmpty()) {
+        filename = filename.arg("." + extension);
     }
 
     auto base = url;
@@ -361,8 +352,5 @@ QUrl Dataset::apiSwitch(const Coordinate globalCoord) const {
 }
 
 bool Dataset::isOverlay() const {
-    return type == CubeType::SEGMENTATION_UNCOMPRESSED_16
-            || type == CubeType::SEGMENTATION_UNCOMPRESSED_64
-            || type == CubeType::SEGMENTATION_SZ_ZIP
-            || type == CubeType::SNAPPY;
+    return CubeCodec::get(type).segmentation;
 }
@@ -37,6 +37,7 @@ struct Dataset {
     };
     enum class CubeType {
         RAW_UNCOMPRESSED, RAW_JPG, RAW_J2K, RAW_JP2_6, SEGMENTATION_UNCOMPRESSED_16, SEGMENTATION_UNCOMPRESSED_64, SEGMENTATION_SZ_ZIP, SNAPPY
+        , SEGMENTATION_SZ, RAW_ZSTD, SEGMENTATION_ZSTD, RAW_LZ4, SEGMENTATION_LZ4
     };
     QString compressionString() const;
 
@@ -61,6 +62,7 @@ struct Dataset {
 
     API api{API::Heidelbrain};
     CubeType type{CubeType::RAW_UNCOMPRESSED};
+    CubeType overlayType{CubeType::SEGMENTATION_SZ_ZIP};// of the overlay layer of heidelbrain datasets
     // Edge length of the current data set in data pixels.
     Coordinate boundary{1000, 1000, 1000};
     // pixel-to-nanometer scale
@@ -22,11 +22,171 @@
 
 #include "hashtable.h"
 
-void * Coordinate2BytePtr_hash_get_or_fail(const coord2bytep_map_t &h, const CoordOfCube &c) {
-    const auto gotIt = h.find(c);
-    if (gotIt == std::end(h)) {
+#include "kernelbench.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+CubeHash::Pin::Pin(const CubeHash & hash) : pins{hash.pins.get()} {
+    while (true) {// a pin counted on the old side after the phase changed might be missed by the waiter
+        side = pins->phase % 2;
+        ++pins->count[side];
+        if (pins->phase % 2 == side) {
+            break;
+        }
+        pins->release(side);
+    }
+}
+
+void CubeHash::Pin::unlock() {
+    if (pins != nullptr) {
+        pins->release(side);
+        pins = nullptr;
+    }
+}
+
+void CubeHash::waitForUnpinned() const {
+    QMutexLocker serial(&pins->waiters);
+    QMutexLocker locker(&pins->mutex);
+    const auto side = pins->phase++ % 2;// new pins count on the other side
+    while (pins->count[side] != 0) {
+        pins->released.wait(&pins->mutex);
+    }
+}
+
+void * CubeHash::get(const CoordOfCube & coord) const {
+    auto & shard = this->shard(coord);
+    QReadLocker locker(&shard.lock);
+    const auto gotIt = shard.cubes.find(coord);
+    return gotIt != std::end(shard.cubes) ? gotIt->second : nullptr;
+}
+
+void CubeHash::emplace(const CoordOfCube & coord, void * cube) {
+    auto & shard = this->shard(coord);
+    QWriteLocker locker(&shard.lock);
+    shard.cubes[coord] = cube;
+}
+
+void * CubeHash::take(const CoordOfCube & coord) {
+    auto & shard = this->shard(coord);
+    QWriteLocker locker(&shard.lock);
+    const auto gotIt = shard.cubes.find(coord);
+    if (gotIt == std::end(shard.cubes)) {
         return nullptr;
     }
+    auto * cube = gotIt->second;
+    shard.cubes.erase(gotIt);
+    return cube;
+}
+
+void CubeHash::erase(const CoordOfCube & coord) {
+    take(coord);
+}
+
+void CubeHash::clear() {
+    for (auto & shard : *shards) {
+        QWriteLocker locker(&shard.lock);
+        shard.cubes.clear();
+    }
+}
+
+std::size_t CubeHash::size() const {
+    std::size_t count{0};
+    for (const auto & shard : *shards) {
+        QReadLocker locker(&shard.lock);
+        count += shard.cubes.size();
+    }
+    return count;
+}
+
+void * Coordinate2BytePtr_hash_get_or_fail(const coord2bytep_map_t &h, const CoordOfCube &c) {
+    return h.get(c);
+}
+
+namespace {
+constexpr int benchmarkGrid = 16;
+
+CoordOfCube benchmarkCube(const std::uint64_t key) {
+    return {static_cast<int>(key % benchmarkGrid), static_cast<int>(key / benchmarkGrid % benchmarkGrid), static_cast<int>(key / benchmarkGrid / benchmarkGrid % benchmarkGrid)};
+}
+
+template<typename Get, typename Replace>
+double contendedLookups(const int threads, const std::size_t lookups, Get get, Replace replace) {
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads + 1);
+    std::atomic<bool> done{false};
+    auto writer = QtConcurrent::run(&pool, [&done, &replace](){
+        for (std::uint64_t i{0}; !done; ++i) {
+            replace(benchmarkCube(KernelBench::mix(i)));
+        }
+    });
+    std::atomic<std::uintptr_t> sink{0};
+    std::vector<QFuture<void>> readers;
+    QElapsedTimer timer;
+    timer.start();
+    for (int thread{0}; thread < threads; ++thread) {
+        readers.emplace_back(QtConcurrent::run(&pool, [thread, lookups, &get, &sink](){
+            std::uintptr_t sum{0};
+            for (std::size_t i{0}; i < lookups; ++i) {
+                sum += reinterpret_cast<std::uintptr_t>(get(benchmarkCube(KernelBench::mix(i * benchmarkGrid + thread))));
+            }
+            sink += sum;
+        }));
+    }
+    for (auto & reader : readers) {
+        reader.waitForFinished();
+    }
+    const auto elapsed = timer.nsecsElapsed();
+    done = true;
+    writer.waitForFinished();
+    return static_cast<double>(elapsed) / lookups;
+}
+}
+
+std::vector<CubeHash::BenchmarkResult> CubeHash::benchmark(const std::vector<int> & threads, const int repetitions) {
+    const auto lookups = static_cast<std::size_t>(repetitions) * 100000;
+    const auto slot = [](const CoordOfCube & coord){
+        return reinterpret_cast<void *>(static_cast<std::uintptr_t>(1 + coord.x + benchmarkGrid * (coord.y + benchmarkGrid * coord.z)));
+    };
+    std::vector<BenchmarkResult> results;
+    for (const auto count : threads) {
+        // the single map with the global mutex the loader and the viewer used to share
+        QMutex mutex;
+        std::unordered_map<CoordOfCube, void *> map;
+        CubeHash hash;
+        for (int i{0}; i < benchmarkGrid * benchmarkGrid * benchmarkGrid; ++i) {
+            map[benchmarkCube(i)] = slot(benchmarkCube(i));
+            hash.emplace(benchmarkCube(i), slot(benchmarkCube(i)));
+        }
+        results.push_back({count, "global mutex", contendedLookups(count, lookups, [&mutex, &map](const CoordOfCube & coord){
+            QMutexLocker locker(&mutex);
+            const auto it = map.find(coord);
+            return it != std::end(map) ? it->second : nullptr;
+        }, [&mutex, &map, &slot](const CoordOfCube & coord){
+            QMutexLocker locker(&mutex);
+            map.erase(coord);
+            map[coord] = slot(coord);
+        })});
+        results.push_back({count, "sharded", contendedLookups(count, lookups, [&hash](const CoordOfCube & coord){
+            return hash.get(coord);
+        }, [&hash, &slot](const CoordOfCube & coord){
+            hash.erase(coord);
+            hash.emplace(coord, slot(coord));
+        })});
+    }
+    return results;
+}
 
-    return gotIt->second;
+namespace {
+const KernelBench::Registration registration{"cube index contention", 5, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : CubeHash::benchmark({1, 2, 4, 8}, repetitions)) {
+        results.append(QVariantMap{{"threads", result.threads}
+            , {"method", result.method}
+            , {"ns_per_lookup", result.nsPerLookup}});
+    }
+    return results;
+}};
 }
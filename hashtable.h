@@ -25,9 +25,119 @@
 
 #include "coordinate.h"
 
+#include <QMutex>
+#include <QReadLocker>
+#include <QReadWriteLock>
+#include <QString>
+#include <QWaitCondition>
+#include <QWriteLocker>
+
+#include <array>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
+#include <vector>
+
+/**
+ * @brief CubeHash maps cube coordinates to the slots the cubes are loaded into.
+ *
+ * The keys are distributed over independently locked shards, so the viewer, the
+ * decompression pool and the loader only serialize when they touch the same shard
+ * and lookups never wait for each other.
+ * Every member is safe to call concurrently, no external locking is required.
+ */
+class CubeHash {
+    static constexpr std::size_t shardCount = 16;
+    struct Shard {
+        mutable QReadWriteLock lock;
+        std::unordered_map<CoordOfCube, void *> cubes;
+    };
+    // behind pointers so the hash stays movable (the locks aren’t)
+    std::unique_ptr<std::array<Shard, shardCount>> shards{new std::array<Shard, shardCount>};
+    struct Pins {
+        std::atomic<std::size_t> phase{0};// pins count on the side of the phase parity
+        std::array<std::atomic<std::size_t>, 2> count;
+        QMutex waiters;// one phase change at a time
+        QMutex mutex;
+        QWaitCondition released;
+        void release(const std::size_t side) {
+            if (--count[side] == 0) {
+                QMutexLocker locker(&mutex);
+                released.wakeAll();
+            }
+        }
+        Pins() {
+            count[0] = count[1] = 0;
+        }
+    };
+    std::unique_ptr<Pins> pins{new Pins};
+
+    Shard & shard(const CoordOfCube & coord) const {
+        return (*shards)[std::hash<CoordOfCube>{}(coord) % shardCount];
+    }
+public:
+    /**
+     * @brief Pin keeps the slots of the cubes looked up during its lifetime from being reused.
+     *
+     * Lookups alone only guarantee the slot was valid when it was found. Readers who keep
+     * working on the slots afterwards hold a Pin, the loader waits for them (waitForUnpinned)
+     * before it hands the slots of removed cubes to other cubes.
+     * Taking one never waits and it may be released on another thread than the one which took it.
+     * Don’t block on the loader while holding one.
+     */
+    class Pin {
+        Pins * pins;
+        std::size_t side;
+    public:
+        explicit Pin(const CubeHash & hash);
+        Pin(const Pin &) = delete;
+        Pin & operator=(const Pin &) = delete;
+        ~Pin() {
+            unlock();
+        }
+        void unlock();
+    };
+    void waitForUnpinned() const;// returns when no Pin taken before the call is alive anymore
+    void * get(const CoordOfCube & coord) const;
+    void emplace(const CoordOfCube & coord, void * cube);// inserts or replaces
+    void * take(const CoordOfCube & coord);// removes and returns the cube
+    void erase(const CoordOfCube & coord);
+    void clear();
+    std::size_t size() const;
+
+    template<typename Func>
+    void forEach(Func func) const {
+        for (auto & shard : *shards) {
+            QReadLocker locker(&shard.lock);
+            for (const auto & elem : shard.cubes) {
+                func(elem.first, elem.second);
+            }
+        }
+    }
+    template<typename Predicate>
+    void eraseIf(Predicate predicate) {
+        for (auto & shard : *shards) {
+            QWriteLocker locker(&shard.lock);
+            for (auto it = std::begin(shard.cubes); it != std::end(shard.cubes);) {
+                if (predicate(it->first, it->second)) {
+                    it = shard.cubes.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    struct BenchmarkResult {
+        int threads;// looking up concurrently while one writer replaces cubes
+        QString method;// "global mutex" around one map like before or "sharded"
+        double nsPerLookup;// per looking up thread
+    };
+    // looks up random cubes of a grid of 16³ cubes, each thread repetitions · 100000 times
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & threads, const int repetitions);
+};
 
-using coord2bytep_map_t = std::unordered_map<CoordOfCube, void *>;
+using coord2bytep_map_t = CubeHash;
 
 void * Coordinate2BytePtr_hash_get_or_fail(const coord2bytep_map_t &h, const CoordOfCube &c);
 
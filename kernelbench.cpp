@@ -0,0 +1,86 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "kernelbench.h"
+
+#include <map>
+
+namespace {
+struct Entry {
+    int repetitions;// default
+    KernelBench::Benchmark benchmark;
+    KernelBench::Check check;
+};
+
+std::map<QString, Entry> & registry() {// filled during static initialization, so it must exist before the first registration
+    static std::map<QString, Entry> entries;
+    return entries;
+}
+}
+
+KernelBench::Registration::Registration(const QString & name, const int repetitions, Benchmark benchmark, Check check) {
+    registry()[name] = {repetitions, std::move(benchmark), std::move(check)};
+}
+
+QStringList KernelBench::benchmarks() {
+    QStringList names;
+    for (const auto & entry : registry()) {
+        names.append(entry.first);
+    }
+    return names;
+}
+
+QVariantList KernelBench::benchmark(const QString & name, const int repetitions) {
+    const auto it = registry().find(name);
+    if (it == std::end(registry())) {
+        return {};
+    }
+    return it->second.benchmark(repetitions > 0 ? repetitions : it->second.repetitions);
+}
+
+QVariantList KernelBench::check() {
+    QVariantList results;
+    for (const auto & entry : registry()) {
+        if (entry.second.check) {
+            results.append(entry.second.check());
+        }
+    }
+    return results;
+}
+
+std::uint64_t KernelBench::mix(std::uint64_t value) {
+    value *= 0x9E3779B97F4A7C15ull;
+    return value ^ (value >> 29);
+}
+
+bool KernelBench::inside(const Coordinate & pos, const Coordinate & first, const Coordinate & last) {
+    return pos.x >= first.x && pos.y >= first.y && pos.z >= first.z && pos.x <= last.x && pos.y <= last.y && pos.z <= last.z;
+}
+
+QVariantMap KernelBench::checkResult(const QString & kernel, const QString & check, const bool passed, const QString & detail) {
+    return {{"kernel", kernel}, {"check", check}, {"passed", passed}, {"detail", detail}};
+}
+
+QVariantMap KernelBench::voxelCheckResult(const QString & kernel, const QString & check, const std::size_t failures, const std::size_t voxels) {
+    return checkResult(kernel, check, failures == 0, QString("%1 of %2 voxels differ").arg(failures).arg(voxels));
+}
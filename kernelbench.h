@@ -0,0 +1,115 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef KERNELBENCH_H
+#define KERNELBENCH_H
+
+#include "coordinate.h"
+
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief KernelBench runs the benchmarks and the self checks of the voxel kernels from python.
+ *
+ * Each kernel registers its benchmark and checks next to its code with a static Registration.
+ * The benchmarks compare the kernels with the code they replaced, the checks compare them
+ * on synthetic cubes with the straightforward code they have to agree with.
+ */
+class KernelBench {
+public:
+    using Benchmark = std::function<QVariantList(int)>;// one map per measurement
+    using Check = std::function<QVariantList()>;// one map with kernel, check, passed and detail per check
+    struct Registration {
+        Registration(const QString & name, const int repetitions, Benchmark benchmark, Check check = nullptr);
+    };
+
+    static QStringList benchmarks();
+    // repetitions ≤ 0 uses the default of the benchmark, unknown names yield an empty list
+    static QVariantList benchmark(const QString & name, const int repetitions);
+    static QVariantList check();
+
+    // helpers for the checks
+    static std::uint64_t mix(std::uint64_t value);
+    static bool inside(const Coordinate & pos, const Coordinate & first, const Coordinate & last);
+    static QVariantMap checkResult(const QString & kernel, const QString & check, const bool passed, const QString & detail);
+    static QVariantMap voxelCheckResult(const QString & kernel, const QString & check, const std::size_t failures, const std::size_t voxels);
+
+    // cubesPerAxis³ cubes of one magnification starting at the origin
+    class SyntheticCubes {
+        int edge;
+        int cubesPerAxis;
+        int magnification;
+        std::vector<std::vector<std::uint64_t>> cubes;
+    public:
+        SyntheticCubes(const int edge, const int cubesPerAxis, const int magnification = 1)
+            : edge{edge}, cubesPerAxis{cubesPerAxis}, magnification{magnification}
+            , cubes(static_cast<std::size_t>(cubesPerAxis) * cubesPerAxis * cubesPerAxis, std::vector<std::uint64_t>(static_cast<std::size_t>(edge) * edge * edge)) {}
+        std::uint64_t * cube(const CoordOfCube & coord) {// nullptr outside
+            if (coord.x < 0 || coord.y < 0 || coord.z < 0 || coord.x >= cubesPerAxis || coord.y >= cubesPerAxis || coord.z >= cubesPerAxis) {
+                return nullptr;
+            }
+            return cubes[coord.x + cubesPerAxis * (coord.y + cubesPerAxis * coord.z)].data();
+        }
+        std::function<std::uint64_t *(const CoordOfCube &)> lookup() {
+            return [this](const CoordOfCube & coord){
+                return cube(coord);
+            };
+        }
+        std::vector<std::pair<CoordOfCube, std::uint64_t *>> all() {
+            std::vector<std::pair<CoordOfCube, std::uint64_t *>> result;
+            for (int z = 0; z < cubesPerAxis; ++z)
+            for (int y = 0; y < cubesPerAxis; ++y)
+            for (int x = 0; x < cubesPerAxis; ++x) {
+                result.emplace_back(CoordOfCube{x, y, z}, cube({x, y, z}));
+            }
+            return result;
+        }
+        Coordinate globalMax() const {
+            return Coordinate{1, 1, 1} * (edge * cubesPerAxis * magnification - 1);
+        }
+        template<typename Func>
+        void forEach(Func func) {// func(global position, id)
+            for (int cz = 0; cz < cubesPerAxis; ++cz)
+            for (int cy = 0; cy < cubesPerAxis; ++cy)
+            for (int cx = 0; cx < cubesPerAxis; ++cx) {
+                auto * ids = cube({cx, cy, cz});
+                const auto origin = CoordOfCube{cx, cy, cz}.cube2Global(edge, magnification);
+                for (int z = 0; z < edge; ++z)
+                for (int y = 0; y < edge; ++y)
+                for (int x = 0; x < edge; ++x, ++ids) {
+                    func(origin + Coordinate{x, y, z} * magnification, *ids);
+                }
+            }
+        }
+    };
+};
+
+#endif//KERNELBENCH_H
@@ -22,6 +22,7 @@
 
 #include "loader.h"
 
+#include "cubecodec.h"
 #include "functions.h"
 #include "network.h"
 #include "segmentation/segmentation.h"
@@ -31,20 +32,21 @@
 #include "viewer.h"
 #include "widgets/mainwindow.h"
 
-#include <quazip.h>
-#include <quazipfile.h>
-
 #include <snappy.h>
 
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFuture>
-#include <QImage>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QStringList>
 #include <QtConcurrent>
 
+#include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <stdexcept>
 
 //generalizing this needs polymorphic lambdas or return type deduction
@@ -75,15 +77,34 @@ Loader::Controller::~Controller() {
     suspendLoader();
 }
 
+void Loader::Controller::prepareSlotArenas(const decltype(Dataset::datasets) & datasets) {
+    slotArenas.resize(datasets.size());
+    for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
+        const auto overlayFactor = datasets[layerId].isOverlay() ? OBJID_BYTES : 1;// overlay slots hold raw ids, see CompressedSegmentation
+        const auto slotBytes = state->cubeBytes * overlayFactor;
+        const auto slotCount = state->cubeSetBytes / state->cubeBytes;
+        if (slotArenas[layerId] == nullptr || !slotArenas[layerId]->fits(slotBytes, slotCount)) {
+            slotArenas[layerId].reset();// release before allocating the replacement
+            slotArenas[layerId].reset(new SlotArena(slotBytes, slotCount));
+        }
+    }
+}
+
 void Loader::Controller::unloadCurrentMagnification() {
     ++loadingNr;
     emit unloadCurrentMagnificationSignal();
 }
 
 void Loader::Controller::markOcCubeAsModified(const CoordOfCube &cubeCoord, const int magnification) {
-    emit markOcCubeAsModifiedSignal(cubeCoord, magnification);
+    markOcCubesAsModified({cubeCoord}, magnification);
+}
+
+void Loader::Controller::markOcCubesAsModified(const std::vector<CoordOfCube> & cubeCoords, const int magnification) {
+    emit markOcCubesAsModifiedSignal(cubeCoords, magnification);
     state->viewer->window->notifyUnsavedChanges();
-    state->viewer->reslice_notify_all(worker.get()->snappyLayerId, cubeCoord.cube2Global(Dataset::current().cubeEdgeLength, magnification));
+    for (const auto & cubeCoord : cubeCoords) {
+        state->viewer->reslice_notify_all(worker.get()->snappyLayerId, cubeCoord.cube2Global(Dataset::current().cubeEdgeLength, magnification));
+    }
 }
 
 decltype(Loader::Worker::snappyCache) Loader::Controller::getAllModifiedCubes() {
@@ -201,7 +222,7 @@ std::vector<CoordOfCube> Loader::Worker::DcoiFromPos(const CoordOfCube & current
 
 Loader::Worker::Worker(const decltype(datasets) & layers)
     : slotDownload(static_cast<std::size_t>(layers.size())), slotDecompression(static_cast<std::size_t>(layers.size()))
-    , slotChunk(static_cast<std::size_t>(layers.size())), freeSlots(static_cast<std::size_t>(layers.size()))
+    , freeSlots(static_cast<std::size_t>(layers.size())), queuedDownloads(static_cast<std::size_t>(layers.size()))
     , datasets{layers}
     , OcModifiedCacheQueue(static_cast<std::size_t>(std::log2(Dataset::current().highestAvailableMag)+1))
     , snappyCache(static_cast<std::size_t>(std::log2(Dataset::current().highestAvailableMag)+1))
@@ -214,59 +235,114 @@ Loader::Worker::Worker(const decltype(datasets) & layers)
     // datacube, we load it into a location from this list. Whenever a
     // datacube in memory becomes invalid, we add the pointer to its
     // memory location back into this list.
+    // The slots are carved out of the controllers arenas which are reused across restarts.
+    const auto & arenas = Loader::Controller::singleton().slotArenas;
     for (std::size_t layerId{0}; layerId < layers.size(); ++layerId) {
         state->cube2Pointer.emplace_back(std::log2(layers[layerId].highestAvailableMag)+1);
-        const auto overlayFactor = layers[layerId].isOverlay() ? OBJID_BYTES : 1;
-        qDebug() << "Allocating" << state->cubeSetBytes * overlayFactor / 1024. / 1024. << "MiB for cubes.";
-        for (size_t i = 0; i < state->cubeSetBytes * overlayFactor; i += state->cubeBytes * overlayFactor) {
-            slotChunk[layerId].emplace_back(state->cubeBytes * overlayFactor, 0);// zero init chunk of chars
-            freeSlots[layerId].emplace_back(slotChunk[layerId].back().data());// append newest element
+        for (std::size_t i{0}; i < arenas[layerId]->size(); ++i) {
+            freeSlots[layerId].emplace_back(arenas[layerId]->slot(i));
         }
     }
 }
 
 Loader::Worker::~Worker() {
     abortDownloadsFinishDecompression();
+    // completions the event loop didn’t get to anymore
+    decodeCompletions.consume_all([](const DecodeCompletion & completion){
+        delete completion.reply;// the slots belong to the arenas
+    });
+    prefetchCompletions.consume_all([](const PrefetchCompletion & completion){
+        delete completion.compressedCube;
+    });
+    evictionCompletions.consume_all([](const EvictionCompletion & completion){
+        delete completion.compressedCube;
+    });
 
     if (state->quitSignal) {
         return;//state is dead already
     }
 
-    state->protectCube2Pointer.lock();
     for (auto & layer : state->cube2Pointer) {
         for (auto & elem : layer) {
             elem.clear();
+            elem.waitForUnpinned();// the arena slots are reused by the next worker
         }
     }
-    state->protectCube2Pointer.unlock();
 }
 
-template<typename CubeHash, typename Slots, typename Keep>
-void unloadCubes(CubeHash & loadedCubes, Slots & freeSlots, Keep keep) {
+template<typename Cubes, typename Slots, typename Keep>
+void unloadCubes(Cubes & loadedCubes, Slots & freeSlots, Keep keep) {
     unloadCubes(loadedCubes, freeSlots, keep, [](const CoordOfCube &, void *){});
 }
 
-template<typename CubeHash, typename Slots, typename Keep, typename UnloadHook>
-void unloadCubes(CubeHash & loadedCubes, Slots & freeSlots, Keep keep, UnloadHook todo) {
-    for (auto it = std::begin(loadedCubes); it != std::end(loadedCubes);) {
-        if (!keep(it->first)) {
-            todo(CoordOfCube(it->first.x, it->first.y, it->first.z), it->second);
-            freeSlots.emplace_back(it->second);
-            it = loadedCubes.erase(it);
-        } else {
-            ++it;
+template<typename Cubes, typename Slots, typename Keep, typename UnloadHook, typename Release>
+void unloadCubes(Cubes & loadedCubes, Slots & freeSlots, Keep keep, UnloadHook todo, Release release) {
+    std::vector<std::pair<CoordOfCube, void *>> unloaded;
+    loadedCubes.eraseIf([&unloaded, &keep](const CoordOfCube & cubeCoord, void * remSlotPtr){
+        if (!keep(cubeCoord)) {
+            unloaded.emplace_back(cubeCoord, remSlotPtr);
+            return true;
+        }
+        return false;
+    });
+    if (unloaded.empty()) {
+        return;
+    }
+    // the hooks run outside the shard locks, the slots are reused only after the readers which found them are done
+    loadedCubes.waitForUnpinned();
+    for (const auto & elem : unloaded) {
+        todo(elem.first, elem.second);
+        if (release(elem.first, elem.second)) {// otherwise its owner returns it later
+            freeSlots.emplace_back(elem.second);
         }
     }
 }
 
+template<typename Cubes, typename Slots, typename Keep, typename UnloadHook>
+void unloadCubes(Cubes & loadedCubes, Slots & freeSlots, Keep keep, UnloadHook todo) {
+    unloadCubes(loadedCubes, freeSlots, keep, todo, [](const CoordOfCube &, void *){ return true; });
+}
+
+CompressedCubeCache::Format cacheFormat(const Dataset & dataset) {
+    return dataset.isOverlay() ? CompressedCubeCache::Format::Segmentation : CompressedCubeCache::Format::Snappy;
+}
+
+bool Loader::Worker::compressEvictedCube(const std::size_t layerId, const CoordOfCube & cubeCoord, void * slot) {
+    if (evictedCubes.maxSize() == 0) {
+        return true;
+    }
+    if (layerId == snappyLayerId) {// modified cubes belong to the snappy cache
+        const bool unflushed = OcModifiedCacheQueue[loaderMagnification].find(cubeCoord) != std::end(OcModifiedCacheQueue[loaderMagnification]);
+        const bool flushed = snappyCache[loaderMagnification].find(cubeCoord) != std::end(snappyCache[loaderMagnification]);
+        if (unflushed || flushed) {
+            return true;
+        }
+    }
+    const CompressedCubeKey key{layerId, loaderMagnification, cubeCoord};
+    const auto cubeBytes = state->cubeBytes * (datasets[layerId].isOverlay() ? OBJID_BYTES : 1);
+    // the loader thread goes on with the downloads, the slot stays reserved until the drain stores the result
+    evictions[key] = QtConcurrent::run(&decompressionPool, [this, key, slot, cubeBytes, format = cacheFormat(datasets[layerId])](){
+        evictionCompletions.push({key, slot, new std::string(CompressedCubeCache::compress(slot, cubeBytes, format))});
+        scheduleCompletionDrain();
+    });
+    return false;
+}
+
+void Loader::Worker::drainEvictions() {
+    evictionCompletions.consume_all([this](const EvictionCompletion & completion){
+        std::unique_ptr<std::string> compressedCube{completion.compressedCube};
+        evictedCubes.insert(completion.key, std::move(*compressedCube));
+        freeSlots[completion.key.layerId].emplace_back(completion.slot);
+        evictions.erase(completion.key);
+    });
+}
+
 void Loader::Worker::unloadCurrentMagnification() {
     abortDownloadsFinishDecompression([](const Coordinate &){return false;});
 
-    state->protectCube2Pointer.lock();
     for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
-        for (auto &elem : state->cube2Pointer[layerId][loaderMagnification]) {
-            const auto cubeCoord = elem.first;
-            const auto remSlotPtr = elem.second;
+        unloadCubes(state->cube2Pointer[layerId][loaderMagnification], freeSlots[layerId], [](const CoordOfCube &){ return false; }
+                    , [this, layerId](const CoordOfCube & cubeCoord, void * remSlotPtr){
             if (layerId == snappyLayerId) {
                 if (OcModifiedCacheQueue[loaderMagnification].find(cubeCoord) != std::end(OcModifiedCacheQueue[loaderMagnification])) {
                     snappyCacheBackupRaw(cubeCoord, remSlotPtr);
@@ -274,20 +350,20 @@ void Loader::Worker::unloadCurrentMagnification() {
                     OcModifiedCacheQueue[loaderMagnification].erase(cubeCoord);
                 }
             }
-            freeSlots[layerId].emplace_back(remSlotPtr);
-        }
-        state->cube2Pointer[layerId][loaderMagnification].clear();
+        }, [this, layerId](const CoordOfCube & cubeCoord, void * remSlotPtr){
+            return compressEvictedCube(layerId, cubeCoord, remSlotPtr);
+        });
     }
-    state->protectCube2Pointer.unlock();
 }
 
-void Loader::Worker::markOcCubeAsModified(const CoordOfCube &cubeCoord, const int magnification) {
-    OcModifiedCacheQueue[std::log2(magnification)].emplace(cubeCoord);
+void Loader::Worker::markOcCubesAsModified(const std::vector<CoordOfCube> & cubeCoords, const int magnification) {
+    OcModifiedCacheQueue[std::log2(magnification)].insert(std::begin(cubeCoords), std::end(cubeCoords));
 }
 
 void Loader::Worker::snappyCacheSupplySnappy(const CoordOfCube cubeCoord, const int magnification, const std::string cube) {
     const auto cubeMagnification = std::log2(magnification);
     snappyCache[cubeMagnification].emplace(std::piecewise_construct, std::forward_as_tuple(cubeCoord), std::forward_as_tuple(cube));
+    evictedCubes.erase({snappyLayerId, static_cast<std::size_t>(cubeMagnification), cubeCoord});// superseded
 
     if (cubeMagnification == loaderMagnification) {//unload if currently loaded
         const auto globalCoord = cubeCoord.cube2Global(Dataset::current().cubeEdgeLength, magnification);
@@ -297,16 +373,14 @@ void Loader::Worker::snappyCacheSupplySnappy(const CoordOfCube cubeCoord, const
         }
         auto decompressionIt = slotDecompression[snappyLayerId].find(globalCoord);
         if (decompressionIt != std::end(slotDecompression[snappyLayerId])) {
-            decompressionIt->second->waitForFinished();
+            decompressionIt->second.waitForFinished();
         }
-        state->protectCube2Pointer.lock();
-        const auto coord = cubeCoord;
-        auto cubePtr = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[snappyLayerId][loaderMagnification], coord);
+        auto & cubeHash = state->cube2Pointer[snappyLayerId][loaderMagnification];
+        auto cubePtr = cubeHash.take(cubeCoord);
         if (cubePtr != nullptr) {
+            cubeHash.waitForUnpinned();
             freeSlots[snappyLayerId].emplace_back(cubePtr);
-            state->cube2Pointer[snappyLayerId][loaderMagnification].erase(coord);
         }
-        state->protectCube2Pointer.unlock();
     }
 }
 
@@ -336,9 +410,7 @@ void Loader::Worker::flushIntoSnappyCache() {
 
     for (std::size_t mag = 0; mag < OcModifiedCacheQueue.size(); ++mag) {
         for (const auto & cubeCoord : OcModifiedCacheQueue[mag]) {
-            state->protectCube2Pointer.lock();
             auto cube = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[snappyLayerId][mag], {cubeCoord.x, cubeCoord.y, cubeCoord.z});
-            state->protectCube2Pointer.unlock();
             if (cube != nullptr) {
                 snappyCacheBackupRaw(cubeCoord, cube);
             }
@@ -358,14 +430,15 @@ void Loader::Worker::moveToThread(QThread *targetThread) {
 
 template<typename Downloads, typename Func>
 void abortDownloads(Downloads & downloads, Func keep) {
-    std::vector<Coordinate> abortQueue;
+    // batched cubes share their reply, it is only aborted if none of them are kept
+    std::unordered_map<QNetworkReply *, bool> replies;
     for (auto && elem : downloads) {
-        if (!keep(elem.first)) {
-            abortQueue.emplace_back(elem.first);
-        }
+        replies[elem.second] |= keep(elem.first);
     }
-    for (auto && elem : abortQueue) {
-        downloads[elem]->abort();//abort running downloads
+    for (auto && elem : replies) {
+        if (!elem.second) {
+            elem.first->abort();//abort running downloads
+        }
     }
 }
 
@@ -373,18 +446,26 @@ template<typename Decomp, typename Func>
 void finishDecompression(Decomp & decompressions, Func keep) {
     for (auto && elem : decompressions) {
         if (!keep(elem.first)) {
-            //elem.second->cancel();
-            elem.second->waitForFinished();
+            //elem.second.cancel();
+            elem.second.waitForFinished();
         }
     }
 }
 
 void Loader::Worker::abortDownloadsFinishDecompression() {
+    abortPrefetches({});
+    for (auto & elem : prefetchDecompressions) {
+        elem.second.waitForFinished();
+    }
+    for (auto & elem : evictions) {
+        elem.second.waitForFinished();
+    }
     abortDownloadsFinishDecompression([](const Coordinate &){return false;});
 }
 
 template<typename Func>
 void Loader::Worker::abortDownloadsFinishDecompression(Func keep) {
+    dropQueuedRequests();// the next load queues what is still needed in its own order
     for (auto & layer : slotDownload) {
         abortDownloads(layer, keep);
     }
@@ -393,76 +474,149 @@ void Loader::Worker::abortDownloadsFinishDecompression(Func keep) {
     }
 }
 
-std::pair<bool, void*> decompressCube(void * currentSlot, QIODevice & reply, const std::size_t layerId, const Dataset dataset, coord2bytep_map_t & cubeHash, const Coordinate globalCoord) {
-    if (!reply.isOpen()) {// sanity check, finished replies with no error should be ready for reading (https://bugreports.qt.io/browse/QTBUG-45944)
-        return {false, currentSlot};
+bool decodeCube(void * currentSlot, QByteArray data, const Dataset & dataset) {
+    return CubeCodec::get(dataset.type).decode(data.constData(), data.size(), currentSlot, dataset.cubeEdgeLength);
+}
+
+std::pair<bool, void*> decompressCube(void * currentSlot, QByteArray data, const std::size_t layerId, const Dataset dataset, coord2bytep_map_t & cubeHash, const Coordinate globalCoord) {
+    QThread::currentThread()->setPriority(QThread::IdlePriority);
+    const bool success = decodeCube(currentSlot, std::move(data), dataset);
+    if (success) {
+        cubeHash.emplace(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification), currentSlot);
+        state->viewer->reslice_notify_all(layerId, globalCoord);
     }
+
+    return {success, currentSlot};
+}
+
+// reads a cube of a file:// dataset on the calling thread, uncompressed cubes go straight into the slot
+bool readLocalCube(void * currentSlot, const QString & path, const Dataset & dataset) {
+    QThread::currentThread()->setPriority(QThread::IdlePriority);
+    const qint64 cubeBytes = state->cubeBytes * (dataset.isOverlay() ? OBJID_BYTES : 1);
+    QFile file(path);
+    if (!file.exists()) {// missing cubes are filled, like a 404 of a remote dataset
+        std::fill(reinterpret_cast<std::uint8_t *>(currentSlot), reinterpret_cast<std::uint8_t *>(currentSlot) + cubeBytes, 0);
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    if (dataset.type == Dataset::CubeType::RAW_UNCOMPRESSED) {
+        return file.size() == cubeBytes && file.read(reinterpret_cast<char *>(currentSlot), cubeBytes) == cubeBytes;
+    }
+    auto * mapped = file.map(0, file.size());
+    if (mapped == nullptr) {
+        return decodeCube(currentSlot, file.readAll(), dataset);
+    }
+    const bool success = decodeCube(currentSlot, QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), static_cast<int>(file.size())), dataset);
+    file.unmap(mapped);
+    return success;
+}
+
+std::string decodeAndCompress(QByteArray data, const Dataset & dataset, const std::size_t cubeBytes) {
     QThread::currentThread()->setPriority(QThread::IdlePriority);
-    bool success = false;
+    std::vector<std::uint8_t> cube(cubeBytes);
+    return decodeCube(cube.data(), std::move(data), dataset) ? CompressedCubeCache::compress(cube.data(), cubeBytes, cacheFormat(dataset)) : std::string{};
+}
 
-    auto data = reply.read(reply.bytesAvailable());//readAll can be very slow – https://bugreports.qt.io/browse/QTBUG-45926
-    const std::size_t availableSize = data.size();
+QNetworkRequest cubeRequest(const Dataset & dataset, const Coordinate & globalCoord) {
+    QUrl dcUrl = dataset.apiSwitch(globalCoord);
+    //transform googles oauth2 token from query item to request header
+    QUrlQuery originalQuery(dcUrl);
+    auto reducedQuery = originalQuery;
+    reducedQuery.removeQueryItem("access_token");
+    dcUrl.setQuery(reducedQuery);
+
+    auto request = QNetworkRequest(dcUrl);
+
+    if (originalQuery.hasQueryItem("access_token")) {
+        const auto authorization =  QString("Bearer ") + originalQuery.queryItemValue("access_token");
+        request.setRawHeader("Authorization", authorization.toUtf8());
+    }
+    //request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+    //request.setAttribute(QNetworkRequest::SpdyAllowedAttribute, true);
+    request.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, Loader::Controller::singleton().http2.load());
+    return request;
+}
+
+// size of one cube inside a multi-cube response, 0 if the backend can’t batch this layer
+std::size_t batchedCubeBytes(const Dataset & dataset) {
+    if (dataset.api != Dataset::API::WebKnossos) {
+        return 0;
+    }
     if (dataset.type == Dataset::CubeType::RAW_UNCOMPRESSED) {
-        const std::size_t expectedSize = state->cubeBytes;
-        if (availableSize == expectedSize) {
-            std::copy(std::begin(data), std::end(data), reinterpret_cast<std::uint8_t *>(currentSlot));
-            success = true;
-        }
-    } else if (dataset.type == Dataset::CubeType::RAW_JPG || dataset.type == Dataset::CubeType::RAW_J2K || dataset.type == Dataset::CubeType::RAW_JP2_6) {
-        const auto image = QImage::fromData(data).convertToFormat(QImage::Format_Indexed8);
-        const qint64 expectedSize = state->cubeBytes;
-        if (image.byteCount() == expectedSize) {
-            std::copy(image.bits(), image.bits() + image.byteCount(), reinterpret_cast<std::uint8_t *>(currentSlot));
-            success = true;
-        }
+        return state->cubeBytes;
     } else if (dataset.type == Dataset::CubeType::SEGMENTATION_UNCOMPRESSED_16) {
-        const std::size_t expectedSize = state->cubeBytes * OBJID_BYTES / 4;
-        if (availableSize == expectedSize) {
-            boost::multi_array_ref<uint16_t, 1> dataRef(reinterpret_cast<uint16_t *>(data.data()), boost::extents[std::pow(dataset.cubeEdgeLength, 3)]);
-            boost::multi_array_ref<uint64_t, 1> slotRef(reinterpret_cast<uint64_t *>(currentSlot), boost::extents[std::pow(dataset.cubeEdgeLength, 3)]);
-            std::copy(std::begin(dataRef), std::end(dataRef), std::begin(slotRef));
-            success = true;
-        }
+        return state->cubeBytes * OBJID_BYTES / 4;
     } else if (dataset.type == Dataset::CubeType::SEGMENTATION_UNCOMPRESSED_64) {
-        const std::size_t expectedSize = state->cubeBytes * OBJID_BYTES;
-        if (availableSize == expectedSize) {
-            std::copy(std::begin(data), std::end(data), reinterpret_cast<std::uint64_t *>(currentSlot));
-            success = true;
-        }
-    } else if (dataset.type == Dataset::CubeType::SEGMENTATION_SZ_ZIP) {
-        QBuffer buffer(&data);
-        QuaZip archive(&buffer);//QuaZip needs a random access QIODevice
-        if (archive.open(QuaZip::mdUnzip)) {
-            archive.goToFirstFile();
-            QuaZipFile file(&archive);
-            if (file.open(QIODevice::ReadOnly)) {
-                auto data = file.readAll();
-                std::size_t uncompressedSize;
-                snappy::GetUncompressedLength(data.data(), data.size(), &uncompressedSize);
-                const std::size_t expectedSize = state->cubeBytes * OBJID_BYTES;
-                if (uncompressedSize == expectedSize) {
-                    success = snappy::RawUncompress(data.data(), data.size(), reinterpret_cast<char*>(currentSlot));
-                }
-            }
-            archive.close();
+        return state->cubeBytes * OBJID_BYTES;
+    }
+    return 0;
+}
+
+QNetworkReply * Loader::Worker::sendCubeRequest(QNetworkRequest request, const Dataset & dataset, const std::vector<Coordinate> & globalCoords) {
+    QNetworkReply * reply;
+    if (dataset.api == Dataset::API::WebKnossos) {// the response contains the cubes in request order
+        request.setRawHeader("Content-Type", "application/json");
+        QStringList cubes;
+        for (const auto & globalCoord : globalCoords) {
+            cubes.append(QString{R"json({"position":[%1,%2,%3],"zoomStep":%4,"cubeSize":%5,"fourBit":false})json"}.arg(globalCoord.x).arg(globalCoord.y).arg(globalCoord.z).arg(int_log(dataset.magnification)).arg(dataset.cubeEdgeLength));
         }
+        reply = qnam.post(request, QString{"[%1]"}.arg(cubes.join(",")).toUtf8());
     } else {
-        qDebug() << "unsupported format";
+        reply = qnam.get(request);
     }
+    reply->setParent(nullptr);//reparent, so it don’t gets destroyed with qnam
+    auto & stats = Loader::Controller::singleton().metrics.transport;
+    ++stats.requests;
+    ++stats.inFlight;
+    QElapsedTimer timer;
+    timer.start();
+    // connected before the callers handler, so queued requests are sent as early as possible
+    QObject::connect(reply, &QNetworkReply::finished, this, [this, reply, timer, &stats](){
+        --stats.inFlight;
+        if (reply->error() == QNetworkReply::NoError) {
+            Loader::Controller::singleton().metrics.recordDownload(timer.elapsed(), reply->bytesAvailable());
+        }
+        const auto limit = Loader::Controller::singleton().maxRequestsInFlight.load();
+        while (!queuedRequests.empty() && (limit == 0 || stats.inFlight < limit)) {
+            auto send = queuedRequests.front();
+            queuedRequests.pop_front();
+            stats.queued = queuedRequests.size();
+            send();
+        }
+    });
+    return reply;
+}
 
-    if (success) {
-        state->protectCube2Pointer.lock();
-        cubeHash[globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification)] = currentSlot;
-        state->protectCube2Pointer.unlock();
-        state->viewer->reslice_notify_all(layerId, globalCoord);
+void Loader::Worker::throttledRequest(const std::size_t layerId, const std::vector<Coordinate> & globalCoords, std::function<void()> send) {
+    auto & stats = Loader::Controller::singleton().metrics.transport;
+    const auto limit = Loader::Controller::singleton().maxRequestsInFlight.load();
+    if (limit == 0 || (stats.inFlight < limit && queuedRequests.empty())) {
+        send();
+        return;
     }
+    queuedDownloads[layerId].insert(std::begin(globalCoords), std::end(globalCoords));
+    queuedRequests.emplace_back([this, layerId, globalCoords, send](){
+        for (const auto & globalCoord : globalCoords) {
+            queuedDownloads[layerId].erase(globalCoord);
+        }
+        send();
+    });
+    stats.queued = queuedRequests.size();
+}
 
-    return {success, currentSlot};
+void Loader::Worker::dropQueuedRequests() {
+    queuedRequests.clear();
+    for (auto & layer : queuedDownloads) {
+        layer.clear();
+    }
+    Loader::Controller::singleton().metrics.transport.queued = 0;
 }
 
+
 void Loader::Worker::cleanup(const Coordinate center) {
     abortDownloadsFinishDecompression(currentlyVisibleWrap(center));
-    state->protectCube2Pointer.lock();
     for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
         unloadCubes(state->cube2Pointer[layerId][loaderMagnification], freeSlots[layerId], insideCurrentSupercubeWrap(center, datasets[layerId])
                     , [this, layerId](const CoordOfCube & cubeCoord, void * remSlotPtr){
@@ -473,31 +627,96 @@ void Loader::Worker::cleanup(const Coordinate center) {
                     OcModifiedCacheQueue[loaderMagnification].erase(cubeCoord);
                 }
             }
+        }, [this, layerId](const CoordOfCube & cubeCoord, void * remSlotPtr){
+            return compressEvictedCube(layerId, cubeCoord, remSlotPtr);
         });
     }
-    state->protectCube2Pointer.unlock();
 }
 
 void Loader::Controller::startLoading(const Coordinate & center, const UserMoveType userMoveType, const floatCoordinate & direction) {
     if (worker != nullptr) {
         worker->isFinished = false;
-        emit loadSignal(++loadingNr, center, userMoveType, direction, Dataset::datasets);
+        // direction of the last traced segment of the active node, hints the prefetcher where tracing continues
+        floatCoordinate treeDirection;
+        if (state->skeletonState != nullptr && state->skeletonState->activeNode != nullptr) {
+            const auto & activeNode = *state->skeletonState->activeNode;
+            for (const auto & segment : activeNode.segments) {
+                const auto & neighbor = segment.forward ? segment.target : segment.source;
+                treeDirection = activeNode.position - neighbor.position;
+                if (!segment.forward) {// prefer the node the active node was traced from
+                    break;
+                }
+            }
+        }
+        emit loadSignal(++loadingNr, center, userMoveType, direction, treeDirection, Dataset::datasets);
+    }
+}
+
+void Loader::Worker::scheduleCompletionDrain() {
+    if (!completionDrainScheduled.exchange(true)) {// one queued call drains everything that finished until then
+        QMetaObject::invokeMethod(this, "drainCompletions", Qt::QueuedConnection);
     }
 }
 
+void Loader::Worker::drainCompletions() {
+    completionDrainScheduled = false;// completions pushed from now on schedule another drain
+    auto & stats = Loader::Controller::singleton().metrics.pipeline;
+    ++stats.batches;
+    decodeCompletions.consume_all([this, &stats](const DecodeCompletion & completion){
+        if (completion.success) {
+            ++stats.inserted;
+            cubeLoaded(completion.globalCoord);
+        } else {
+            ++stats.failed;
+            qCritical() << completion.layerId << completion.globalCoord << static_cast<int>(datasets[completion.layerId].type) << "decompression failed → no fill";
+            freeSlots[completion.layerId].emplace_back(completion.slot);
+        }
+        if (completion.reply != nullptr) {
+            completion.reply->deleteLater();
+        }
+        slotDecompression[completion.layerId].erase(completion.globalCoord);
+    });
+    drainEvictions();
+    prefetchCompletions.consume_all([this](const PrefetchCompletion & completion){
+        std::unique_ptr<std::string> compressedCube{completion.compressedCube};
+        // the cube may have entered the supercube and been loaded regularly in the meantime
+        const bool loaded = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[completion.key.layerId][completion.key.magnification], completion.key.cube) != nullptr;
+        if (!compressedCube->empty() && !loaded) {
+            evictedCubes.insert(completion.key, std::move(*compressedCube));
+            prefetchedCubes.emplace(completion.key);
+        }
+        prefetchDecompressions.erase(completion.key);
+    });
+    broadcastProgress();
+}
+
 void Loader::Worker::broadcastProgress(bool startup) {
     std::size_t count{0};
     for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
         count += slotDownload[layerId].size() + slotDecompression[layerId].size();
+        Loader::Controller::singleton().metrics.recordQueueDepth(layerId, slotDownload[layerId].size(), slotDecompression[layerId].size(), queuedDownloads[layerId].size());
     }
     isFinished = count == 0;
     emit progress(startup, count);
 }
 
-void Loader::Worker::downloadAndLoadCubes(const unsigned int loadingNr, const Coordinate center, const UserMoveType userMoveType, const floatCoordinate & direction, const Dataset::list_t & changedDatasets) {
+void Loader::Worker::cubeLoaded(const Coordinate & globalCoord) {
+    if (awaitingVisibleCube && currentlyVisibleWrap(jumpCenter)(globalCoord)) {
+        Loader::Controller::singleton().metrics.recordFirstVisibleCube(sinceJump.elapsed());
+        awaitingVisibleCube = false;
+    }
+}
+
+void Loader::Worker::downloadAndLoadCubes(const unsigned int loadingNr, const Coordinate center, const UserMoveType userMoveType, const floatCoordinate & direction, const floatCoordinate & treeDirection, const Dataset::list_t & changedDatasets) {
     QTime time;
     time.start();
     datasets = changedDatasets;
+    const auto cubeSize = datasets.front().cubeEdgeLength * datasets.front().magnification;
+    if (recentCenters.empty() || (center - recentCenters.back()).length() > state->M * cubeSize) {// jumped, measure until something is visible again
+        jumpCenter = center;
+        sinceJump.start();
+        awaitingVisibleCube = true;
+    }
     cleanup(center);
     decltype(Dataset::magnification) magnification = Dataset::current().magnification;
     loaderMagnification = std::log2(magnification);
@@ -509,7 +728,6 @@ void Loader::Worker::downloadAndLoadCubes(const unsigned int loadingNr, const Co
     std::vector<Coordinate> cacheCubes;
     for (auto && todo : Dcoi) {
         const Coordinate globalCoord = todo.cube2Global(cubeEdgeLen, magnification);
-        state->protectCube2Pointer.lock();
         for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
             // only queue downloads which are necessary
             if (Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[layerId][loaderMagnification], globalCoord.cube(cubeEdgeLen, magnification)) == nullptr) {
@@ -521,10 +739,157 @@ void Loader::Worker::downloadAndLoadCubes(const unsigned int loadingNr, const Co
                 }
             }
         }
-        state->protectCube2Pointer.unlock();
     }
 
-    auto startDownload = [this, center](const std::size_t layerId, const Dataset dataset, const Coordinate globalCoord, decltype(slotDownload)::value_type & downloads
+    auto startDecompression = [this](const std::size_t layerId, const Coordinate globalCoord, decltype(slotDecompression)::value_type & decompressions, QNetworkReply * reply, std::function<DecompressionResult()> job){
+        decompressions[globalCoord] = QtConcurrent::run(&decompressionPool, [this, layerId, globalCoord, reply, job, type = datasets[layerId].type](){
+            QElapsedTimer timer;
+            timer.start();
+            const auto result = job();
+            Loader::Controller::singleton().metrics.recordDecode(type, timer.nsecsElapsed() / 1000);
+            ++Loader::Controller::singleton().metrics.pipeline.decoded;
+            decodeCompletions.push({layerId, globalCoord, result.first, result.second, reply});
+            scheduleCompletionDrain();
+            return result;
+        });
+    };
+    auto download = [this, center, startDecompression](const std::size_t layerId, const Dataset dataset, const Coordinate globalCoord, decltype(slotDownload)::value_type & downloads
+            , decltype(slotDecompression)::value_type & decompressions, decltype(freeSlots)::value_type & freeSlots, decltype(state->cube2Pointer)::value_type::value_type & cubeHash){
+        auto request = cubeRequest(dataset, globalCoord);
+        auto & diskCache = Loader::Controller::singleton().diskCache;
+        const auto diskCacheKey = diskCache.enabled() ? CubeDiskCache::key(request.url(), dataset.magnification, globalCoord) : std::string{};
+        if (globalCoord == center.cube(dataset.cubeEdgeLength, dataset.magnification).cube2Global(dataset.cubeEdgeLength, dataset.magnification)) {
+            //the first download usually finishes last (which is a bug) so we put it alone in the high priority bucket
+            request.setPriority(QNetworkRequest::HighPriority);
+        } else if (!currentlyVisibleWrap(center)(globalCoord)) {// only needed once we move
+            request.setPriority(QNetworkRequest::LowPriority);
+        }
+
+        auto * reply = sendCubeRequest(request, dataset, {globalCoord});
+        downloads[globalCoord] = reply;
+        broadcastProgress(true);
+        QObject::connect(reply, &QNetworkReply::finished, [this, layerId, dataset, reply, globalCoord, &downloads, &decompressions, &freeSlots, &cubeHash, startDecompression, &diskCache, diskCacheKey](){
+            if (freeSlots.empty()) {
+                ++Loader::Controller::singleton().metrics.pipeline.slotExhaustions;
+                qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << "no slots for decompression" << cubeHash.size() << freeSlots.size();
+                reply->deleteLater();
+                downloads.erase(globalCoord);
+                broadcastProgress();
+                return;
+            }
+            if (reply->error() == QNetworkReply::NoError) {
+                ++Loader::Controller::singleton().metrics.pipeline.downloaded;
+                auto * currentSlot = freeSlots.front();
+                freeSlots.pop_front();
+                downloads.erase(globalCoord);
+                startDecompression(layerId, globalCoord, decompressions, reply, [reply, currentSlot, layerId, dataset, &cubeHash, globalCoord, &diskCache, diskCacheKey](){
+                    if (!reply->isOpen()) {// sanity check, finished replies with no error should be ready for reading (https://bugreports.qt.io/browse/QTBUG-45944)
+                        return DecompressionResult{false, currentSlot};
+                    }
+                    const auto data = reply->read(reply->bytesAvailable());//readAll can be very slow – https://bugreports.qt.io/browse/QTBUG-45926
+                    const auto result = decompressCube(currentSlot, data, layerId, dataset, cubeHash, globalCoord);
+                    if (result.first && !diskCacheKey.empty()) {
+                        diskCache.store(diskCacheKey, data);
+                    }
+                    return result;
+                });
+            } else {
+                if (reply->error() == QNetworkReply::ContentNotFoundError) {//404 → fill
+                    auto * currentSlot = freeSlots.front();
+                    freeSlots.pop_front();
+                    std::fill(reinterpret_cast<std::uint8_t *>(currentSlot), reinterpret_cast<std::uint8_t *>(currentSlot) + state->cubeBytes * (dataset.isOverlay() ? OBJID_BYTES : 1), 0);
+                    cubeHash.emplace(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification), currentSlot);
+                    state->viewer->reslice_notify_all(layerId, globalCoord);
+                    cubeLoaded(globalCoord);
+                } else {
+                    if (reply->error() != QNetworkReply::OperationCanceledError) {
+                        qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << reply->errorString() << reply->readAll();
+                    }
+                }
+                reply->deleteLater();
+                downloads.erase(globalCoord);
+                broadcastProgress();
+            }
+        });
+    };
+    // consecutive cubes of the prioritized dcoi are close to each other, they are requested together
+    const auto batchSize = std::max<std::size_t>(1, Loader::Controller::singleton().requestBatchSize);
+    std::vector<std::vector<Coordinate>> pendingBatches(datasets.size());
+    auto downloadBatch = [this, center, startDecompression, download](const std::size_t layerId, const Dataset dataset, std::vector<Coordinate> batch, decltype(slotDownload)::value_type & downloads
+            , decltype(slotDecompression)::value_type & decompressions, decltype(freeSlots)::value_type & freeSlots, decltype(state->cube2Pointer)::value_type::value_type & cubeHash){
+        // the slots are reserved before sending, so a finished batch never has to throw away downloaded cubes
+        std::vector<void *> slots;
+        while (slots.size() < batch.size() && !freeSlots.empty()) {
+            slots.emplace_back(freeSlots.front());
+            freeSlots.pop_front();
+        }
+        if (slots.size() < batch.size()) {// the rest isn’t requested, the next load asks for it again
+            Loader::Controller::singleton().metrics.pipeline.slotExhaustions += batch.size() - slots.size();
+            qCritical() << layerId << batch[slots.size()] << static_cast<int>(dataset.type) << "no slots for" << batch.size() - slots.size() << "batched cubes" << cubeHash.size() << freeSlots.size();
+            batch.resize(slots.size());
+        }
+        if (batch.size() <= 1) {
+            for (auto * slot : slots) {
+                freeSlots.emplace_front(slot);
+            }
+            if (!batch.empty()) {
+                download(layerId, dataset, batch.front(), downloads, decompressions, freeSlots, cubeHash);
+            }
+            return;
+        }
+        ++Loader::Controller::singleton().metrics.pipeline.batchedRequests;
+        auto request = cubeRequest(dataset, batch.front());
+        if (!currentlyVisibleWrap(center)(batch.front())) {// batches follow the dcoi order, so the rest isn’t visible either
+            request.setPriority(QNetworkRequest::LowPriority);
+        }
+        auto * reply = sendCubeRequest(request, dataset, batch);
+        for (const auto & globalCoord : batch) {
+            downloads[globalCoord] = reply;
+        }
+        broadcastProgress(true);
+        QObject::connect(reply, &QNetworkReply::finished, [this, layerId, dataset, reply, batch, slots, &downloads, &decompressions, &freeSlots, &cubeHash, startDecompression, download](){
+            for (const auto & globalCoord : batch) {
+                downloads.erase(globalCoord);
+            }
+            reply->deleteLater();// the cubes are split off here, so the decoders don’t reference the reply
+            const auto partBytes = batchedCubeBytes(dataset);
+            const auto data = reply->error() == QNetworkReply::NoError ? reply->read(reply->bytesAvailable()) : QByteArray{};
+            if (reply->error() == QNetworkReply::OperationCanceledError || static_cast<std::size_t>(data.size()) != batch.size() * partBytes) {
+                for (auto * slot : slots) {// the single requests take their slots when they finish
+                    freeSlots.emplace_front(slot);
+                }
+                if (reply->error() != QNetworkReply::OperationCanceledError) {
+                    ++Loader::Controller::singleton().metrics.pipeline.batchFallbacks;
+                    qWarning() << layerId << batch.front() << "batched request of" << batch.size() << "cubes failed, retrying them one by one" << reply->errorString();
+                    for (const auto & globalCoord : batch) {
+                        throttledRequest(layerId, {globalCoord}, [=, &downloads, &decompressions, &freeSlots, &cubeHash](){
+                            download(layerId, dataset, globalCoord, downloads, decompressions, freeSlots, cubeHash);
+                        });
+                    }
+                }
+                broadcastProgress();
+                return;
+            }
+            auto & diskCache = Loader::Controller::singleton().diskCache;
+            for (std::size_t i{0}; i < batch.size(); ++i) {
+                const auto globalCoord = batch[i];
+                ++Loader::Controller::singleton().metrics.pipeline.downloaded;
+                auto * currentSlot = slots[i];
+                const auto diskCacheKey = diskCache.enabled() ? CubeDiskCache::key(cubeRequest(dataset, globalCoord).url(), dataset.magnification, globalCoord) : std::string{};
+                startDecompression(layerId, globalCoord, decompressions, nullptr, [data, i, partBytes, currentSlot, layerId, dataset, &cubeHash, globalCoord, &diskCache, diskCacheKey](){
+                    const auto part = data.mid(static_cast<int>(i * partBytes), static_cast<int>(partBytes));
+                    const auto result = decompressCube(currentSlot, part, layerId, dataset, cubeHash, globalCoord);
+                    if (result.first && !diskCacheKey.empty()) {
+                        diskCache.store(diskCacheKey, part);
+                    }
+                    return result;
+                });
+            }
+            broadcastProgress();
+        });
+    };
+
+    auto startDownload = [this, center, startDecompression, download, downloadBatch, batchSize, &pendingBatches](const std::size_t layerId, const Dataset dataset, const Coordinate globalCoord, decltype(slotDownload)::value_type & downloads
             , decltype(slotDecompression)::value_type & decompressions, decltype(freeSlots)::value_type & freeSlots, decltype(state->cube2Pointer)::value_type::value_type & cubeHash){
         if (dataset.isOverlay()) {
             auto snappyIt = snappyCache[loaderMagnification].find(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification));
@@ -536,13 +901,10 @@ void Loader::Worker::downloadAndLoadCubes(const unsigned int loadingNr, const Co
                     }
                     auto decompressionIt = decompressions.find(globalCoord);
                     if (decompressionIt != std::end(decompressions)) {
-                        decompressionIt->second->waitForFinished();
+                        decompressionIt->second.waitForFinished();
                     }
                     const auto cubeCoord = globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification);
-                    state->protectCube2Pointer.lock();
-                    auto * currentSlot = Coordinate2BytePtr_hash_get_or_fail(cubeHash, cubeCoord);
-                    cubeHash.erase(cubeCoord);
-                    state->protectCube2Pointer.unlock();
+                    auto * currentSlot = cubeHash.take(cubeCoord);
                     if (currentSlot == nullptr) {
                         currentSlot = freeSlots.front();
                         freeSlots.pop_front();
@@ -550,134 +912,325 @@ void Loader::Worker::downloadAndLoadCubes(const unsigned int loadingNr, const Co
                     //directly uncompress snappy cube into the OC slot
                     const auto success = snappy::RawUncompress(snappyIt->second.c_str(), snappyIt->second.size(), reinterpret_cast<char*>(currentSlot));
                     if (success) {
-                        state->protectCube2Pointer.lock();
-                        cubeHash[globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification)] = currentSlot;
-                        state->protectCube2Pointer.unlock();
+                        cubeHash.emplace(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification), currentSlot);
 
                         state->viewer->reslice_notify_all(layerId, globalCoord);
+                        cubeLoaded(globalCoord);
                     } else {
                         freeSlots.emplace_back(currentSlot);
                         qCritical() << layerId << globalCoord << "snappy extract failed" << snappyIt->second.size();
                     }
                 } else {
+                    ++Loader::Controller::singleton().metrics.pipeline.slotExhaustions;
                     qCritical() << layerId << globalCoord << "no slots for snappy extract" << cubeHash.size() << freeSlots.size();
                 }
                 return;
             }
         }
-        QUrl dcUrl = dataset.apiSwitch(globalCoord);
-
-        state->protectCube2Pointer.lock();
         const bool cubeNotAlreadyLoaded = Coordinate2BytePtr_hash_get_or_fail(cubeHash, globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification)) == nullptr;
-        state->protectCube2Pointer.unlock();
-        const bool cubeNotDownloading = downloads.find(globalCoord) == std::end(downloads);
+        auto & pendingBatch = pendingBatches[layerId];
+        const bool cubeNotDownloading = downloads.find(globalCoord) == std::end(downloads) && queuedDownloads[layerId].count(globalCoord) == 0
+                && std::find(std::begin(pendingBatch), std::end(pendingBatch), globalCoord) == std::end(pendingBatch);
         const bool cubeNotDecompressing = decompressions.find(globalCoord) == std::end(decompressions);
 
         if (cubeNotAlreadyLoaded && cubeNotDownloading && cubeNotDecompressing) {
+            const CompressedCubeKey evictedKey{layerId, loaderMagnification, globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification)};
+            auto evictionIt = evictions.find(evictedKey);
+            if (evictionIt != std::end(evictions)) {// came back while it’s still being compressed
+                evictionIt->second.waitForFinished();
+                drainEvictions();
+            }
+            if (!freeSlots.empty()) {// recently evicted cubes are restored from RAM
+                const auto cubeBytes = state->cubeBytes * (dataset.isOverlay() ? OBJID_BYTES : 1);
+                auto * currentSlot = freeSlots.front();
+                if (evictedCubes.restore(evictedKey, currentSlot, cubeBytes)) {
+                    ++Loader::Controller::singleton().metrics.caches.ramHits;
+                    if (prefetchedCubes.erase(evictedKey) > 0) {
+                        ++Loader::Controller::singleton().metrics.prefetch.hits;
+                    }
+                    freeSlots.pop_front();
+                    cubeHash.emplace(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification), currentSlot);
+                    state->viewer->reslice_notify_all(layerId, globalCoord);
+                    cubeLoaded(globalCoord);
+                    return;
+                }
+                ++Loader::Controller::singleton().metrics.caches.ramMisses;
+                if (prefetchCandidateKeys.erase(evictedKey) > 0) {// predicted, but it didn’t arrive in time
+                    ++Loader::Controller::singleton().metrics.prefetch.misses;
+                }
+            }
             if (dataset.type == Dataset::CubeType::SNAPPY) {
                 if (!freeSlots.empty()) {
                     auto * currentSlot = freeSlots.front();
                     freeSlots.pop_front();
                     std::fill(reinterpret_cast<std::uint8_t *>(currentSlot), reinterpret_cast<std::uint8_t *>(currentSlot) + state->cubeBytes * (dataset.isOverlay() ? OBJID_BYTES : 1), 0);
-                    state->protectCube2Pointer.lock();
-                    cubeHash[globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification)] = currentSlot;
-                    state->protectCube2Pointer.unlock();
+                    cubeHash.emplace(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification), currentSlot);
                     state->viewer->reslice_notify_all(layerId, globalCoord);
+                    cubeLoaded(globalCoord);
                 } else {
+                    ++Loader::Controller::singleton().metrics.pipeline.slotExhaustions;
                     qCritical() << layerId << globalCoord << "no slots for snappy extract" << cubeHash.size() << freeSlots.size();
                 }
                 return;
             }
 
-            //transform googles oauth2 token from query item to request header
-            QUrlQuery originalQuery(dcUrl);
-            auto reducedQuery = originalQuery;
-            reducedQuery.removeQueryItem("access_token");
-            dcUrl.setQuery(reducedQuery);
-
-            auto request = QNetworkRequest(dcUrl);
-
-            if (originalQuery.hasQueryItem("access_token")) {
-                const auto authorization =  QString("Bearer ") + originalQuery.queryItemValue("access_token");
-                request.setRawHeader("Authorization", authorization.toUtf8());
-            }
-            QByteArray payload;
-            if (dataset.api == Dataset::API::WebKnossos) {
-                request.setRawHeader("Content-Type", "application/json");
-                payload = QString{R"json([{"position":[%1,%2,%3],"zoomStep":%4,"cubeSize":%5,"fourBit":false}])json"}.arg(globalCoord.x).arg(globalCoord.y).arg(globalCoord.z).arg(int_log(dataset.magnification)).arg(dataset.cubeEdgeLength).toUtf8();
-            }
-            //request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
-            //request.setAttribute(QNetworkRequest::SpdyAllowedAttribute, true);
-            if (globalCoord == center.cube(dataset.cubeEdgeLength, dataset.magnification).cube2Global(dataset.cubeEdgeLength, dataset.magnification)) {
-                //the first download usually finishes last (which is a bug) so we put it alone in the high priority bucket
-                request.setPriority(QNetworkRequest::HighPriority);
-            }
-
-            auto * reply = dataset.api == Dataset::API::WebKnossos ? qnam.post(request, payload) : qnam.get(request);
-
-            reply->setParent(nullptr);//reparent, so it don’t gets destroyed with qnam
-            downloads[globalCoord] = reply;
-            broadcastProgress(true);
-            QObject::connect(reply, &QNetworkReply::finished, [this, layerId, dataset, reply, globalCoord, &downloads, &decompressions, &freeSlots, &cubeHash](){
+            if (dataset.url.scheme() == "file") {// read on the pool, qnam and the event loop would only be in the way
                 if (freeSlots.empty()) {
-                    qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << "no slots for decompression" << cubeHash.size() << freeSlots.size();
-                    reply->deleteLater();
-                    downloads.erase(globalCoord);
-                    broadcastProgress();
+                    ++Loader::Controller::singleton().metrics.pipeline.slotExhaustions;
+                    qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << "no slots for local read" << cubeHash.size() << freeSlots.size();
                     return;
                 }
-                if (reply->error() == QNetworkReply::NoError) {
-                    auto * currentSlot = freeSlots.front();
-                    freeSlots.pop_front();
-                    auto * watcher = new QFutureWatcher<DecompressionResult>;
-                    QObject::connect(watcher, &QFutureWatcher<DecompressionResult>::finished, [this, reply, dataset, layerId, &freeSlots, &decompressions, globalCoord, watcher, currentSlot](){
-                        if (!watcher->isCanceled()) {
-                            auto result = watcher->result();
-
-                            if (!result.first) {//decompression unsuccessful
-                                qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << "decompression failed → no fill";
-                                freeSlots.emplace_back(result.second);
-                            }
-                        } else {
-                            qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << "future canceled";
-                            freeSlots.emplace_back(currentSlot);
-                        }
-                        reply->deleteLater();
-                        decompressions.erase(globalCoord);
-                        broadcastProgress();
-                    });
-                    decompressions[globalCoord].reset(watcher);
-                    downloads.erase(globalCoord);
-                    watcher->setFuture(QtConcurrent::run(&decompressionPool, std::bind(&decompressCube, currentSlot, std::ref(*reply), layerId, dataset, std::ref(cubeHash), globalCoord)));
-                } else {
-                    if (reply->error() == QNetworkReply::ContentNotFoundError) {//404 → fill
-                        auto * currentSlot = freeSlots.front();
-                        freeSlots.pop_front();
-                        std::fill(reinterpret_cast<std::uint8_t *>(currentSlot), reinterpret_cast<std::uint8_t *>(currentSlot) + state->cubeBytes * (dataset.isOverlay() ? OBJID_BYTES : 1), 0);
-                        state->protectCube2Pointer.lock();
-                        cubeHash[globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification)] = currentSlot;
-                        state->protectCube2Pointer.unlock();
+                auto * currentSlot = freeSlots.front();
+                freeSlots.pop_front();
+                const auto path = dataset.apiSwitch(globalCoord).toLocalFile();
+                startDecompression(layerId, globalCoord, decompressions, nullptr, [currentSlot, path, layerId, dataset, &cubeHash, globalCoord](){
+                    const bool success = readLocalCube(currentSlot, path, dataset);
+                    if (success) {
+                        cubeHash.emplace(globalCoord.cube(dataset.cubeEdgeLength, dataset.magnification), currentSlot);
                         state->viewer->reslice_notify_all(layerId, globalCoord);
-                    } else {
-                        if (reply->error() != QNetworkReply::OperationCanceledError) {
-                            qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << reply->errorString() << reply->readAll();
-                        }
                     }
-                    reply->deleteLater();
-                    downloads.erase(globalCoord);
-                    broadcastProgress();
+                    return DecompressionResult{success, currentSlot};
+                });
+                broadcastProgress(true);
+                return;
+            }
+            // remote cubes are served from the disk cache if possible
+            auto & diskCache = Loader::Controller::singleton().diskCache;
+            const auto diskCacheKey = diskCache.enabled() ? CubeDiskCache::key(cubeRequest(dataset, globalCoord).url(), dataset.magnification, globalCoord) : std::string{};
+            const bool diskCacheHit = !diskCacheKey.empty() && diskCache.contains(diskCacheKey);
+            if (diskCacheHit) {
+                ++Loader::Controller::singleton().metrics.caches.diskHits;
+            } else if (!diskCacheKey.empty()) {
+                ++Loader::Controller::singleton().metrics.caches.diskMisses;
+            }
+            if (diskCacheHit) {
+                if (freeSlots.empty()) {// the next load requests it again, the bytes don’t have to be downloaded twice
+                    ++Loader::Controller::singleton().metrics.pipeline.slotExhaustions;
+                    qCritical() << layerId << globalCoord << static_cast<int>(dataset.type) << "no slots for disk cache read" << cubeHash.size() << freeSlots.size();
+                    return;
                 }
-            });
+                auto * currentSlot = freeSlots.front();
+                freeSlots.pop_front();
+                startDecompression(layerId, globalCoord, decompressions, nullptr, [&diskCache, diskCacheKey, currentSlot, layerId, dataset, &cubeHash, globalCoord](){
+                    const auto result = decompressCube(currentSlot, diskCache.load(diskCacheKey), layerId, dataset, cubeHash, globalCoord);
+                    if (!result.first) {// unreadable entry, download it again next time
+                        diskCache.remove(diskCacheKey);
+                    }
+                    return result;
+                });
+                broadcastProgress(true);
+                return;
+            }
+
+            const bool centerCube = globalCoord == center.cube(dataset.cubeEdgeLength, dataset.magnification).cube2Global(dataset.cubeEdgeLength, dataset.magnification);
+            if (batchSize > 1 && batchedCubeBytes(dataset) != 0 && !centerCube) {
+                pendingBatch.emplace_back(globalCoord);
+                if (pendingBatch.size() >= batchSize) {
+                    throttledRequest(layerId, pendingBatch, [=, &downloads, &decompressions, &freeSlots, &cubeHash](){
+                        downloadBatch(layerId, dataset, pendingBatch, downloads, decompressions, freeSlots, cubeHash);
+                    });
+                    pendingBatch.clear();
+                }
+            } else {
+                throttledRequest(layerId, {globalCoord}, [=, &downloads, &decompressions, &freeSlots, &cubeHash](){
+                    download(layerId, dataset, globalCoord, downloads, decompressions, freeSlots, cubeHash);
+                });
+            }
         }
     };
 
-    const auto workaroundProcessLocalImmediately = datasets[0].url.scheme() == "file" ? [](){QCoreApplication::processEvents();} : [](){};
     for (auto globalCoord : allCubes) {
         if (loadingNr == Loader::Controller::singleton().loadingNr) {
             for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
                 startDownload(layerId, datasets[layerId], globalCoord, slotDownload[layerId], slotDecompression[layerId], freeSlots[layerId], state->cube2Pointer[layerId][loaderMagnification]);
-                workaroundProcessLocalImmediately();//https://bugreports.qt.io/browse/QTBUG-45925
             }
         }
     }
+    for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {// send the incomplete batches
+        if (!pendingBatches[layerId].empty() && loadingNr == Loader::Controller::singleton().loadingNr) {
+            throttledRequest(layerId, pendingBatches[layerId], [this, downloadBatch, layerId, batch = pendingBatches[layerId], dataset = datasets[layerId], &cubeHash = state->cube2Pointer[layerId][loaderMagnification]](){
+                downloadBatch(layerId, dataset, batch, slotDownload[layerId], slotDecompression[layerId], freeSlots[layerId], cubeHash);
+            });
+        }
+    }
+
+    const auto trajectory = predictTrajectory(center, treeDirection);
+    const auto prefetchBudget = Loader::Controller::singleton().prefetchBudget.load();
+    if (prefetchBudget > 0 && trajectory != floatCoordinate{} && loadingNr == Loader::Controller::singleton().loadingNr) {
+        prefetch(prefetchCandidates(center, trajectory, prefetchBudget));
+    } else {
+        prefetchCandidateKeys.clear();
+    }
+}
+
+floatCoordinate Loader::Worker::predictTrajectory(const Coordinate & center, const floatCoordinate & treeDirection) {
+    const auto cubeSize = datasets.front().cubeEdgeLength * datasets.front().magnification;
+    if (!recentCenters.empty() && (center - recentCenters.back()).length() > state->M * cubeSize) {
+        recentCenters.clear();// jumped, the history doesn’t tell anything about where we’re going
+    }
+    if (recentCenters.empty() || recentCenters.back() != center) {
+        recentCenters.emplace_back(center);
+    }
+    if (recentCenters.size() > static_cast<std::size_t>(LL_CURRENT_DIRECTIONS_SIZE)) {
+        recentCenters.pop_front();
+    }
+    floatCoordinate movement = recentCenters.back() - recentCenters.front();
+    floatCoordinate treeHeading = treeDirection;
+    const bool moving = movement.normalize();
+    const bool tracing = treeHeading.normalize();
+    if (!moving) {// standing still, assume the tracing continues along the active tree
+        return tracing ? treeHeading : floatCoordinate{};
+    }
+    if (tracing && movement.dot(treeHeading) > 0) {// following the tree, let it bend the extrapolation
+        movement += treeHeading * 0.5f;
+        movement.normalize();
+    }
+    return movement;
+}
+
+std::vector<std::vector<CoordOfCube>> Loader::Worker::prefetchCandidates(const Coordinate & center, const floatCoordinate & trajectory, const std::size_t budget) {
+    const int halfSc = state->M / 2;
+    std::vector<std::vector<CoordOfCube>> layerCandidates(datasets.size());
+    for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {// the layers may differ in cube geometry
+        const auto & dataset = datasets[layerId];
+        const auto cubeSize = dataset.cubeEdgeLength * dataset.magnification;
+        auto & candidates = layerCandidates[layerId];
+        std::unordered_set<CoordOfCube> known;
+        // walk along the predicted trajectory and collect the cubes the slice planes will need there, nearest first
+        for (int step = 1; step <= state->M && candidates.size() < budget; ++step) {
+            const Coordinate predictedCenter = center + static_cast<Coordinate>(trajectory * static_cast<float>(step * cubeSize));
+            const auto predictedCube = predictedCenter.cube(dataset.cubeEdgeLength, dataset.magnification);
+            std::vector<CoordOfCube> planes;
+            for (int x = -halfSc; x < halfSc + 1; ++x) {
+                for (int y = -halfSc; y < halfSc + 1; ++y) {
+                    for (int z = -halfSc; z < halfSc + 1; ++z) {
+                        const CoordOfCube cubeCoord{predictedCube.x + x, predictedCube.y + y, predictedCube.z + z};
+                        const auto globalCoord = cubeCoord.cube2Global(dataset.cubeEdgeLength, dataset.magnification);
+                        const bool insideDataset = globalCoord.x >= 0 && globalCoord.y >= 0 && globalCoord.z >= 0
+                                && globalCoord.x < dataset.boundary.x && globalCoord.y < dataset.boundary.y && globalCoord.z < dataset.boundary.z;
+                        if (insideDataset && currentlyVisible(globalCoord, predictedCenter, state->M, cubeSize)
+                                && !insideCurrentSupercube(globalCoord, center, state->M, cubeSize) && known.emplace(cubeCoord).second) {
+                            planes.emplace_back(cubeCoord);
+                        }
+                    }
+                }
+            }
+            std::sort(std::begin(planes), std::end(planes), [predictedCube](const CoordOfCube & lhs, const CoordOfCube & rhs){
+                return (lhs - predictedCube).length() < (rhs - predictedCube).length();
+            });
+            const auto count = std::min(planes.size(), budget - candidates.size());
+            candidates.insert(std::end(candidates), std::begin(planes), std::begin(planes) + count);
+        }
+    }
+    return layerCandidates;
+}
+
+void Loader::Worker::abortPrefetches(const std::unordered_set<CompressedCubeKey> & keep) {
+    std::vector<CompressedCubeKey> abortQueue;
+    for (const auto & elem : prefetchDownloads) {
+        if (keep.find(elem.first) == std::end(keep)) {
+            abortQueue.emplace_back(elem.first);
+        }
+    }
+    for (const auto & key : abortQueue) {
+        auto it = prefetchDownloads.find(key);
+        if (it != std::end(prefetchDownloads)) {// abort emits finished which removes the entry
+            it->second->abort();
+        }
+    }
+}
+
+void Loader::Worker::prefetch(const std::vector<std::vector<CoordOfCube>> & candidates) {
+    auto & stats = Loader::Controller::singleton().metrics.prefetch;
+    // prefetched cubes which were dropped from the RAM tier before anybody needed them
+    for (auto it = std::begin(prefetchedCubes); it != std::end(prefetchedCubes);) {
+        if (!evictedCubes.contains(*it)) {
+            ++stats.wasted;
+            it = prefetchedCubes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::unordered_set<CompressedCubeKey> wanted;
+    std::size_t mostCandidates{0};
+    for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
+        for (const auto & cubeCoord : candidates[layerId]) {
+            wanted.insert({layerId, loaderMagnification, cubeCoord});
+        }
+        mostCandidates = std::max(mostCandidates, candidates[layerId].size());
+    }
+    abortPrefetches(wanted);
+    prefetchCandidateKeys = wanted;
+
+    auto & diskCache = Loader::Controller::singleton().diskCache;
+    for (std::size_t i{0}; i < mostCandidates; ++i) {// nearest first over all layers
+        for (std::size_t layerId{0}; layerId < datasets.size(); ++layerId) {
+            if (i >= candidates[layerId].size()) {
+                continue;
+            }
+            const auto & cubeCoord = candidates[layerId][i];
+            const auto & dataset = datasets[layerId];
+            const CompressedCubeKey key{layerId, loaderMagnification, cubeCoord};
+            const bool modified = dataset.isOverlay() && snappyCache[loaderMagnification].find(cubeCoord) != std::end(snappyCache[loaderMagnification]);
+            const bool pending = prefetchDownloads.find(key) != std::end(prefetchDownloads) || prefetchDecompressions.find(key) != std::end(prefetchDecompressions)
+                    || evictions.find(key) != std::end(evictions);
+            if (dataset.type == Dataset::CubeType::SNAPPY || modified || pending || evictedCubes.contains(key)) {
+                continue;
+            }
+            const auto globalCoord = cubeCoord.cube2Global(dataset.cubeEdgeLength, dataset.magnification);
+            const auto cubeBytes = state->cubeBytes * (dataset.isOverlay() ? OBJID_BYTES : 1);
+            // decoded into a temporary buffer, the slots are reserved for the supercube
+            auto decode = [this, key](std::function<std::string()> job){
+                prefetchDecompressions[key] = QtConcurrent::run(&decompressionPool, [this, key, job](){
+                    prefetchCompletions.push({key, new std::string(job())});
+                    scheduleCompletionDrain();
+                });
+            };
+
+            if (dataset.url.scheme() == "file") {
+                ++stats.issued;
+                decode([path = dataset.apiSwitch(globalCoord).toLocalFile(), dataset, cubeBytes](){
+                    std::vector<std::uint8_t> cube(cubeBytes);
+                    return readLocalCube(cube.data(), path, dataset) ? CompressedCubeCache::compress(cube.data(), cubeBytes, cacheFormat(dataset)) : std::string{};
+                });
+                continue;
+            }
+            auto request = cubeRequest(dataset, globalCoord);
+            const auto diskCacheKey = diskCache.enabled() ? CubeDiskCache::key(request.url(), dataset.magnification, globalCoord) : std::string{};
+            if (!diskCacheKey.empty() && diskCache.contains(diskCacheKey)) {
+                ++stats.issued;
+                decode([&diskCache, diskCacheKey, dataset, cubeBytes](){
+                    return decodeAndCompress(diskCache.load(diskCacheKey), dataset, cubeBytes);
+                });
+                continue;
+            }
+            const auto limit = Loader::Controller::singleton().maxRequestsInFlight.load();
+            if (limit != 0 && (Loader::Controller::singleton().metrics.transport.inFlight >= limit || !queuedRequests.empty())) {
+                continue;// throttled, prefetches don’t queue up in front of supercube requests, the next pass retries
+            }
+            ++stats.issued;
+            request.setPriority(QNetworkRequest::LowPriority);// never compete with the supercube
+            auto * reply = sendCubeRequest(request, dataset, {globalCoord});
+            prefetchDownloads[key] = reply;
+            QObject::connect(reply, &QNetworkReply::finished, [this, key, reply, dataset, cubeBytes, decode, &diskCache, diskCacheKey](){
+                if (reply->error() == QNetworkReply::NoError) {
+                    const auto data = reply->read(reply->bytesAvailable());
+                    decode([&diskCache, diskCacheKey, data, dataset, cubeBytes](){
+                        auto compressedCube = decodeAndCompress(data, dataset, cubeBytes);
+                        if (!compressedCube.empty() && !diskCacheKey.empty()) {
+                            diskCache.store(diskCacheKey, data);
+                        }
+                        return compressedCube;
+                    });
+                } else if (reply->error() == QNetworkReply::ContentNotFoundError) {//404 → fill
+                    decode([cubeBytes, format = cacheFormat(dataset)](){
+                        return CompressedCubeCache::compress(std::vector<std::uint8_t>(cubeBytes, 0).data(), cubeBytes, format);
+                    });
+                }
+                reply->deleteLater();
+                prefetchDownloads.erase(key);
+            });
+        }
+    }
 }
@@ -23,14 +23,19 @@
 #ifndef LOADER_H
 #define LOADER_H
 
+#include "compressedcubecache.h"
 #include "coordinate.h"
+#include "cubediskcache.h"
 #include "dataset.h"
 #include "hashtable.h"
+#include "loadermetrics.h"
 #include "segmentation/segmentation.h"
+#include "slotarena.h"
 #include "usermove.h"
 
 #include <QCoreApplication>
-#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QMutex>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
@@ -41,10 +46,14 @@
 #include <QTimer>
 #include <QWaitCondition>
 
+#include <boost/lockfree/queue.hpp>
 #include <boost/multi_array.hpp>
 
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <list>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -79,10 +88,9 @@ private:
     template<typename T>
     using ptr = std::unique_ptr<T>;
     using DecompressionResult = std::pair<bool, void *>;
-    using DecompressionOperationPtr = ptr<QFutureWatcher<DecompressionResult>>;
+    using DecompressionOperation = QFuture<DecompressionResult>;
     std::vector<std::unordered_map<Coordinate, QNetworkReply*>> slotDownload;
-    std::vector<std::unordered_map<Coordinate, DecompressionOperationPtr>> slotDecompression;
-    std::vector<std::list<std::vector<std::uint8_t>>> slotChunk;// slot ownership
+    std::vector<std::unordered_map<Coordinate, DecompressionOperation>> slotDecompression;
     std::vector<std::list<void *>> freeSlots;
     int currentMaxMetric;
 
@@ -95,6 +103,57 @@ private:
     void snappyCacheBackupRaw(const CoordOfCube &, const void * cube);
     void snappyCacheClear();
 
+    CompressedCubeCache evictedCubes;// 2nd tier for cubes which left the supercube
+    // compressing on the pool, their slots return to freeSlots once the completion is drained
+    std::unordered_map<CompressedCubeKey, QFuture<void>> evictions;
+    bool compressEvictedCube(const std::size_t layerId, const CoordOfCube & cubeCoord, void * slot);// false if the slot is still in use
+    void drainEvictions();
+
+    QNetworkReply * sendCubeRequest(QNetworkRequest request, const Dataset & dataset, const std::vector<Coordinate> & globalCoords);
+    // requests beyond Controller::maxRequestsInFlight wait here in dcoi order
+    std::deque<std::function<void()>> queuedRequests;
+    std::vector<std::unordered_set<Coordinate>> queuedDownloads;
+    void throttledRequest(const std::size_t layerId, const std::vector<Coordinate> & globalCoords, std::function<void()> send);
+    void dropQueuedRequests();
+
+    std::deque<Coordinate> recentCenters;// for the trajectory prediction
+    std::unordered_map<CompressedCubeKey, QNetworkReply*> prefetchDownloads;
+    std::unordered_map<CompressedCubeKey, QFuture<void>> prefetchDecompressions;
+    std::unordered_set<CompressedCubeKey> prefetchedCubes;// waiting in evictedCubes to be used
+    std::unordered_set<CompressedCubeKey> prefetchCandidateKeys;// of the last prefetch pass, for the miss count
+    floatCoordinate predictTrajectory(const Coordinate & center, const floatCoordinate & treeDirection);
+    std::vector<std::vector<CoordOfCube>> prefetchCandidates(const Coordinate & center, const floatCoordinate & trajectory, const std::size_t budget);// per layer
+    void prefetch(const std::vector<std::vector<CoordOfCube>> & candidates);
+    void abortPrefetches(const std::unordered_set<CompressedCubeKey> & keep);
+
+    // decode jobs report back through these instead of a QFutureWatcher per cube
+    struct DecodeCompletion {
+        std::size_t layerId;
+        Coordinate globalCoord;
+        bool success;
+        void * slot;
+        QNetworkReply * reply;// nullptr if it wasn’t downloaded
+    };
+    struct PrefetchCompletion {
+        CompressedCubeKey key;
+        std::string * compressedCube;// owned by the consumer, empty on failure
+    };
+    struct EvictionCompletion {
+        CompressedCubeKey key;
+        void * slot;
+        std::string * compressedCube;// owned by the consumer
+    };
+    boost::lockfree::queue<DecodeCompletion> decodeCompletions{128};
+    boost::lockfree::queue<PrefetchCompletion> prefetchCompletions{128};
+    boost::lockfree::queue<EvictionCompletion> evictionCompletions{128};
+    std::atomic_bool completionDrainScheduled{false};
+    void scheduleCompletionDrain();
+
+    Coordinate jumpCenter;
+    QElapsedTimer sinceJump;
+    bool awaitingVisibleCube{false};
+    void cubeLoaded(const Coordinate & globalCoord);// for the time to the first visible cube after a jump
+
     void abortDownloadsFinishDecompression();
     template<typename Func>
     void abortDownloadsFinishDecompression(Func);
@@ -112,7 +171,7 @@ public://matsch
     void moveToThread(QThread * targetThread);//reimplement to move qnam
 
     void unloadCurrentMagnification();
-    void markOcCubeAsModified(const CoordOfCube &cubeCoord, const int magnification);
+    void markOcCubesAsModified(const std::vector<CoordOfCube> & cubeCoords, const int magnification);
     void snappyCacheSupplySnappy(const CoordOfCube, const int magnification, const std::string cube);
     void flushIntoSnappyCache();
     void broadcastProgress(bool startup = false);
@@ -120,18 +179,29 @@ public://matsch
     ~Worker();
 signals:
     void progress(bool incremented, int count);
+private slots:
+    void drainCompletions();
 public slots:
     void cleanup(const Coordinate center);
-    void downloadAndLoadCubes(const unsigned int loadingNr, const Coordinate center, const UserMoveType userMoveType, const floatCoordinate & direction, const Dataset::list_t & changedDatasets);
+    void downloadAndLoadCubes(const unsigned int loadingNr, const Coordinate center, const UserMoveType userMoveType, const floatCoordinate & direction, const floatCoordinate & treeDirection, const Dataset::list_t & changedDatasets);
 };
 
 class Controller : public QObject {
     Q_OBJECT
     friend class Loader::Worker;
     QThread workerThread;
+    void prepareSlotArenas(const decltype(Dataset::datasets) & datasets);
 public:
+    std::vector<std::unique_ptr<SlotArena>> slotArenas;// cube slots per layer, outlive worker restarts
     std::unique_ptr<Loader::Worker> worker;
     std::atomic_uint loadingNr{0};
+    CubeDiskCache diskCache;// outlives worker restarts
+    std::size_t evictedCubesCacheSize{512 * 1024 * 1024};
+    std::atomic<std::size_t> prefetchBudget{16};// cubes per layer fetched ahead of the supercube, 0 disables prefetching
+    std::atomic<std::size_t> requestBatchSize{8};// cubes per request for backends which accept several, 1 disables batching
+    std::atomic_bool http2{false};// multiplex the cube requests over one HTTP/2 connection (https only)
+    std::atomic<std::size_t> maxRequestsInFlight{0};// further supercube requests are queued, 0 is unlimited
+    LoaderMetrics metrics;
     static Controller & singleton(){
         static Loader::Controller & loader = *new Loader::Controller;
         return loader;
@@ -146,18 +216,22 @@ public:
         if (worker != nullptr) {
             worker->flushIntoSnappyCache();
             auto snappyCache = worker->snappyCache;
+            worker.reset();// give back the slots before the arenas are reused
+            prepareSlotArenas(datasets);
             worker.reset(new Loader::Worker(datasets));
             worker->snappyCache = snappyCache;
         } else {
+            prepareSlotArenas(datasets);
             worker.reset(new Loader::Worker(datasets));
         }
+        worker->evictedCubes.setMaxSize(evictedCubesCacheSize);
         workerThread.setObjectName("Loader");
         worker->moveToThread(&workerThread);
         QObject::connect(worker.get(), &Loader::Worker::progress, this, [this](bool, int count){emit progress(count);});
         QObject::connect(worker.get(), &Loader::Worker::progress, this, &Loader::Controller::refCountChange);
         QObject::connect(this, &Loader::Controller::loadSignal, worker.get(), &Loader::Worker::downloadAndLoadCubes);
         QObject::connect(this, &Loader::Controller::unloadCurrentMagnificationSignal, worker.get(), &Loader::Worker::unloadCurrentMagnification, Qt::BlockingQueuedConnection);
-        QObject::connect(this, &Loader::Controller::markOcCubeAsModifiedSignal, worker.get(), &Loader::Worker::markOcCubeAsModified, Qt::BlockingQueuedConnection);
+        QObject::connect(this, &Loader::Controller::markOcCubesAsModifiedSignal, worker.get(), &Loader::Worker::markOcCubesAsModified, Qt::BlockingQueuedConnection);
         QObject::connect(this, &Loader::Controller::snappyCacheSupplySnappySignal, worker.get(), &Loader::Worker::snappyCacheSupplySnappy, Qt::BlockingQueuedConnection);
         workerThread.start();
     }
@@ -167,6 +241,7 @@ public:
         emit snappyCacheSupplySnappySignal(std::forward<Args>(args)...);
     }
     void markOcCubeAsModified(const CoordOfCube &cubeCoord, const int magnification);
+    void markOcCubesAsModified(const std::vector<CoordOfCube> & cubeCoords, const int magnification);// one round trip to the worker for all cubes
     decltype(Loader::Worker::snappyCache) getAllModifiedCubes();
 public slots:
     bool isFinished();
@@ -174,8 +249,8 @@ signals:
     void progress(int count);
     void refCountChange(bool isIncrement, int refCount);
     void unloadCurrentMagnificationSignal();
-    void loadSignal(const unsigned int loadingNr, const Coordinate center, const UserMoveType userMoveType, const floatCoordinate & direction, const Dataset::list_t & changedDatasets);
-    void markOcCubeAsModifiedSignal(const CoordOfCube &cubeCoord, const int magnification);
+    void loadSignal(const unsigned int loadingNr, const Coordinate center, const UserMoveType userMoveType, const floatCoordinate & direction, const floatCoordinate & treeDirection, const Dataset::list_t & changedDatasets);
+    void markOcCubesAsModifiedSignal(const std::vector<CoordOfCube> & cubeCoords, const int magnification);
     void snappyCacheSupplySnappySignal(const CoordOfCube, const int magnification, const std::string cube);
 };
 }//namespace Loader
@@ -0,0 +1,134 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "loadermetrics.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+
+#include <algorithm>
+
+void LoaderMetrics::Samples::add(const qint64 value) {
+    values.emplace_back(value);
+    if (values.size() > window) {
+        values.pop_front();
+    }
+}
+
+QJsonObject LoaderMetrics::Samples::toJson() const {
+    if (values.empty()) {
+        return {{"count", 0}};
+    }
+    std::vector<qint64> sorted(std::begin(values), std::end(values));
+    std::sort(std::begin(sorted), std::end(sorted));
+    const auto percentile = [&sorted](const std::size_t p){
+        return static_cast<double>(sorted[std::min(sorted.size() - 1, sorted.size() * p / 100)]);
+    };
+    double sum{0};
+    for (const auto value : sorted) {
+        sum += value;
+    }
+    return {{"count", static_cast<int>(sorted.size())}
+        , {"mean", sum / sorted.size()}
+        , {"p50", percentile(50)}
+        , {"p90", percentile(90)}
+        , {"p99", percentile(99)}
+        , {"max", static_cast<double>(sorted.back())}};
+}
+
+void LoaderMetrics::recordDownload(const qint64 latency, const qint64 bytes) {
+    QMutexLocker locker(&mutex);
+    downloadLatency.add(latency);
+    transfers.push_back({QDateTime::currentMSecsSinceEpoch(), bytes});
+    if (transfers.size() > Samples::window) {
+        transfers.pop_front();
+    }
+}
+
+void LoaderMetrics::recordDecode(const Dataset::CubeType type, const qint64 microseconds) {
+    QMutexLocker locker(&mutex);
+    decodeTime[type].add(microseconds);
+}
+
+void LoaderMetrics::recordFirstVisibleCube(const qint64 milliseconds) {
+    QMutexLocker locker(&mutex);
+    firstVisibleCube.add(milliseconds);
+}
+
+void LoaderMetrics::recordQueueDepth(const std::size_t layerId, const std::size_t downloads, const std::size_t decompressions, const std::size_t queued) {
+    QMutexLocker locker(&mutex);
+    if (queueDepth.size() <= layerId) {
+        queueDepth.resize(layerId + 1);
+    }
+    queueDepth[layerId] = {downloads, decompressions, queued};
+}
+
+void LoaderMetrics::reset() {
+    QMutexLocker locker(&mutex);
+    transfers.clear();
+    downloadLatency = {};
+    decodeTime.clear();
+    firstVisibleCube = {};
+    for (auto * counter : {&prefetch.issued, &prefetch.hits, &prefetch.misses, &prefetch.wasted
+         , &pipeline.downloaded, &pipeline.decoded, &pipeline.inserted, &pipeline.failed, &pipeline.batches, &pipeline.batchedRequests, &pipeline.batchFallbacks, &pipeline.slotExhaustions
+         , &transport.requests, &caches.ramHits, &caches.ramMisses, &caches.diskHits, &caches.diskMisses}) {
+        *counter = 0;
+    }// inFlight, queued and the queue depths describe the present and stay
+}
+
+QJsonObject LoaderMetrics::toJson() const {
+    QMutexLocker locker(&mutex);
+    const auto count = [](const std::atomic<std::size_t> & counter){
+        return static_cast<double>(counter.load());
+    };
+    const qint64 rateWindow{5000};// ms
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    qint64 recentBytes{0};
+    for (const auto & transfer : transfers) {
+        if (now - transfer.finished < rateWindow) {
+            recentBytes += transfer.bytes;
+        }
+    }
+    QJsonArray layers;
+    for (const auto & depth : queueDepth) {
+        layers.append(QJsonObject{{"downloads", static_cast<double>(depth.downloads)}
+            , {"decompressions", static_cast<double>(depth.decompressions)}
+            , {"queued", static_cast<double>(depth.queued)}});
+    }
+    QJsonObject decode;
+    for (const auto & elem : decodeTime) {
+        Dataset dataset;
+        dataset.type = elem.first;
+        decode[dataset.compressionString()] = elem.second.toJson();
+    }
+    return {{"prefetch", QJsonObject{{"issued", count(prefetch.issued)}, {"hits", count(prefetch.hits)}, {"misses", count(prefetch.misses)}, {"wasted", count(prefetch.wasted)}}}
+        , {"pipeline", QJsonObject{{"downloaded", count(pipeline.downloaded)}, {"decoded", count(pipeline.decoded)}, {"inserted", count(pipeline.inserted)}, {"failed", count(pipeline.failed)}
+              , {"batches", count(pipeline.batches)}, {"batched_requests", count(pipeline.batchedRequests)}, {"batch_fallbacks", count(pipeline.batchFallbacks)}
+              , {"slot_exhaustions", count(pipeline.slotExhaustions)}}}
+        , {"transport", QJsonObject{{"in_flight", count(transport.inFlight)}, {"queued", count(transport.queued)}, {"requests", count(transport.requests)}
+              , {"bytes_per_second", recentBytes * 1000. / rateWindow}, {"latency_ms", downloadLatency.toJson()}}}
+        , {"caches", QJsonObject{{"ram_hits", count(caches.ramHits)}, {"ram_misses", count(caches.ramMisses)}, {"disk_hits", count(caches.diskHits)}, {"disk_misses", count(caches.diskMisses)}}}
+        , {"decode_us", decode}
+        , {"first_visible_cube_ms", firstVisibleCube.toJson()}
+        , {"queue_depth", layers}};
+}
@@ -0,0 +1,101 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef LOADERMETRICS_H
+#define LOADERMETRICS_H
+
+#include "dataset.h"
+
+#include <QJsonObject>
+#include <QMutex>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
+
+/**
+ * @brief LoaderMetrics collects what the loader does, so changes to it can be measured on real datasets.
+ *
+ * Counters are plain atomics, durations are kept as a window of the most recent samples.
+ * Everything is written from the loader thread and the decompression pool and read from the main thread.
+ */
+class LoaderMetrics {
+public:
+    class Samples {
+        std::deque<qint64> values;
+    public:
+        static constexpr std::size_t window = 1024;
+        void add(const qint64 value);
+        QJsonObject toJson() const;// count, mean and percentiles of the window
+    };
+private:
+    mutable QMutex mutex;// for the samples and the queue depths
+    struct Transfer {
+        qint64 finished;// ms since epoch
+        qint64 bytes;
+    };
+    std::deque<Transfer> transfers;// for the download rate
+    Samples downloadLatency;// ms
+    std::map<Dataset::CubeType, Samples> decodeTime;// µs
+    Samples firstVisibleCube;// ms from a jump until a visible cube is available
+    struct QueueDepth {
+        std::size_t downloads{0}, decompressions{0}, queued{0};
+    };
+    std::vector<QueueDepth> queueDepth;// per layer
+public:
+    struct {
+        std::atomic<std::size_t> issued{0};// cubes requested ahead of the supercube
+        std::atomic<std::size_t> hits{0};// prefetched cubes that entered the supercube from RAM
+        std::atomic<std::size_t> misses{0};// predicted cubes which weren’t in RAM yet when the supercube needed them
+        std::atomic<std::size_t> wasted{0};// prefetched cubes dropped before they were needed
+    } prefetch;
+    struct {
+        std::atomic<std::size_t> downloaded{0};// replies handed to the decoder
+        std::atomic<std::size_t> decoded{0};// decode jobs finished on the pool
+        std::atomic<std::size_t> inserted{0};// successful cubes drained on the loader thread
+        std::atomic<std::size_t> failed{0};
+        std::atomic<std::size_t> batches{0};// drains of the completion queues
+        std::atomic<std::size_t> batchedRequests{0};// multi-cube requests sent
+        std::atomic<std::size_t> batchFallbacks{0};// multi-cube requests retried as single requests
+        std::atomic<std::size_t> slotExhaustions{0};// cubes dropped because no slot was free
+    } pipeline;
+    struct {
+        std::atomic<std::size_t> inFlight{0};
+        std::atomic<std::size_t> queued{0};
+        std::atomic<std::size_t> requests{0};
+    } transport;
+    struct {
+        std::atomic<std::size_t> ramHits{0}, ramMisses{0};// 2nd tier of evicted cubes
+        std::atomic<std::size_t> diskHits{0}, diskMisses{0};// persistent cache of remote cubes
+    } caches;
+
+    void recordDownload(const qint64 latency, const qint64 bytes);
+    void recordDecode(const Dataset::CubeType type, const qint64 microseconds);
+    void recordFirstVisibleCube(const qint64 milliseconds);
+    void recordQueueDepth(const std::size_t layerId, const std::size_t downloads, const std::size_t decompressions, const std::size_t queued);
+    void reset();
+    QJsonObject toJson() const;
+};
+
+#endif//LOADERMETRICS_H
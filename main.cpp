@@ -134,6 +134,7 @@ int main(int argc, char *argv[]) {
     qRegisterMetaType<std::string>();
     qRegisterMetaType<Coordinate>();
     qRegisterMetaType<CoordOfCube>();
+    qRegisterMetaType<std::vector<CoordOfCube>>("std::vector<CoordOfCube>");
     qRegisterMetaType<Dataset>("Dataset");
     qRegisterMetaType<Dataset::list_t>("Dataset::list_t");
     qRegisterMetaType<floatCoordinate>();
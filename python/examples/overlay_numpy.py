@@ -0,0 +1,30 @@
+import KnossosModule
+import numpy
+
+""" This script accesses the segmentation overlay through numpy
+	Whole regions are copied with one call, single loaded cubes can be viewed without copying.
+"""
+
+knossos = KnossosModule.knossos
+
+class CubeView(object):
+	def __init__(self, interface):
+		self.__array_interface__ = dict(interface, shape=tuple(interface["shape"]), data=tuple(interface["data"]))
+
+first = knossos.getPosition()
+size = [128, 128, 128]
+
+# x fastest buffer, the overlay rows are memcpy’d into it
+region = numpy.zeros(size[::-1], dtype=numpy.uint64)# (z, y, x)
+strides = list(region.strides[::-1])# x, y, z
+knossos.processRegionByStridedBufProxy(first, size, region.__array_interface__["data"][0], strides, False, False)
+print("ids in region:", numpy.unique(region))
+
+# view into the loaded cube containing the current position, only valid while the cube stays loaded
+interface = knossos.overlayCubeArrayInterface(first)
+if interface:
+	cube = numpy.asarray(CubeView(interface))# (z, y, x)
+	print("ids in cube:", numpy.unique(cube))
+
+# erase the region, the changed cubes are marked and resliced
+changedCubes = knossos.fillOverlayRegion(first, size, 0, True)
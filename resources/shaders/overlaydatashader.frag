@@ -2,14 +2,23 @@
 
 uniform float textureOpacity;
 uniform sampler3D indexTexture;
-uniform sampler1D textureLUT;
-uniform float lutSize;//float(textureSize1D(textureLUT, 0));
-uniform float factor;//expand float to uint8 range
+uniform sampler2D textureLUT;// index → color table slot in rgb
+uniform sampler2D colorTable;// slot → color, shared by all cubes of the layer
+uniform vec2 lutSize;
+uniform vec2 colorTableSize;
+uniform vec2 factor;//expand red and green to the index
 varying vec3 texCoordFrag;//in
 
+vec4 fetch(sampler2D table, vec2 size, float index) {
+    float row = floor(index / size.x);
+    return texture2D(table, (vec2(index - row * size.x, row) + 0.5) / size);
+}
+
 void main() {
-    float index = texture3D(indexTexture, texCoordFrag).r;
-    index *= factor;
-    gl_FragColor = texture1D(textureLUT, (index + 0.5) / lutSize);
+    vec2 channels = texture3D(indexTexture, texCoordFrag).rg;
+    float index = floor(channels.r * factor.x + 0.5) + floor(channels.g * factor.y + 0.5);
+    vec3 slotBytes = floor(fetch(textureLUT, lutSize, index).rgb * 255.0 + 0.5);
+    float slot = slotBytes.r + slotBytes.g * 256.0 + slotBytes.b * 65536.0;
+    gl_FragColor = fetch(colorTable, colorTableSize, slot);
     gl_FragColor.a = textureOpacity;
 }
@@ -24,6 +24,7 @@
 
 #include "buildinfo.h"
 #include "functions.h"
+#include "kernelbench.h"
 #include "loader.h"
 #include "segmentation/cubeloader.h"
 #include "skeleton/node.h"
@@ -37,6 +38,11 @@
 
 #include <QApplication>
 #include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <algorithm>
 
 void PythonProxy::annotationLoad(const QString & filename, const bool merge) {
     state->mainWindow->openFileDispatch({filename}, merge, true);
@@ -71,15 +77,42 @@ QList<float> PythonProxy::getScale() {
     return Dataset::current().scale.list();
 }
 
-QVector<int> PythonProxy::processRegionByStridedBufProxy(QList<int> globalFirst, QList<int> size,
-                             quint64 dataPtr, QList<int> strides, bool isWrite, bool isMarkChanged) {
-    auto cubeChangeSet = processRegionByStridedBuf(Coordinate(globalFirst), Coordinate(globalFirst) + Coordinate(size) - 1, (char*)dataPtr, Coordinate(strides), isWrite, isMarkChanged);
+namespace {
+QVector<int> cubeCoordsVector(const CubeCoordSet & cubeChangeSet) {
     QVector<int> cubeChangeSetVector;
     for (auto &elem : cubeChangeSet) {
         cubeChangeSetVector += elem.vector();
     }
     return cubeChangeSetVector;
 }
+}
+
+QVector<int> PythonProxy::processRegionByStridedBufProxy(QList<int> globalFirst, QList<int> size,
+                             quint64 dataPtr, QList<int> strides, bool isWrite, bool isMarkChanged) {
+    return cubeCoordsVector(processRegionByStridedBuf(Coordinate(globalFirst), Coordinate(globalFirst) + Coordinate(size) - 1, (char*)dataPtr, Coordinate(strides), isWrite, isMarkChanged));
+}
+
+QVector<int> PythonProxy::fillOverlayRegion(QList<int> globalFirst, QList<int> size, quint64 value, bool isMarkChanged) {
+    return cubeCoordsVector(fillRegion(Coordinate(globalFirst), Coordinate(globalFirst) + Coordinate(size) - 1, value, isMarkChanged));
+}
+
+/**
+ * numpy __array_interface__ of the loaded overlay cube containing globalCoord for zero-copy (z, y, x) views,
+ * numpy expects tuples for shape and data, so convert them before exposing the dict as __array_interface__.
+ * The view is only valid while the cube stays loaded, writes have to be announced via coordCubesMarkChangedProxy.
+ * Returns an empty map if the cube isn’t loaded.
+ */
+QVariantMap PythonProxy::overlayCubeArrayInterface(QList<int> globalCoord) {
+    const auto rawcube = getRawCube(Coordinate(globalCoord));
+    if (!rawcube.first) {
+        return {};
+    }
+    const auto edge = Dataset::current().cubeEdgeLength;
+    return QVariantMap{{"version", 3}
+        , {"shape", QVariantList{edge, edge, edge}}
+        , {"typestr", "<u8"}
+        , {"data", QVariantList{static_cast<qulonglong>(reinterpret_cast<quintptr>(rawcube.second)), false}}};
+}
 
 void PythonProxy::coordCubesMarkChangedProxy(QVector<int> cubeChangeSetList) {
     CubeCoordSet cubeChangeSet;
@@ -130,6 +163,112 @@ bool PythonProxy::loaderFinished() {
     return Loader::Controller::singleton().isFinished();
 }
 
+QVariantMap PythonProxy::loaderMemoryStats() {
+    qulonglong arenaBytes{0}, slots{0}, slotsUsed{0};
+    QStringList backing;
+    for (const auto & arena : Loader::Controller::singleton().slotArenas) {
+        if (arena != nullptr) {
+            arenaBytes += arena->bytes();
+            slots += arena->size();
+            backing.append(arena->backingName());
+        }
+    }
+    for (const auto & layer : state->cube2Pointer) {
+        for (const auto & mag : layer) {
+            slotsUsed += mag.size();
+        }
+    }
+    return {{"rss", static_cast<qulonglong>(SlotArena::residentBytes())}
+        , {"arena_bytes", arenaBytes}
+        , {"slots", slots}
+        , {"slots_used", slotsUsed}
+        , {"backing", backing}};
+}
+
+QJsonObject loaderMetricsWithSettings() {
+    const auto & loader = Loader::Controller::singleton();
+    auto metrics = loader.metrics.toJson();
+    metrics["settings"] = QJsonObject{{"prefetch_budget", static_cast<double>(loader.prefetchBudget.load())}
+        , {"request_batch_size", static_cast<double>(loader.requestBatchSize.load())}
+        , {"http2", loader.http2.load()}
+        , {"max_requests_in_flight", static_cast<double>(loader.maxRequestsInFlight.load())}};
+    return metrics;
+}
+
+QVariantMap PythonProxy::loaderMetrics() {
+    return loaderMetricsWithSettings().toVariantMap();
+}
+
+QString PythonProxy::loaderMetricsJson() {
+    return QJsonDocument(loaderMetricsWithSettings()).toJson();
+}
+
+void PythonProxy::resetLoaderMetrics() {
+    Loader::Controller::singleton().metrics.reset();
+}
+
+QVariantMap PythonProxy::gpuUploadMetrics() {
+    TextureLayer::UploadMetrics total;
+    for (const auto & layer : state->viewer->layers) {
+        total.cubes += layer.uploadMetrics.cubes;
+        total.dropped += layer.uploadMetrics.dropped;
+        total.streamingNs += layer.uploadMetrics.streamingNs;
+        total.prepareNs += layer.uploadMetrics.prepareNs;
+        total.uploadNs += layer.uploadMetrics.uploadNs;
+        total.pixelBuffers = total.pixelBuffers || layer.uploadMetrics.pixelBuffers;
+    }
+    const auto perCube = [&total](const qint64 ns){
+        return total.cubes > 0 ? ns / 1e3 / total.cubes : 0.0;
+    };
+    return {{"cubes", static_cast<qulonglong>(total.cubes)}
+        , {"dropped", static_cast<qulonglong>(total.dropped)}
+        , {"cubes_per_second", total.streamingNs > 0 ? total.cubes * 1e9 / total.streamingNs : 0.0}
+        , {"prepare_us_per_cube", perCube(total.prepareNs)}
+        , {"upload_us_per_cube", perCube(total.uploadNs)}
+        , {"pixel_buffers", total.pixelBuffers}};
+}
+
+void PythonProxy::resetGpuUploadMetrics() {
+    for (auto & layer : state->viewer->layers) {
+        layer.uploadMetrics = {};
+    }
+}
+
+QVariantMap PythonProxy::gpuTextureResidency() {
+    QVariantList layers;
+    for (const auto & layer : state->viewer->layers) {
+        layers.append(QVariantMap{{"overlay", layer.isOverlayData}
+            , {"resident", static_cast<qulonglong>(layer.textures.size())}
+            , {"pooled", static_cast<qulonglong>(layer.pooledTextures())}
+            , {"capacity", static_cast<qulonglong>(layer.textureCapacity)}
+            , {"allocations", static_cast<qulonglong>(layer.residencyMetrics.allocations)}
+            , {"reuses", static_cast<qulonglong>(layer.residencyMetrics.reuses)}
+            , {"evictions", static_cast<qulonglong>(layer.residencyMetrics.evictions)}
+            , {"recycled", static_cast<qulonglong>(layer.residencyMetrics.recycled)}});
+    }
+    return {{"gpu_cube_edge_length", state->viewer->gpucubeedge}, {"layers", layers}};
+}
+
+void PythonProxy::setGpuTextureCapacity(const int cubes) {
+    const auto gpusupercube = (state->M - 1) * Dataset::current().cubeEdgeLength / state->viewer->gpucubeedge + 1;
+    for (auto & layer : state->viewer->layers) {// the visible cubes have to fit
+        layer.setTextureCapacity(std::max(cubes, gpusupercube * gpusupercube * gpusupercube));
+    }
+}
+
+void PythonProxy::setLoaderPrefetchBudget(const int cubes) {
+    Loader::Controller::singleton().prefetchBudget = std::max(0, cubes);
+}
+
+void PythonProxy::setLoaderRequestBatchSize(const int cubes) {
+    Loader::Controller::singleton().requestBatchSize = std::max(1, cubes);
+}
+
+void PythonProxy::setLoaderTransport(const bool http2, const int maxRequestsInFlight) {
+    Loader::Controller::singleton().http2 = http2;
+    Loader::Controller::singleton().maxRequestsInFlight = std::max(0, maxRequestsInFlight);
+}
+
 void PythonProxy::setMagnificationLock(const bool locked) {
     state->viewer->setMagnificationLock(locked);
 }
@@ -142,6 +281,21 @@ void PythonProxy::set_annotation_time(int ms) {
     Session::singleton().setAnnotationTime(ms);
 }
 
+// UNTESTED
+QStringList PythonProxy::kernelBenchmarks() {
+    return KernelBench::benchmarks();
+}
+
+// UNTESTED
+QVariantList PythonProxy::benchmarkKernel(const QString & name, const int repetitions) {
+    return KernelBench::benchmark(name, repetitions);
+}
+
+// UNTESTED
+QVariantList PythonProxy::checkKernels() {
+    return KernelBench::check();
+}
+
 // UNTESTED
 bool PythonProxy::loadStyleSheet(const QString &filename) {
     QFile file(filename);
@@ -27,6 +27,9 @@
 
 #include <QObject>
 #include <QList>
+#include <QStringList>
+#include <QVariantList>
+#include <QVariantMap>
 #include <QVector>
 
 struct _object;
@@ -65,6 +68,8 @@ public slots:
     bool writeOverlayVoxel(QList<int> coord, quint64 val);
     QVector<int> processRegionByStridedBufProxy(QList<int> globalFirst, QList<int> size, quint64 dataPtr,
                                         QList<int> strides, bool isWrite, bool isMarkedChanged);
+    QVector<int> fillOverlayRegion(QList<int> globalFirst, QList<int> size, quint64 value, bool isMarkChanged = true);
+    QVariantMap overlayCubeArrayInterface(QList<int> globalCoord);
     void coordCubesMarkChangedProxy(QVector<int> cubeChangeSetList);
     void setMovementArea(QList<int> minCoord, QList<int> maxCoord);
     void resetMovementArea();
@@ -73,7 +78,21 @@ public slots:
     void oc_reslice_notify_all(QList<int> coord);
     int loaderLoadingNr();
     bool loaderFinished();
+    QVariantMap loaderMemoryStats();
+    QVariantMap loaderMetrics();
+    QString loaderMetricsJson();
+    void resetLoaderMetrics();
+    QVariantMap gpuUploadMetrics();
+    void resetGpuUploadMetrics();
+    QVariantMap gpuTextureResidency();
+    void setGpuTextureCapacity(const int cubes);
+    void setLoaderPrefetchBudget(const int cubes);
+    void setLoaderRequestBatchSize(const int cubes);
+    void setLoaderTransport(const bool http2, const int maxRequestsInFlight);
     bool loadStyleSheet(const QString &path);
+    QStringList kernelBenchmarks();
+    QVariantList benchmarkKernel(const QString & name, const int repetitions = 0);// 0 uses the default of the benchmark
+    QVariantList checkKernels();
     void setMagnificationLock(const bool locked);
 };
 
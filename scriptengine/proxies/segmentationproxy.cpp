@@ -110,3 +110,15 @@ void SegmentationProxy::jumpToObject(const quint64 objId) {
 QList<int> SegmentationProxy::objectLocation(const quint64 objId) {
     return objectFromId(objId).location.list();
 }
+
+QList<quint64> SegmentationProxy::splitObjectIntoComponents(const quint64 objId) {
+    QList<quint64> newIds;
+    for (const auto index : splitIntoConnectedComponents(objectFromId(objId).index)) {
+        newIds.append(Segmentation::singleton().objects[index].id);
+    }
+    return newIds;
+}
+
+quint64 SegmentationProxy::splitDisconnectedSubobjects() {
+    return ::splitDisconnectedSubobjects();
+}
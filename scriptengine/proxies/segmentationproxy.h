@@ -48,6 +48,8 @@ public slots:
     void unselectObject(const quint64 objId);
     void jumpToObject(const quint64 objId);
     QList<int> objectLocation(const quint64 objId);
+    QList<quint64> splitObjectIntoComponents(const quint64 objId);
+    quint64 splitDisconnectedSubobjects();
 };
 
 #endif // SEGMENTATIONPROXY_H
@@ -0,0 +1,291 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "brushrasterizer.h"
+
+#include "cubeloader.h"
+#include "dataset.h"
+#include "hashtable.h"
+#include "kernelbench.h"
+#include "segmentation.h"
+#include "stateInfo.h"
+
+#include <QElapsedTimer>
+
+#include <cmath>
+#include <unordered_set>
+
+namespace {
+int floorToMag(const double value, const int magnification) {
+    return static_cast<int>(std::floor(value / magnification)) * magnification;
+}
+
+// same arithmetic as isInsideSphere, so the spans cover exactly the voxels the per voxel test accepted
+bool insideSphere(const double xi, const double yi, const double zi, const floatCoordinate & scale, const double radius) {
+    const auto x = xi * scale.x;
+    const auto y = yi * scale.y;
+    const auto z = zi * scale.z;
+    const auto sqdistance = x*x + y*y + z*z;
+    return sqdistance < radius * radius;
+}
+}
+
+BrushRasterizer::BrushRasterizer(CubeLookup lookup, const int cubeEdgeLength, const int magnification, const floatCoordinate & scale
+                                 , const Coordinate & center, const brush_t & brush, const Coordinate & globalFirst, const Coordinate & globalLast)
+        : lookup{std::move(lookup)}, cubeEdge{cubeEdgeLength}, magnification{magnification}
+        , first{-floorToMag(-globalFirst.x, magnification), -floorToMag(-globalFirst.y, magnification), -floorToMag(-globalFirst.z, magnification)}
+        , last{floorToMag(globalLast.x, magnification), floorToMag(globalLast.y, magnification), floorToMag(globalLast.z, magnification)} {
+    if (first.x > last.x || first.y > last.y || first.z > last.z) {
+        return;
+    }
+    rowsY = (last.y - first.y) / magnification + 1;
+    spans.reserve(rowsY * ((last.z - first.z) / magnification + 1));
+    const double radius = brush.radius;
+    // the voxel closest to the center has the smallest distance in every row
+    const auto nearestX = floorToMag(center.x + magnification / 2.0, magnification);
+    for (int z = first.z; z <= last.z; z += magnification)
+    for (int y = first.y; y <= last.y; y += magnification) {
+        if (brush.shape == brush_t::shape_t::angular) {
+            spans.emplace_back(first.x, last.x);
+            continue;
+        }
+        const auto inside = [&](const int x){
+            return insideSphere(x - center.x, y - center.y, z - center.z, scale, radius);
+        };
+        if (!inside(nearestX)) {
+            spans.emplace_back(0, -1);
+            continue;
+        }
+        // estimate the extent and correct it with the exact test
+        const double ys = (y - center.y) * static_cast<double>(scale.y);
+        const double zs = (z - center.z) * static_cast<double>(scale.z);
+        const auto halfWidth = std::sqrt(std::max(0.0, radius * radius - ys * ys - zs * zs)) / std::abs(static_cast<double>(scale.x));
+        auto low = std::min(nearestX, floorToMag(center.x - halfWidth, magnification));
+        auto high = std::max(nearestX, -floorToMag(-(center.x + halfWidth), magnification));
+        while (!inside(low)) {
+            low += magnification;
+        }
+        while (inside(low - magnification)) {
+            low -= magnification;
+        }
+        while (!inside(high)) {
+            high -= magnification;
+        }
+        while (inside(high + magnification)) {
+            high += magnification;
+        }
+        spans.emplace_back(std::max(low, first.x), std::min(high, last.x));
+    }
+}
+
+BrushRasterizer BrushRasterizer::overlay(const Coordinate & center, const brush_t & brush) {
+    const auto magnification = Dataset::current().magnification;
+    const auto lookup = [magnification](const CoordOfCube & cubeCoord) -> std::uint64_t * {
+        if (!Segmentation::singleton().enabled) {
+            return nullptr;
+        }
+        auto & cubes = state->cube2Pointer[Segmentation::singleton().layerId][int_log(magnification)];
+        return reinterpret_cast<std::uint64_t *>(Coordinate2BytePtr_hash_get_or_fail(cubes, cubeCoord));
+    };
+    const auto region = getRegion(center, brush);
+    auto pin = pinOverlay();// the spans are painted after the lookup
+    BrushRasterizer rasterizer(lookup, Dataset::current().cubeEdgeLength, magnification, Dataset::current().scale, center, brush, region.first, region.second);
+    rasterizer.pin = std::move(pin);
+    return rasterizer;
+}
+
+std::size_t BrushRasterizer::voxelCount() const {
+    std::size_t count{0};
+    for (const auto & row : spans) {
+        if (row.first <= row.second) {
+            count += (row.second - row.first) / magnification + 1;
+        }
+    }
+    return count;
+}
+
+namespace {
+// the traversal writeVoxels used before: a sphere test (and a selection lookup) per voxel of the region
+template<typename Func>
+std::size_t referencePaint(const BrushRasterizer::CubeLookup & lookup, const int edge, const Coordinate & globalFirst, const Coordinate & globalLast, Func func) {
+    std::size_t count{0};
+    const auto cubeBegin = globalFirst.cube(edge, 1);
+    const auto cubeEnd = globalLast.cube(edge, 1) + 1;
+    for (int z = cubeBegin.z; z < cubeEnd.z; ++z)
+    for (int y = cubeBegin.y; y < cubeEnd.y; ++y)
+    for (int x = cubeBegin.x; x < cubeEnd.x; ++x) {
+        const auto cubeCoord = CoordOfCube(x, y, z);
+        auto * cube = lookup(cubeCoord);
+        const auto globalCubeBegin = cubeCoord.cube2Global(edge, 1);
+        const auto globalCubeEnd = globalCubeBegin + edge - 1;
+        const auto localStart = globalFirst.capped(globalCubeBegin, globalCubeEnd).insideCube(edge, 1);
+        const auto localEnd = globalLast.capped(globalCubeBegin, globalCubeEnd).insideCube(edge, 1);
+        for (int z = localStart.z; z <= localEnd.z; ++z)
+        for (int y = localStart.y; y <= localEnd.y; ++y)
+        for (int x = localStart.x; x <= localEnd.x; ++x) {
+            count += func(cube[x + edge * (y + static_cast<std::size_t>(edge) * z)], Coordinate{globalCubeBegin.x + x, globalCubeBegin.y + y, globalCubeBegin.z + z});
+        }
+    }
+    return count;
+}
+}
+
+std::vector<BrushRasterizer::BenchmarkResult> BrushRasterizer::benchmark(const std::vector<int> & radii, const int repetitions) {
+    const int edge = 64;
+    const int grid = 4;
+    const auto cubeVoxels = static_cast<std::size_t>(edge) * edge * edge;
+    std::vector<std::vector<std::uint64_t>> cubes(grid * grid * grid, std::vector<std::uint64_t>(cubeVoxels));
+    const auto reset = [&cubes, edge](){// slabs of 8 ids of which every other one is selected
+        for (auto & cube : cubes) {
+            for (std::size_t i = 0; i < cube.size(); ++i) {
+                cube[i] = 1 + i / (edge * edge * 8) % 8;
+            }
+        }
+    };
+    const CubeLookup lookup = [&cubes, grid](const CoordOfCube & coord) -> std::uint64_t * {
+        if (coord.x < 0 || coord.y < 0 || coord.z < 0 || coord.x >= grid || coord.y >= grid || coord.z >= grid) {
+            return nullptr;
+        }
+        return cubes[coord.x + grid * (coord.y + grid * coord.z)].data();
+    };
+    const std::unordered_set<std::uint64_t> selected{2, 4, 6, 8};
+    const floatCoordinate scale{10, 10, 25};
+    const Coordinate center{grid * edge / 2, grid * edge / 2, grid * edge / 2};
+    const Coordinate gridMax{grid * edge - 1, grid * edge - 1, grid * edge - 1};
+    std::vector<BenchmarkResult> results;
+    for (const auto radius : radii) {
+        for (const QString mode : {"2d round", "3d round", "3d angular", "3d inverse round"}) {
+            brush_t brush;
+            brush.radius = radius;
+            brush.mode = mode.startsWith("2d") ? brush_t::mode_t::two_dim : brush_t::mode_t::three_dim;
+            brush.shape = mode.endsWith("angular") ? brush_t::shape_t::angular : brush_t::shape_t::round;
+            brush.inverse = mode.contains("inverse");
+            const Coordinate extent{static_cast<int>(radius / scale.x), static_cast<int>(radius / scale.y), brush.mode == brush_t::mode_t::three_dim ? static_cast<int>(radius / scale.z) : 0};
+            const auto globalFirst = (center - extent).capped({0, 0, 0}, gridMax);
+            const auto globalLast = (center + extent).capped({0, 0, 0}, gridMax);
+            const auto round = brush.shape == brush_t::shape_t::round;
+            const auto measure = [&](const QString & method, auto paint){
+                reset();
+                std::size_t voxels{0};
+                QElapsedTimer timer;
+                timer.start();
+                for (int i{0}; i < repetitions; ++i) {
+                    voxels = paint();
+                }
+                results.push_back({radius, mode, method, voxels, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions) / std::max<std::size_t>(1, voxels)});
+            };
+            measure("per voxel", [&](){
+                return referencePaint(lookup, edge, globalFirst, globalLast, [&](std::uint64_t & voxel, const Coordinate & pos){
+                    if (!round || insideSphere(pos.x - center.x, pos.y - center.y, pos.z - center.z, scale, radius)) {
+                        if (!brush.inverse) {
+                            voxel = 9;
+                        } else if (selected.find(voxel) != std::end(selected)) {
+                            voxel = 0;
+                        }
+                        return true;
+                    }
+                    return false;
+                });
+            });
+            measure("spans", [&](){
+                const BrushRasterizer rasterizer(lookup, edge, 1, scale, center, brush, globalFirst, globalLast);
+                if (!brush.inverse) {
+                    rasterizer.rasterize([](std::uint64_t * ids, const int count){
+                        std::fill_n(ids, count, 9);
+                    });
+                } else {
+                    rasterizer.rasterize([&selected, lastId = std::uint64_t{0}, lastSelected = false](std::uint64_t * ids, const int count) mutable {
+                        for (int i = 0; i < count; ++i) {
+                            if (ids[i] != lastId) {
+                                lastId = ids[i];
+                                lastSelected = selected.find(lastId) != std::end(selected);
+                            }
+                            if (lastSelected) {
+                                ids[i] = 0;
+                            }
+                        }
+                    });
+                }
+                return rasterizer.voxelCount();
+            });
+        }
+    }
+    return results;
+}
+
+namespace {
+// paints brushes and compares the painted voxels with a sphere test per voxel
+QVariantList checkBrush() {
+    struct Case {
+        QString name;
+        brush_t::mode_t mode;
+        brush_t::shape_t shape;
+        int radius;
+        int magnification;
+    };
+    const std::vector<Case> cases{{"2d round", brush_t::mode_t::two_dim, brush_t::shape_t::round, 150, 1}
+        , {"3d round", brush_t::mode_t::three_dim, brush_t::shape_t::round, 230, 1}
+        , {"3d round in mag 2", brush_t::mode_t::three_dim, brush_t::shape_t::round, 230, 2}
+        , {"3d angular", brush_t::mode_t::three_dim, brush_t::shape_t::angular, 120, 1}};
+    const int edge = 32;
+    const auto scale = Dataset::current().scale;
+    QVariantList results;
+    for (const auto & test : cases) {
+        KernelBench::SyntheticCubes cubes(edge, 3, test.magnification);
+        brush_t brush;
+        brush.mode = test.mode;
+        brush.shape = test.shape;
+        brush.radius = test.radius;
+        const auto center = Coordinate{1, 1, 1} * (edge * 3 * test.magnification / 2) + Coordinate{1, 0, 1};// off the voxels of mag 2
+        const Coordinate extent{static_cast<int>(test.radius / scale.x) + 1, static_cast<int>(test.radius / scale.y) + 1, test.mode == brush_t::mode_t::three_dim ? static_cast<int>(test.radius / scale.z) + 1 : 0};
+        const auto first = (center - extent).capped({0, 0, 0}, cubes.globalMax());
+        const auto last = (center + extent).capped({0, 0, 0}, cubes.globalMax());
+        const BrushRasterizer rasterizer(cubes.lookup(), edge, test.magnification, scale, center, brush, first, last);
+        rasterizer.rasterize([](std::uint64_t * ids, const int count){
+            std::fill_n(ids, count, 1);
+        });
+        std::size_t failures{0};
+        std::size_t total{0};
+        cubes.forEach([&](const Coordinate & pos, const std::uint64_t id){
+            const bool covered = KernelBench::inside(pos, first, last)
+                    && (test.shape == brush_t::shape_t::angular || isInsideSphere(pos.x - center.x, pos.y - center.y, pos.z - center.z, test.radius));
+            failures += (id == 1) != covered;
+            ++total;
+        });
+        results.append(KernelBench::voxelCheckResult("brush", test.name + " spans vs isInsideSphere", failures, total));
+    }
+    return results;
+}
+
+const KernelBench::Registration registration{"brush", 5, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : BrushRasterizer::benchmark({100, 400, 1000}, repetitions)) {
+        results.append(QVariantMap{{"radius", result.radius}
+            , {"mode", result.mode}
+            , {"method", result.method}
+            , {"voxels", static_cast<qulonglong>(result.voxels)}
+            , {"ns_per_voxel", result.nsPerVoxel}});
+    }
+    return results;
+}, checkBrush};
+}
@@ -0,0 +1,132 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef BRUSHRASTERIZER_H
+#define BRUSHRASTERIZER_H
+
+#include "coordinate.h"
+#include "hashtable.h"
+#include "segmentationsplit.h"
+
+#include <QDebug>
+#include <QString>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief BrushRasterizer hands out the voxels covered by a brush as x-spans inside one cube.
+ *
+ * The x-extent of the brush is solved once per (y, z) row of the region, so painting is a fill per span
+ * instead of a sphere test per voxel. Round brushes cover the voxels of the region (the bounding box of the brush frame)
+ * which lie inside the sphere scaled by the voxel size, angular brushes cover the whole region.
+ * Coordinates are global, only voxels of the given magnification are covered.
+ */
+class BrushRasterizer {
+public:
+    using CubeLookup = std::function<std::uint64_t *(const CoordOfCube &)>;// nullptr if the cube isn’t loaded
+
+    BrushRasterizer(CubeLookup lookup, const int cubeEdgeLength, const int magnification, const floatCoordinate & scale
+                    , const Coordinate & center, const brush_t & brush, const Coordinate & globalFirst, const Coordinate & globalLast);
+    // overlay cubes of the current magnification in the region of the brush, they stay pinned until the destruction of the rasterizer
+    static BrushRasterizer overlay(const Coordinate & center, const brush_t & brush);
+
+    // covered global x-range [first, second] of the row, empty if first > second
+    const std::pair<int, int> & span(const int y, const int z) const {
+        return spans[(y - first.y) / magnification + rowsY * static_cast<std::size_t>((z - first.z) / magnification)];
+    }
+    /**
+     * visit(ids, count) receives the covered voxels span by span and may overwrite them.
+     * Returns the cubes containing covered voxels.
+     */
+    template<typename Visit>
+    std::unordered_set<CoordOfCube> rasterize(Visit visit) const;
+    std::size_t voxelCount() const;
+
+    struct BenchmarkResult {
+        int radius;// of the brush
+        QString mode;// "2d round", "3d round", "3d angular" or "3d inverse round"
+        QString method;// "per voxel" sphere tests like before or "spans"
+        std::size_t voxels;
+        double nsPerVoxel;
+    };
+    // paints brushes of the given radii into a synthetic cube grid with cube edge length 64
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & radii, const int repetitions);
+private:
+    std::unique_ptr<CubeHash::Pin> pin;
+    CubeLookup lookup;
+    int cubeEdge;
+    int magnification;
+    Coordinate first;// region aligned to the voxels of the magnification
+    Coordinate last;
+    std::size_t rowsY{0};
+    std::vector<std::pair<int, int>> spans;// per row of the region, empty if the region is
+};
+
+template<typename Visit>
+std::unordered_set<CoordOfCube> BrushRasterizer::rasterize(Visit visit) const {
+    std::unordered_set<CoordOfCube> cubeCoords;
+    if (spans.empty()) {
+        return cubeCoords;
+    }
+    const auto cubeBegin = first.cube(cubeEdge, magnification);
+    const auto cubeEnd = last.cube(cubeEdge, magnification) + 1;
+    for (int z = cubeBegin.z; z < cubeEnd.z; ++z)
+    for (int y = cubeBegin.y; y < cubeEnd.y; ++y)
+    for (int x = cubeBegin.x; x < cubeEnd.x; ++x) {
+        const auto cubeCoord = CoordOfCube(x, y, z);
+        const auto globalCubeBegin = cubeCoord.cube2Global(cubeEdge, magnification);
+        const auto globalCubeEnd = globalCubeBegin + (cubeEdge - 1) * magnification;
+        const auto cubeFirst = first.capped(globalCubeBegin, globalCubeEnd);
+        const auto cubeLast = last.capped(globalCubeBegin, globalCubeEnd);
+        std::uint64_t * cube{nullptr};// looked up with the first covered row
+        for (int globalZ = cubeFirst.z; globalZ <= cubeLast.z; globalZ += magnification)
+        for (int globalY = cubeFirst.y; globalY <= cubeLast.y; globalY += magnification) {
+            const auto & row = span(globalY, globalZ);
+            const auto runFirst = std::max(row.first, cubeFirst.x);
+            const auto runLast = std::min(row.second, cubeLast.x);
+            if (runFirst > runLast) {
+                continue;
+            }
+            if (cube == nullptr && (cube = lookup(cubeCoord)) == nullptr) {
+                qCritical() << x << y << z << "cube missing for brush";
+                globalZ = cubeLast.z;// skip the cube
+                break;
+            }
+            const auto local = Coordinate{runFirst, globalY, globalZ}.insideCube(cubeEdge, magnification);
+            visit(cube + local.x + cubeEdge * (local.y + static_cast<std::size_t>(cubeEdge) * local.z), (runLast - runFirst) / magnification + 1);
+        }
+        if (cube != nullptr) {
+            cubeCoords.emplace(cubeCoord);
+        }
+    }
+    return cubeCoords;
+}
+
+#endif//BRUSHRASTERIZER_H
@@ -0,0 +1,287 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+#include "compressedsegmentation.h"
+
+#include "kernelbench.h"
+
+#include <QElapsedTimer>
+
+#include <snappy.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace {
+constexpr std::size_t blockVoxels = CompressedSegmentation::blockEdge * CompressedSegmentation::blockEdge * CompressedSegmentation::blockEdge;
+constexpr std::uint32_t maxOffset = (1 << 24) - 1;
+
+int blocksPerEdge(const int cubeEdgeLength) {
+    return (cubeEdgeLength + CompressedSegmentation::blockEdge - 1) / CompressedSegmentation::blockEdge;
+}
+
+std::uint32_t word(const char * data, const std::size_t index) {
+    std::uint32_t value;
+    std::memcpy(&value, data + 4 * index, sizeof(value));
+    return value;
+}
+
+struct BlockHeader {
+    std::size_t palette;
+    std::uint32_t bits;
+    std::size_t indices;
+};
+
+BlockHeader blockHeader(const char * data, const std::size_t block) {
+    const auto first = word(data, 2 * block);
+    return {first & maxOffset, first >> 24, word(data, 2 * block + 1)};
+}
+
+std::uint64_t paletteEntry(const char * data, const BlockHeader & header, const std::size_t index) {
+    std::uint64_t value;// low word first
+    std::memcpy(&value, data + 4 * (header.palette + 2 * index), sizeof(value));
+    return value;
+}
+
+std::uint32_t paletteIndex(const char * data, const BlockHeader & header, const std::size_t voxel) {
+    if (header.bits == 0) {
+        return 0;
+    }
+    const auto bit = voxel * header.bits;// indices never straddle words
+    return (word(data, header.indices + bit / 32) >> (bit % 32)) & static_cast<std::uint32_t>((1ull << header.bits) - 1);
+}
+}
+
+std::string CompressedSegmentation::encode(const std::uint64_t * cube, const int cubeEdgeLength) {
+    const std::size_t edge = cubeEdgeLength;
+    const std::size_t blocks = blocksPerEdge(cubeEdgeLength);
+    std::vector<std::uint32_t> words(2 * blocks * blocks * blocks);
+    std::map<std::vector<std::uint64_t>, std::uint32_t> palettes;// shared between blocks
+    std::vector<std::uint64_t> values(blockVoxels);
+    std::vector<std::uint64_t> palette;
+    for (std::size_t bz{0}; bz < blocks; ++bz)
+    for (std::size_t by{0}; by < blocks; ++by)
+    for (std::size_t bx{0}; bx < blocks; ++bx) {
+        // voxels of partial blocks outside of the cube repeat the border, so they don’t add to the palette
+        auto * value = values.data();
+        for (std::size_t z{0}; z < blockEdge; ++z)
+        for (std::size_t y{0}; y < blockEdge; ++y) {
+            const auto * row = cube + std::min(by * blockEdge + y, edge - 1) * edge + std::min(bz * blockEdge + z, edge - 1) * edge * edge;
+            for (std::size_t x{0}; x < blockEdge; ++x) {
+                *value++ = row[std::min(bx * blockEdge + x, edge - 1)];
+            }
+        }
+        palette = values;
+        std::sort(std::begin(palette), std::end(palette));
+        palette.erase(std::unique(std::begin(palette), std::end(palette)), std::end(palette));
+        std::uint32_t bits{0};
+        while ((std::size_t{1} << bits) < palette.size()) {
+            bits = bits == 0 ? 1 : 2 * bits;
+        }
+
+        const std::size_t indices = words.size();
+        if (bits > 0) {
+            words.resize(words.size() + blockVoxels * bits / 32);
+            std::size_t lastIndex{0};
+            for (std::size_t i{0}; i < blockVoxels; ++i) {
+                if (palette[lastIndex] != values[i]) {// neighbors mostly share their id
+                    lastIndex = std::lower_bound(std::begin(palette), std::end(palette), values[i]) - std::begin(palette);
+                }
+                const auto bit = i * bits;
+                words[indices + bit / 32] |= static_cast<std::uint32_t>(lastIndex) << (bit % 32);
+            }
+        }
+        auto paletteIt = palettes.find(palette);
+        if (paletteIt == std::end(palettes)) {
+            if (words.size() > maxOffset) {
+                return {};
+            }
+            paletteIt = palettes.emplace(palette, static_cast<std::uint32_t>(words.size())).first;
+            for (const auto id : palette) {
+                words.emplace_back(static_cast<std::uint32_t>(id));
+                words.emplace_back(static_cast<std::uint32_t>(id >> 32));
+            }
+        }
+        const auto block = bx + blocks * (by + blocks * bz);
+        words[2 * block] = paletteIt->second | bits << 24;
+        words[2 * block + 1] = static_cast<std::uint32_t>(indices);
+    }
+    std::string data(4 * words.size(), '\0');
+    std::memcpy(&data[0], words.data(), data.size());
+    return data;
+}
+
+void CompressedSegmentation::decode(const char * data, const int cubeEdgeLength, std::uint64_t * dst) {
+    const std::size_t edge = cubeEdgeLength;
+    const std::size_t blocks = blocksPerEdge(cubeEdgeLength);
+    for (std::size_t bz{0}; bz < blocks; ++bz)
+    for (std::size_t by{0}; by < blocks; ++by)
+    for (std::size_t bx{0}; bx < blocks; ++bx) {
+        const auto header = blockHeader(data, bx + blocks * (by + blocks * bz));
+        // partial blocks at the border are cut off
+        const auto width = std::min<std::size_t>(blockEdge, edge - bx * blockEdge);
+        const auto height = std::min<std::size_t>(blockEdge, edge - by * blockEdge);
+        const auto depth = std::min<std::size_t>(blockEdge, edge - bz * blockEdge);
+        for (std::size_t z{0}; z < depth; ++z)
+        for (std::size_t y{0}; y < height; ++y) {
+            auto * row = dst + bx * blockEdge + (by * blockEdge + y) * edge + (bz * blockEdge + z) * edge * edge;
+            if (header.bits == 0) {
+                std::fill(row, row + width, paletteEntry(data, header, 0));
+            } else {
+                const auto voxelRow = blockEdge * (y + blockEdge * z);
+                for (std::size_t x{0}; x < width; ++x) {
+                    row[x] = paletteEntry(data, header, paletteIndex(data, header, voxelRow + x));
+                }
+            }
+        }
+    }
+}
+
+bool CompressedSegmentation::valid(const char * data, const std::size_t size, const int cubeEdgeLength) {
+    const std::size_t blocksEdge = blocksPerEdge(cubeEdgeLength);
+    const auto blocks = blocksEdge * blocksEdge * blocksEdge;
+    const auto words = size / 4;
+    if (size % 4 != 0 || words < 2 * blocks) {
+        return false;
+    }
+    for (std::size_t block{0}; block < blocks; ++block) {
+        const auto header = blockHeader(data, block);
+        const bool validBits = header.bits == 0 || header.bits == 1 || header.bits == 2 || header.bits == 4 || header.bits == 8 || header.bits == 16 || header.bits == 32;
+        if (!validBits || header.palette < 2 * blocks || header.palette > words) {
+            return false;
+        }
+        std::uint64_t maxIndex{0};
+        if (header.bits > 0) {
+            if (header.indices < 2 * blocks || header.indices + blockVoxels * header.bits / 32 > words) {
+                return false;
+            }
+            for (std::size_t voxel{0}; voxel < blockVoxels; ++voxel) {
+                maxIndex = std::max<std::uint64_t>(maxIndex, paletteIndex(data, header, voxel));
+            }
+        }
+        if (2 * (maxIndex + 1) > words - header.palette) {// every referenced palette entry
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<CompressedSegmentation::BenchmarkResult> CompressedSegmentation::benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions) {
+    std::vector<BenchmarkResult> results;
+    for (const auto edge : cubeEdgeLengths) {
+        const std::size_t width = edge;
+        const std::size_t cubeBytes = width * width * width * sizeof(std::uint64_t);
+        std::vector<std::uint64_t> cube(width * width * width);
+        std::vector<std::uint64_t> decoded(cube.size());
+        for (const int distinctIds : {16, 4096}) {
+            // supervoxels of 4³ voxels
+            for (std::size_t i{0}; i < cube.size(); ++i) {
+                const std::uint64_t block = (i % width) / 4 + (i / width % width) / 4 * width + (i / width / width) / 4 * width * width;
+                cube[i] = 1 + (block * 2654435761u >> 8) % distinctIds;
+            }
+            std::string compressed;
+            std::string snappyCube;
+            const auto ratio = [cubeBytes](const std::string & data){
+                return static_cast<double>(cubeBytes) / data.size();
+            };
+            const auto measure = [&](const QString & kernel, const QString & operation, const std::string & data, auto run){
+                QElapsedTimer timer;
+                timer.start();
+                for (int i{0}; i < repetitions; ++i) {
+                    run();
+                }
+                results.push_back({edge, kernel, operation, distinctIds, ratio(data), static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions)});
+            };
+            compressed = encode(cube.data(), edge);
+            measure("compressed", "encode", compressed, [&](){
+                compressed = encode(cube.data(), edge);
+            });
+            measure("compressed", "decode", compressed, [&](){
+                decode(compressed.data(), edge, decoded.data());
+            });
+            snappy::Compress(reinterpret_cast<const char *>(cube.data()), cubeBytes, &snappyCube);
+            measure("snappy", "encode", snappyCube, [&](){
+                snappyCube.clear();
+                snappy::Compress(reinterpret_cast<const char *>(cube.data()), cubeBytes, &snappyCube);
+            });
+            measure("snappy", "decode", snappyCube, [&](){
+                snappy::RawUncompress(snappyCube.data(), snappyCube.size(), reinterpret_cast<char *>(decoded.data()));
+            });
+        }
+    }
+    return results;
+}
+
+namespace {
+// round trips several kinds of cubes, including partial blocks at the border, and breaks the encoding
+QVariantList checkCompressedSegmentation() {
+    QVariantList results;
+    for (const int edge : {64, 36}) {
+        const std::size_t width = edge;
+        std::vector<std::uint64_t> cube(width * width * width);
+        std::vector<std::uint64_t> decoded(cube.size());
+        for (const QString kind : {"constant", "blocks of 4 voxels", "noise of 3 ids", "distinct ids"}) {
+            for (std::size_t i = 0; i < cube.size(); ++i) {
+                const std::uint64_t block = (i % width) / 4 + (i / width % width) / 4 * width + (i / width / width) / 4 * width * width;
+                cube[i] = kind == "constant" ? 7 : kind == "blocks of 4 voxels" ? 1 + KernelBench::mix(block) % 16 : kind == "noise of 3 ids" ? (std::uint64_t{1} << 40) + KernelBench::mix(i) % 3 : KernelBench::mix(i);
+            }
+            const auto name = QString("%1 (cube edge %2)").arg(kind).arg(edge);
+            const auto encoded = CompressedSegmentation::encode(cube.data(), edge);
+            if (encoded.empty()) {
+                results.append(KernelBench::checkResult("compressed segmentation", name + " round trip", false, "not encodable"));
+                continue;
+            }
+            std::fill(std::begin(decoded), std::end(decoded), 0);
+            CompressedSegmentation::decode(encoded.data(), edge, decoded.data());
+            std::size_t failures{0};
+            for (std::size_t i = 0; i < cube.size(); ++i) {
+                failures += decoded[i] != cube[i];
+            }
+            results.append(KernelBench::voxelCheckResult("compressed segmentation", name + " round trip", failures, cube.size()));
+
+            auto corrupted = encoded;
+            corrupted[3] = 3;// index bits of the first block
+            const bool accepted = CompressedSegmentation::valid(encoded.data(), encoded.size(), edge);
+            const bool truncatedRejected = !CompressedSegmentation::valid(encoded.data(), encoded.size() - 4, edge);
+            const bool corruptedRejected = !CompressedSegmentation::valid(corrupted.data(), corrupted.size(), edge);
+            results.append(KernelBench::checkResult("compressed segmentation", name + " validation", accepted && truncatedRejected && corruptedRejected
+                                                    , QString("encoding %1, truncated copy %2, corrupted copy %3").arg(accepted ? "accepted" : "rejected")
+                                                    .arg(truncatedRejected ? "rejected" : "accepted").arg(corruptedRejected ? "rejected" : "accepted")));
+        }
+    }
+    return results;
+}
+
+const KernelBench::Registration registration{"compressed segmentation", 10, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : CompressedSegmentation::benchmark({64, 128, 256}, repetitions)) {
+        results.append(QVariantMap{{"cube_edge_length", result.cubeEdgeLength}
+            , {"kernel", result.kernel}
+            , {"operation", result.operation}
+            , {"distinct_ids", result.distinctIds}
+            , {"compression_ratio", result.compressionRatio}
+            , {"ns_per_operation", result.nsPerOperation}});
+    }
+    return results;
+}, checkCompressedSegmentation};
+}
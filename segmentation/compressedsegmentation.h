@@ -0,0 +1,70 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef COMPRESSEDSEGMENTATION_H
+#define COMPRESSEDSEGMENTATION_H
+
+#include <QString>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief CompressedSegmentation encodes cubes of 64 bit segmentation ids in the compressed_segmentation
+ * format of Neuroglancer (single channel, 8³ blocks).
+ *
+ * Every block stores a palette of its distinct ids and 0 to 32 bit indices into it,
+ * identical palettes are shared between blocks.
+ * Only evicted overlay cubes are kept in it (CompressedCubeCache), they are decoded into a whole slot when they return.
+ * Loaded overlay cubes stay raw because the slicers, the gpu upload, the brush, the fills and the python buffers
+ * read and write their ids in place, so the supercube still costs OBJID_BYTES per voxel.
+ *
+ * Layout in 32 bit little endian words: 2 header words per block (x fastest),
+ * the first holds the palette offset (24 bit) and the index bits (8 bit), the second the index offset.
+ * Offsets count words from the start of the data.
+ */
+class CompressedSegmentation {
+public:
+    static constexpr int blockEdge = 8;
+
+    // empty if the palettes don’t fit into the 24 bit offsets (only happens for noise)
+    static std::string encode(const std::uint64_t * cube, const int cubeEdgeLength);
+    // dst receives cubeEdgeLength³ ids, the data has to pass valid
+    static void decode(const char * data, const int cubeEdgeLength, std::uint64_t * dst);
+    // whether every block has a supported index width and its indices and palette entries lie inside the data
+    static bool valid(const char * data, const std::size_t size, const int cubeEdgeLength);
+
+    struct BenchmarkResult {
+        int cubeEdgeLength;
+        QString kernel;// "compressed" or "snappy"
+        QString operation;// "encode" or "decode" of a whole cube
+        int distinctIds;// per cube
+        double compressionRatio;
+        double nsPerOperation;
+    };
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions);
+};
+
+#endif//COMPRESSEDSEGMENTATION_H
@@ -0,0 +1,481 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+#include "connectedcomponents.h"
+
+#include "dataset.h"
+#include "floodfill.h"
+#include "hashtable.h"
+#include "kernelbench.h"
+#include "segmentation.h"
+#include "session.h"
+#include "stateInfo.h"
+
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+// lock-free union-find, roots are only ever linked below smaller roots
+class ConcurrentUnionFind {
+    std::unique_ptr<std::atomic<std::uint32_t>[]> parents;
+public:
+    explicit ConcurrentUnionFind(const std::size_t size) : parents{new std::atomic<std::uint32_t>[size]} {
+        for (std::size_t i = 0; i < size; ++i) {
+            parents[i].store(static_cast<std::uint32_t>(i), std::memory_order_relaxed);
+        }
+    }
+    std::uint32_t find(std::uint32_t label) {
+        while (true) {
+            auto parent = parents[label].load();
+            if (parent == label) {
+                return label;
+            }
+            const auto grandparent = parents[parent].load();
+            parents[label].compare_exchange_weak(parent, grandparent);// path halving, losing the race is harmless
+            label = grandparent;
+        }
+    }
+    void unite(std::uint32_t lhs, std::uint32_t rhs) {
+        while (true) {
+            lhs = find(lhs);
+            rhs = find(rhs);
+            if (lhs == rhs) {
+                return;
+            }
+            if (lhs > rhs) {
+                std::swap(lhs, rhs);
+            }
+            auto expected = rhs;
+            if (parents[rhs].compare_exchange_strong(expected, lhs)) {// fails if rhs stopped being a root
+                return;
+            }
+        }
+    }
+};
+
+constexpr auto noComponent = std::numeric_limits<std::uint32_t>::max();
+}
+
+ConnectedComponents::ConnectedComponents(Cubes cubes, const int cubeEdgeLength, const int magnification, const Coordinate & globalMin, const Coordinate & globalMax)
+        : cubes{std::move(cubes)}, cubeEdge{cubeEdgeLength}, magnification{magnification}
+        , min{{globalMin.x / magnification, globalMin.y / magnification, globalMin.z / magnification}}
+        , max{{globalMax.x / magnification, globalMax.y / magnification, globalMax.z / magnification}} {}
+
+ConnectedComponents ConnectedComponents::overlay() {
+    const auto magnification = Dataset::current().magnification;
+    Cubes cubes;
+    std::unique_ptr<CubeHash::Pin> pin;
+    if (Segmentation::singleton().enabled) {
+        const auto & cubeHash = state->cube2Pointer[Segmentation::singleton().layerId][int_log(magnification)];
+        pin.reset(new CubeHash::Pin(cubeHash));// labelling and relabelling work on the slots after the lookup
+        cubeHash.forEach([&cubes](const CoordOfCube & cubeCoord, void * cube){
+            cubes.emplace_back(cubeCoord, reinterpret_cast<std::uint64_t *>(cube));
+        });
+    }
+    std::sort(std::begin(cubes), std::end(cubes), [](const auto & lhs, const auto & rhs){// deterministic labels
+        return std::tie(lhs.first.z, lhs.first.y, lhs.first.x) < std::tie(rhs.first.z, rhs.first.y, rhs.first.x);
+    });
+    ConnectedComponents labelling(std::move(cubes), Dataset::current().cubeEdgeLength, magnification, Session::singleton().movementAreaMin, Session::singleton().movementAreaMax);
+    labelling.pin = std::move(pin);
+    return labelling;
+}
+
+void ConnectedComponents::unpin() {
+    cubes.clear();
+    pin.reset();
+}
+
+std::pair<ConnectedComponents::Voxel, ConnectedComponents::Voxel> ConnectedComponents::box(const CoordOfCube & cubeCoord) const {
+    const Voxel origin{{cubeCoord.x * cubeEdge, cubeCoord.y * cubeEdge, cubeCoord.z * cubeEdge}};
+    Voxel first, last;
+    for (std::size_t axis = 0; axis < 3; ++axis) {
+        first[axis] = std::max(0, min[axis] - origin[axis]);
+        last[axis] = std::min(cubeEdge - 1, max[axis] - origin[axis]);
+    }
+    return {first, last};
+}
+
+std::uint32_t ConnectedComponents::labelCube(const std::size_t cubeIndex, std::vector<std::uint32_t> & labels, std::vector<std::uint32_t> & parents, std::vector<std::uint64_t> & labelKeys) const {
+    const auto * ids = cubes[cubeIndex].second;
+    const auto area = static_cast<std::size_t>(cubeEdge) * cubeEdge;
+    labels.assign(area * cubeEdge, 0);
+    parents.assign(1, 0);// provisional label 0 marks excluded voxels
+    labelKeys.assign(1, 0);
+    const auto find = [&parents](std::uint32_t label){
+        while (parents[label] != label) {
+            parents[label] = parents[parents[label]];
+            label = parents[label];
+        }
+        return label;
+    };
+    const auto range = box(cubes[cubeIndex].first);
+    bool keyKnown{false};
+    std::uint64_t lastId{0};
+    std::uint64_t lastKey{0};
+    for (int z = range.first[2]; z <= range.second[2]; ++z)
+    for (int y = range.first[1]; y <= range.second[1]; ++y) {
+        const auto row = static_cast<std::size_t>(cubeEdge) * (y + static_cast<std::size_t>(cubeEdge) * z);
+        for (int x = range.first[0]; x <= range.second[0]; ++x) {
+            const auto i = row + x;
+            if (!keyKnown || ids[i] != lastId) {
+                keyKnown = true;
+                lastId = ids[i];
+                lastKey = key(lastId);
+            }
+            if (lastKey == 0) {
+                continue;
+            }
+            std::uint32_t label{0};
+            const auto join = [&](const std::size_t neighbor){
+                const auto neighborLabel = labels[neighbor];
+                if (neighborLabel == 0 || labelKeys[neighborLabel] != lastKey) {
+                    return;
+                }
+                if (label == 0) {
+                    label = neighborLabel;
+                } else if (neighborLabel != label) {
+                    const auto lhs = find(label);
+                    const auto rhs = find(neighborLabel);
+                    parents[std::max(lhs, rhs)] = std::min(lhs, rhs);
+                }
+            };
+            if (x > range.first[0]) {
+                join(i - 1);
+            }
+            if (y > range.first[1]) {
+                join(i - cubeEdge);
+            }
+            if (z > range.first[2]) {
+                join(i - area);
+            }
+            if (label == 0) {
+                label = static_cast<std::uint32_t>(parents.size());
+                parents.emplace_back(label);
+                labelKeys.emplace_back(lastKey);
+            }
+            labels[i] = label;
+        }
+    }
+    // roots are the smallest label of their set, so they get numbered before their members
+    std::vector<std::uint32_t> finalLabels(parents.size(), 0);
+    std::uint32_t count{0};
+    for (std::uint32_t label = 1; label < parents.size(); ++label) {
+        const auto root = find(label);
+        finalLabels[label] = root == label ? ++count : finalLabels[root];
+        labelKeys[finalLabels[label]] = labelKeys[label];
+    }
+    labelKeys.resize(count + 1);
+    for (int z = range.first[2]; z <= range.second[2]; ++z)
+    for (int y = range.first[1]; y <= range.second[1]; ++y) {
+        const auto row = static_cast<std::size_t>(cubeEdge) * (y + static_cast<std::size_t>(cubeEdge) * z);
+        for (int x = range.first[0]; x <= range.second[0]; ++x) {
+            labels[row + x] = finalLabels[labels[row + x]];
+        }
+    }
+    return count;
+}
+
+const std::vector<ConnectedComponents::Component> & ConnectedComponents::label(Key newKey) {
+    key = std::move(newKey);
+    cubeLabels.assign(cubes.size(), {});
+    const auto edge = static_cast<std::size_t>(cubeEdge);
+    QtConcurrent::blockingMap(cubeLabels, [this, edge, first = cubeLabels.data()](CubeLabels & result){
+        const auto cubeIndex = static_cast<std::size_t>(&result - first);
+        std::vector<std::uint32_t> labels, parents;
+        std::vector<std::uint64_t> keys;
+        const auto count = labelCube(cubeIndex, labels, parents, keys);
+        result.keys.assign(std::next(std::begin(keys)), std::end(keys));
+        result.voxels.assign(count, 0);
+        result.firstVoxel.assign(count, 0);
+        const auto * ids = cubes[cubeIndex].second;
+        const auto range = box(cubes[cubeIndex].first);
+        std::pair<std::uint32_t, std::uint64_t> last{0, 0};
+        for (int z = range.first[2]; z <= range.second[2]; ++z)
+        for (int y = range.first[1]; y <= range.second[1]; ++y)
+        for (int x = range.first[0]; x <= range.second[0]; ++x) {
+            const auto i = static_cast<std::uint32_t>(x + edge * (y + edge * z));
+            const auto label = labels[i];
+            if (label == 0) {
+                continue;
+            }
+            if (result.voxels[label - 1]++ == 0) {
+                result.firstVoxel[label - 1] = i;
+            }
+            const auto labelId = std::make_pair(label, ids[i]);
+            if (labelId != last) {
+                result.ids.emplace_back(labelId);
+                last = labelId;
+            }
+        }
+        std::sort(std::begin(result.ids), std::end(result.ids));
+        result.ids.erase(std::unique(std::begin(result.ids), std::end(result.ids)), std::end(result.ids));
+        // faces, the remaining axes run in increasing order with the first one fastest
+        const std::array<std::size_t, 3> strides{{1, edge, edge * edge}};
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+            const auto u = strides[axis == 0 ? 1 : 0];
+            const auto v = strides[axis == 2 ? 1 : 2];
+            for (const auto side : {0, 1}) {
+                auto & face = result.faces[axis + 3 * side];
+                face.resize(edge * edge);
+                const auto base = side * (edge - 1) * strides[axis];
+                for (std::size_t j = 0; j < edge; ++j)
+                for (std::size_t i = 0; i < edge; ++i) {
+                    face[i + edge * j] = labels[base + i * u + j * v];
+                }
+            }
+        }
+    });
+
+    std::size_t labelCount{0};
+    std::unordered_map<CoordOfCube, std::size_t> cubeIndices;
+    for (std::size_t i = 0; i < cubeLabels.size(); ++i) {
+        cubeLabels[i].offset = labelCount;
+        labelCount += cubeLabels[i].keys.size();
+        cubeIndices.emplace(cubes[i].first, i);
+    }
+    ConcurrentUnionFind unionFind(labelCount);
+    QtConcurrent::blockingMap(cubeLabels, [this, edge, &cubeIndices, &unionFind, first = cubeLabels.data()](const CubeLabels & cube){
+        const auto cubeCoord = cubes[static_cast<std::size_t>(&cube - first)].first;
+        for (std::size_t axis = 0; axis < 3; ++axis) {
+            const auto neighborIt = cubeIndices.find({cubeCoord.x + (axis == 0), cubeCoord.y + (axis == 1), cubeCoord.z + (axis == 2)});
+            if (neighborIt == std::end(cubeIndices)) {
+                continue;
+            }
+            const auto & neighbor = cubeLabels[neighborIt->second];
+            const auto & highFace = cube.faces[axis + 3];
+            const auto & lowFace = neighbor.faces[axis];
+            std::uint32_t lastLabel{0}, lastNeighborLabel{0};
+            for (std::size_t i = 0; i < edge * edge; ++i) {
+                const auto label = highFace[i];
+                const auto neighborLabel = lowFace[i];
+                if (label == 0 || neighborLabel == 0 || (label == lastLabel && neighborLabel == lastNeighborLabel)) {
+                    continue;
+                }
+                lastLabel = label;
+                lastNeighborLabel = neighborLabel;
+                if (cube.keys[label - 1] == neighbor.keys[neighborLabel - 1]) {
+                    unionFind.unite(static_cast<std::uint32_t>(cube.offset + label - 1), static_cast<std::uint32_t>(neighbor.offset + neighborLabel - 1));
+                }
+            }
+        }
+    });
+
+    components.clear();
+    componentOfLabel.assign(labelCount, noComponent);
+    std::vector<std::uint32_t> componentOfRoot(labelCount, noComponent);
+    for (std::size_t cubeIndex = 0; cubeIndex < cubeLabels.size(); ++cubeIndex) {
+        auto & cube = cubeLabels[cubeIndex];
+        for (std::size_t label = 0; label < cube.keys.size(); ++label) {
+            const auto root = unionFind.find(static_cast<std::uint32_t>(cube.offset + label));
+            if (componentOfRoot[root] == noComponent) {
+                componentOfRoot[root] = static_cast<std::uint32_t>(components.size());
+                components.emplace_back();
+                components.back().key = cube.keys[label];
+                const auto voxel = cube.firstVoxel[label];
+                const auto & cubeCoord = cubes[cubeIndex].first;
+                const Coordinate inCube{static_cast<int>(voxel % edge), static_cast<int>(voxel / edge % edge), static_cast<int>(voxel / edge / edge)};
+                components.back().location = (Coordinate{cubeCoord.x, cubeCoord.y, cubeCoord.z} * cubeEdge + inCube) * magnification;
+            }
+            componentOfLabel[cube.offset + label] = componentOfRoot[root];
+            components[componentOfRoot[root]].voxels += cube.voxels[label];
+        }
+        for (const auto & labelId : cube.ids) {
+            components[componentOfLabel[cube.offset + labelId.first - 1]].ids.emplace_back(labelId.second);
+        }
+        // only the offsets are needed for relabelling
+        cube.voxels = {};
+        cube.firstVoxel = {};
+        cube.ids = {};
+        cube.faces = {};
+    }
+    for (auto & component : components) {
+        std::sort(std::begin(component.ids), std::end(component.ids));
+        component.ids.erase(std::unique(std::begin(component.ids), std::end(component.ids)), std::end(component.ids));
+    }
+    return components;
+}
+
+CubeCoordSet ConnectedComponents::relabel(const std::function<std::uint64_t(std::size_t, std::uint64_t)> & newId) {
+    std::vector<char> changed(cubes.size(), false);
+    QtConcurrent::blockingMap(cubeLabels, [this, &newId, &changed, first = cubeLabels.data()](const CubeLabels & cube){
+        const auto cubeIndex = static_cast<std::size_t>(&cube - first);
+        std::vector<std::uint32_t> labels, parents;
+        std::vector<std::uint64_t> keys;
+        labelCube(cubeIndex, labels, parents, keys);
+        auto * ids = cubes[cubeIndex].second;
+        std::uint32_t lastLabel{0};
+        std::uint64_t lastId{0}, lastNewId{0};
+        for (std::size_t i = 0; i < labels.size(); ++i) {
+            const auto label = labels[i];
+            if (label == 0) {
+                continue;
+            }
+            if (label != lastLabel || ids[i] != lastId) {
+                lastLabel = label;
+                lastId = ids[i];
+                lastNewId = newId(componentOfLabel[cube.offset + label - 1], lastId);
+            }
+            if (lastNewId != lastId) {
+                ids[i] = lastNewId;
+                changed[cubeIndex] = true;
+            }
+        }
+    });
+    CubeCoordSet changedCubes;
+    for (std::size_t i = 0; i < cubes.size(); ++i) {
+        if (changed[i]) {
+            changedCubes.emplace(cubes[i].first);
+        }
+    }
+    return changedCubes;
+}
+
+std::vector<ConnectedComponents::BenchmarkResult> ConnectedComponents::benchmark(const std::vector<int> & cubesPerAxis, const int repetitions) {
+    const int edge = 64;
+    const int block = 8;
+    const auto cubeVoxels = static_cast<std::size_t>(edge) * edge * edge;
+    std::vector<BenchmarkResult> results;
+    for (const auto grid : cubesPerAxis) {
+        std::vector<std::vector<std::uint64_t>> data(grid * grid * grid, std::vector<std::uint64_t>(cubeVoxels));
+        Cubes cubes;
+        for (int z = 0; z < grid; ++z)
+        for (int y = 0; y < grid; ++y)
+        for (int x = 0; x < grid; ++x) {
+            auto & cube = data[x + grid * (y + grid * z)];
+            for (std::size_t i = 0; i < cubeVoxels; ++i) {
+                const std::size_t bx = (x * edge + i % edge) / block;
+                const std::size_t by = (y * edge + i / edge % edge) / block;
+                const std::size_t bz = (z * edge + i / edge / edge) / block;
+                cube[i] = 1 + ((bx + 1000 * (by + 1000 * bz)) * 0x9E3779B97F4A7C15ull >> 60);
+            }
+            cubes.emplace_back(CoordOfCube{x, y, z}, cube.data());
+        }
+        const Coordinate globalMax = Coordinate{1, 1, 1} * (grid * edge - 1);
+        const auto voxels = cubeVoxels * cubes.size();
+        const auto measure = [&](const QString & method, auto run){
+            std::size_t components{0};
+            QElapsedTimer timer;
+            timer.start();
+            for (int i{0}; i < repetitions; ++i) {
+                components = run();
+            }
+            results.push_back({grid, method, components, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions) / voxels});
+        };
+        measure("flood fill", [&](){
+            FloodFill fill([&data, grid](const CoordOfCube & coord) -> std::uint64_t * {
+                if (coord.x < 0 || coord.y < 0 || coord.z < 0 || coord.x >= grid || coord.y >= grid || coord.z >= grid) {
+                    return nullptr;
+                }
+                return data[coord.x + grid * (coord.y + grid * coord.z)].data();
+            }, edge, 1, {0, 0, 0}, globalMax);
+            std::size_t components{0};
+            for (const auto & cube : cubes) {
+                for (std::size_t i = 0; i < cubeVoxels; ++i) {
+                    const auto id = cube.second[i];
+                    const Coordinate seed{cube.first.x * edge + static_cast<int>(i % edge), cube.first.y * edge + static_cast<int>(i / edge % edge), cube.first.z * edge + static_cast<int>(i / edge / edge)};
+                    components += fill.fill(seed, [id](const std::uint64_t voxel){
+                        return voxel == id;
+                    }, [](std::uint64_t *, const std::size_t, const int, const Coordinate &){}) > 0;
+                }
+            }
+            return components;
+        });
+        measure("union-find", [&](){
+            ConnectedComponents labelling(cubes, edge, 1, {0, 0, 0}, globalMax);
+            return labelling.label([](const std::uint64_t id){
+                return id;
+            }).size();
+        });
+    }
+    return results;
+}
+
+namespace {
+// labels blobs of three ids crossing cube borders and fills every component from its location
+QVariantList checkConnectedComponents() {
+    const int edge = 32;
+    KernelBench::SyntheticCubes cubes(edge, 3);
+    cubes.forEach([](const Coordinate & pos, std::uint64_t & id){
+        const auto cell = KernelBench::mix(pos.x / 6 + 100 * (pos.y / 5 + 100 * (pos.z / 7)));
+        id = cell % 5 == 0 ? 0 : 1 + cell % 3;
+    });
+    const Coordinate min{3, 2, 1};// the labelled box doesn’t line up with the cubes
+    const Coordinate max{90, 93, 85};
+    std::size_t expectedVoxels{0};
+    cubes.forEach([&](const Coordinate & pos, const std::uint64_t id){
+        expectedVoxels += id != 0 && KernelBench::inside(pos, min, max);
+    });
+    ConnectedComponents labelling(cubes.all(), edge, 1, min, max);
+    const auto & components = labelling.label([](const std::uint64_t id){
+        return id;
+    });
+    const auto noVisit = [](std::uint64_t *, const std::size_t, const int, const Coordinate &){};
+    QVariantList results;
+    std::size_t failures{0};
+    std::size_t labelledVoxels{0};
+    FloodFill fill(cubes.lookup(), edge, 1, min, max);
+    for (const auto & component : components) {
+        const auto key = component.key;
+        failures += fill.fill(component.location, [key](const std::uint64_t id){
+            return id == key;
+        }, noVisit) != component.voxels;
+        labelledVoxels += component.voxels;
+    }
+    results.append(KernelBench::checkResult("connected components", "components vs flood fill", failures == 0
+                                            , QString("%1 of %2 components differ from the flood fill at their location").arg(failures).arg(components.size())));
+    results.append(KernelBench::checkResult("connected components", "labelled voxels", labelledVoxels == expectedVoxels
+                                            , QString("%1 voxels labelled, %2 expected").arg(labelledVoxels).arg(expectedVoxels)));
+
+    const std::uint64_t relabelled = 1000;
+    labelling.relabel([relabelled](const std::size_t component, const std::uint64_t){
+        return relabelled + component;
+    });
+    failures = 0;
+    FloodFill refill(cubes.lookup(), edge, 1, min, max);
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        failures += refill.fill(components[i].location, [id = relabelled + i](const std::uint64_t voxel){
+            return voxel == id;
+        }, noVisit) != components[i].voxels;
+    }
+    results.append(KernelBench::checkResult("connected components", "relabel vs flood fill", failures == 0
+                                            , QString("%1 of %2 relabelled components differ from the flood fill at their location").arg(failures).arg(components.size())));
+    return results;
+}
+
+const KernelBench::Registration registration{"connected components", 3, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : ConnectedComponents::benchmark({2, 4}, repetitions)) {
+        results.append(QVariantMap{{"cubes_per_axis", result.cubes}
+            , {"method", result.method}
+            , {"components", static_cast<qulonglong>(result.components)}
+            , {"ns_per_voxel", result.nsPerVoxel}});
+    }
+    return results;
+}, checkConnectedComponents};
+}
@@ -0,0 +1,108 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef CONNECTEDCOMPONENTS_H
+#define CONNECTEDCOMPONENTS_H
+
+#include "coordinate.h"
+#include "cubeloader.h"
+#include "hashtable.h"
+
+#include <QString>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief ConnectedComponents labels the 6-connected components of a set of loaded segmentation cubes.
+ *
+ * Every cube is labelled on its own in parallel (two pass union-find over provisional labels),
+ * only the labels on the cube faces are kept. The per cube labels are then joined across the faces
+ * of adjacent cubes with a lock-free union-find, again in parallel.
+ * Relabelling repeats the (deterministic) cube pass instead of storing a label per voxel.
+ */
+class ConnectedComponents {
+public:
+    using Cubes = std::vector<std::pair<CoordOfCube, std::uint64_t *>>;
+    using Key = std::function<std::uint64_t(std::uint64_t)>;// voxels with equal non-zero keys connect, 0 excludes the voxel
+
+    struct Component {
+        std::uint64_t key;
+        std::size_t voxels{0};
+        Coordinate location;// global coordinate of one of its voxels
+        std::vector<std::uint64_t> ids;// sorted
+    };
+
+    // only voxels inside [globalMin, globalMax] (inclusive) are labelled
+    ConnectedComponents(Cubes cubes, const int cubeEdgeLength, const int magnification, const Coordinate & globalMin, const Coordinate & globalMax);
+    // loaded overlay cubes of the current magnification, limited to the movement area,
+    // they stay pinned until unpin or the destruction of the labelling
+    static ConnectedComponents overlay();
+    // lets the loader reuse the slots again, call it before marking the cubes as changed, the cubes are gone afterwards
+    void unpin();
+
+    // key has to be safe to call concurrently
+    const std::vector<Component> & label(Key key);
+    // writes newId(component, id) into every labelled voxel (in parallel), returns the changed cubes
+    CubeCoordSet relabel(const std::function<std::uint64_t(std::size_t, std::uint64_t)> & newId);
+
+    struct BenchmarkResult {
+        int cubes;// per axis
+        QString method;// "flood fill" for one scanline fill per component, "union-find"
+        std::size_t components;
+        double nsPerVoxel;
+    };
+    // labels a synthetic grid of 64³ cubes filled with 8³ blocks of 16 distinct ids
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & cubesPerAxis, const int repetitions);
+private:
+    using Voxel = std::array<int, 3>;
+    struct CubeLabels {
+        std::size_t offset;// of label 1 in the global labels
+        std::vector<std::uint64_t> keys;// per label, label 1 at index 0
+        std::vector<std::size_t> voxels;
+        std::vector<std::uint32_t> firstVoxel;// index inside the cube
+        std::vector<std::pair<std::uint32_t, std::uint64_t>> ids;// distinct (label, id)
+        std::array<std::vector<std::uint32_t>, 6> faces;// labels on the low x, y, z and the high x, y, z faces
+    };
+
+    std::unique_ptr<CubeHash::Pin> pin;
+    Cubes cubes;
+    int cubeEdge;
+    int magnification;
+    Voxel min;
+    Voxel max;
+    Key key;
+    std::vector<CubeLabels> cubeLabels;
+    std::vector<std::uint32_t> componentOfLabel;
+    std::vector<Component> components;
+
+    std::pair<Voxel, Voxel> box(const CoordOfCube & cubeCoord) const;// voxels of the cube inside [min, max], relative to the cube
+    std::uint32_t labelCube(const std::size_t cubeIndex, std::vector<std::uint32_t> & labels, std::vector<std::uint32_t> & parents, std::vector<std::uint64_t> & labelKeys) const;
+};
+
+#endif//CONNECTEDCOMPONENTS_H
@@ -22,27 +22,41 @@
 
 #include "cubeloader.h"
 
+#include "brushrasterizer.h"
+#include "kernelbench.h"
 #include "loader.h"
-#include "session.h"
 #include "segmentation.h"
 #include "segmentationsplit.h"
+#include "session.h"
 #include "stateInfo.h"
 
+#include <QElapsedTimer>
+
 #include <boost/multi_array.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+
 std::pair<bool, void *> getRawCube(const Coordinate & pos) {
     if (!Segmentation::singleton().enabled) {
         return {false, nullptr};
     }
     const auto posDc = pos.cube(Dataset::current().cubeEdgeLength, Dataset::current().magnification);
 
-    state->protectCube2Pointer.lock();
     auto * rawcube = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[Segmentation::singleton().layerId][int_log(Dataset::current().magnification)], posDc);
-    state->protectCube2Pointer.unlock();
 
     return std::make_pair(rawcube != nullptr, rawcube);
 }
 
+std::unique_ptr<CubeHash::Pin> pinOverlay() {
+    if (!Segmentation::singleton().enabled) {
+        return nullptr;
+    }
+    return std::unique_ptr<CubeHash::Pin>(new CubeHash::Pin(state->cube2Pointer[Segmentation::singleton().layerId][int_log(Dataset::current().magnification)]));
+}
+
 boost::multi_array_ref<uint64_t, 3> getCubeRef(void * const rawcube) {
     const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
     const auto dims = boost::extents[cubeEdgeLen][cubeEdgeLen][cubeEdgeLen];
@@ -50,6 +64,7 @@ boost::multi_array_ref<uint64_t, 3> getCubeRef(void * const rawcube) {
 }
 
 uint64_t readVoxel(const Coordinate & pos) {
+    const auto pin = pinOverlay();
     auto cubeIt = getRawCube(pos);
     if (Session::singleton().outsideMovementArea(pos) || !cubeIt.first) {
         return Segmentation::singleton().getBackgroundId();
@@ -59,12 +74,14 @@ uint64_t readVoxel(const Coordinate & pos) {
 }
 
 bool writeVoxel(const Coordinate & pos, const uint64_t value, bool isMarkChanged) {
+    auto pin = pinOverlay();
     auto cubeIt = getRawCube(pos);
     if (Session::singleton().outsideMovementArea(pos) || !cubeIt.first) {
         return false;
     }
     const auto inCube = pos.insideCube(Dataset::current().cubeEdgeLength, Dataset::current().magnification);
     getCubeRef(cubeIt.second)[inCube.z][inCube.y][inCube.x] = value;
+    pin.reset();// before blocking on the loader
     if (isMarkChanged) {
         Loader::Controller::singleton().markOcCubeAsModified(pos.cube(Dataset::current().cubeEdgeLength, Dataset::current().magnification), Dataset::current().magnification);
     }
@@ -101,51 +118,22 @@ std::pair<Coordinate, Coordinate> getRegion(const floatCoordinate & centerPos, c
 }
 
 void coordCubesMarkChanged(const CubeCoordSet & cubeChangeSet) {
-    for (auto &cubeCoord : cubeChangeSet) {
-        Loader::Controller::singleton().markOcCubeAsModified(cubeCoord, Dataset::current().magnification);
+    if (!cubeChangeSet.empty()) {
+        Loader::Controller::singleton().markOcCubesAsModified({std::begin(cubeChangeSet), std::end(cubeChangeSet)}, Dataset::current().magnification);
     }
 }
 
-auto wholeCubes = [](const Coordinate & globalFirst, const Coordinate & globalLast, const uint64_t value, CubeCoordSet & cubeChangeSet) {
-    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
-    const auto wholeCubeBegin = (globalFirst + cubeEdgeLen - 1).cube(cubeEdgeLen, Dataset::current().magnification);
-    const auto wholeCubeEnd = globalLast.cube(cubeEdgeLen, Dataset::current().magnification);
-
-    //fill all whole cubes
-    for (int z = wholeCubeBegin.z; z < wholeCubeEnd.z; ++z)
-    for (int y = wholeCubeBegin.y; y < wholeCubeEnd.y; ++y)
-    for (int x = wholeCubeBegin.x; x < wholeCubeEnd.x; ++x) {
-        const auto cubeCoord = CoordOfCube(x, y, z);
-        const auto globalCoord = cubeCoord.cube2Global(cubeEdgeLen, Dataset::current().magnification);
-        auto rawcube = getRawCube(globalCoord);
-        if (rawcube.first) {
-            auto cubeRef = getCubeRef(rawcube.second);
-            std::fill(cubeRef.data(), cubeRef.data() + cubeRef.num_elements(), value);
-            cubeChangeSet.emplace(cubeCoord);
-        } else {
-            qCritical() << x << y << z << "cube missing for (complete) writeVoxels";
-        }
-    }
-    //returns the skip function for the region traversal
-    return [wholeCubeBegin, wholeCubeEnd](int & x, int y, int z){
-        if (x == wholeCubeBegin.x && y >= wholeCubeBegin.y && y < wholeCubeEnd.y && z >= wholeCubeBegin.z && z < wholeCubeEnd.z) {
-            x = wholeCubeEnd.x;
-        }
-    };
-};
-
-template<typename Func, typename Skip>
-CubeCoordSet processRegion(const Coordinate & globalFirst, const Coordinate &  globalLast, Func func, Skip skip) {
+template<typename Func>
+CubeCoordSet processRegion(const Coordinate & globalFirst, const Coordinate &  globalLast, Func func) {
     const auto & cubeEdgeLen = Dataset::current().cubeEdgeLength;
     const auto cubeBegin = globalFirst.cube(cubeEdgeLen, Dataset::current().magnification);
     const auto cubeEnd = globalLast.cube(cubeEdgeLen, Dataset::current().magnification) + 1;
     CubeCoordSet cubeCoords;
+    const auto pin = pinOverlay();
 
-    //traverse all remaining cubes
     for (int z = cubeBegin.z; z < cubeEnd.z; ++z)
     for (int y = cubeBegin.y; y < cubeEnd.y; ++y)
     for (int x = cubeBegin.x; x < cubeEnd.x; ++x) {
-        skip(x, y, z);//skip cubes which got processed before
         const auto cubeCoord = CoordOfCube(x, y, z);
         const auto globalCubeBegin = cubeCoord.cube2Global(cubeEdgeLen, Dataset::current().magnification);
         auto rawcube = getRawCube(globalCubeBegin);
@@ -169,9 +157,81 @@ CubeCoordSet processRegion(const Coordinate & globalFirst, const Coordinate &  g
     return cubeCoords;
 }
 
-template<typename Func>//wrapper without Skip
-CubeCoordSet processRegion(const Coordinate & globalFirst, const Coordinate &  globalLast, Func func) {
-    return processRegion(globalFirst, globalLast, func, [](int &, int, int){});
+namespace {
+uint64_t * overlayCube(const CoordOfCube & cubeCoord) {
+    return static_cast<uint64_t *>(getRawCube(cubeCoord.cube2Global(Dataset::current().cubeEdgeLength, Dataset::current().magnification)).second);
+}
+
+/**
+ * Hands the x-runs of the region to func(run, length, globalRunStart), split at cube borders.
+ * The voxels of a run are contiguous in the cube, so kernels can use memcpy/fill instead of per voxel callbacks.
+ */
+template<typename Lookup, typename RunFunc>
+CubeCoordSet processRegionRuns(const Coordinate & globalFirst, const Coordinate & globalLast, const int cubeEdgeLen, const int mag, Lookup lookup, RunFunc func) {
+    const auto cubeBegin = globalFirst.cube(cubeEdgeLen, mag);
+    const auto cubeEnd = globalLast.cube(cubeEdgeLen, mag) + 1;
+    CubeCoordSet cubeCoords;
+    for (int z = cubeBegin.z; z < cubeEnd.z; ++z)
+    for (int y = cubeBegin.y; y < cubeEnd.y; ++y)
+    for (int x = cubeBegin.x; x < cubeEnd.x; ++x) {
+        const auto cubeCoord = CoordOfCube(x, y, z);
+        auto * cube = lookup(cubeCoord);
+        if (cube == nullptr) {
+            qCritical() << x << y << z << "cube missing for region access";
+            continue;
+        }
+        const auto globalCubeBegin = cubeCoord.cube2Global(cubeEdgeLen, mag);
+        const auto globalCubeEnd = globalCubeBegin + cubeEdgeLen * mag - 1;
+        const auto localStart = globalFirst.capped(globalCubeBegin, globalCubeEnd).insideCube(cubeEdgeLen, mag);
+        const auto localEnd = globalLast.capped(globalCubeBegin, globalCubeEnd).insideCube(cubeEdgeLen, mag);
+        const auto length = localEnd.x - localStart.x + 1;
+        for (int z = localStart.z; z <= localEnd.z; ++z)
+        for (int y = localStart.y; y <= localEnd.y; ++y) {
+            const Coordinate globalRunStart{globalCubeBegin.x + localStart.x * mag, globalCubeBegin.y + y * mag, globalCubeBegin.z + z * mag};
+            func(cube + localStart.x + cubeEdgeLen * (y + static_cast<std::size_t>(cubeEdgeLen) * z), length, globalRunStart);
+        }
+        cubeCoords.emplace(cubeCoord);
+    }
+    return cubeCoords;
+}
+
+// buffer offsets are counted in global coordinates like the region
+std::ptrdiff_t bufferOffset(const Coordinate & delta, const Coordinate & strides) {
+    return static_cast<std::ptrdiff_t>(delta.x) * strides.x + static_cast<std::ptrdiff_t>(delta.y) * strides.y + static_cast<std::ptrdiff_t>(delta.z) * strides.z;
+}
+
+void copyFromBuffer(uint64_t * run, const char * buffer, const std::ptrdiff_t stride, const int length) {
+    if (stride == sizeof(uint64_t)) {
+        std::memcpy(run, buffer, length * sizeof(uint64_t));
+    } else {
+        for (int i = 0; i < length; ++i) {
+            std::memcpy(run + i, buffer + i * stride, sizeof(uint64_t));
+        }
+    }
+}
+
+void copyToBuffer(char * buffer, const uint64_t * run, const std::ptrdiff_t stride, const int length) {
+    if (stride == sizeof(uint64_t)) {
+        std::memcpy(buffer, run, length * sizeof(uint64_t));
+    } else {
+        for (int i = 0; i < length; ++i) {
+            std::memcpy(buffer + i * stride, run + i, sizeof(uint64_t));
+        }
+    }
+}
+
+template<typename Lookup>
+CubeCoordSet stridedBufRegion(const Coordinate & globalFirst, const Coordinate & globalLast, const int cubeEdgeLen, const int mag, Lookup lookup, char * data, const Coordinate & strides, const bool isWrite) {
+    const auto xStride = static_cast<std::ptrdiff_t>(strides.x) * mag;
+    if (isWrite) {
+        return processRegionRuns(globalFirst, globalLast, cubeEdgeLen, mag, lookup, [globalFirst, data, strides, xStride](uint64_t * run, const int length, const Coordinate & globalRunStart){
+            copyFromBuffer(run, data + bufferOffset(globalRunStart - globalFirst, strides), xStride, length);
+        });
+    }
+    return processRegionRuns(globalFirst, globalLast, cubeEdgeLen, mag, lookup, [globalFirst, data, strides, xStride](uint64_t * run, const int length, const Coordinate & globalRunStart){
+        copyToBuffer(data + bufferOffset(globalRunStart - globalFirst, strides), run, xStride, length);
+    });
+}
 }
 
 subobjectRetrievalMap readVoxels(const Coordinate & centerPos, const brush_t &brush) {
@@ -186,82 +246,210 @@ subobjectRetrievalMap readVoxels(const Coordinate & centerPos, const brush_t &br
 }
 
 void writeVoxels(const Coordinate & centerPos, const uint64_t value, const brush_t & brush, bool isMarkChanged) {
-    //all the different invocations here are listed explicitly so the compiler can inline the fuck out of it
-    //the brush differentiations were moved outside the core lambda which is called for every voxel
     CubeCoordSet cubeChangeSet;
-    CubeCoordSet cubeChangeSetWholeCube;
     if (Session::singleton().annotationMode.testFlag(AnnotationMode::Mode_Paint)) {
-        const auto region = getRegion(centerPos, brush);
-        if (brush.shape == brush_t::shape_t::angular) {
-            if (!brush.inverse || Segmentation::singleton().selectedObjectsCount() == 0) {
-                //for rectangular brushes no further range checks are needed
-                if (brush.mode == brush_t::mode_t::three_dim && brush.shape == brush_t::shape_t::angular) {
-                    //rarest special case: processes completely exclosed cubes first
-                    cubeChangeSet = processRegion(region.first, region.second, [value](uint64_t & voxel, Coordinate){
-                        voxel = value;
-                    }, wholeCubes(region.first, region.second, value, cubeChangeSetWholeCube));
-                } else {
-                    cubeChangeSet = processRegion(region.first, region.second, [value](uint64_t & voxel, Coordinate){
-                        voxel = value;
-                    });
-                }
-            } else {//inverse but selected
-                cubeChangeSet = processRegion(region.first, region.second, [](uint64_t & voxel, Coordinate){
-                    if (Segmentation::singleton().isSubObjectIdSelected(voxel)) {//if there’re selected objects, we only want to erase these
-                        voxel = 0;
-                    }
-                });
-            }
-        } else if (!brush.inverse || Segmentation::singleton().selectedObjectsCount() == 0) {
-            //voxel need to check if they are inside the circle
-            cubeChangeSet = processRegion(region.first, region.second, [&brush, centerPos, value](uint64_t & voxel, Coordinate globalPos){
-                if (isInsideSphere(globalPos.x - centerPos.x, globalPos.y - centerPos.y, globalPos.z - centerPos.z, brush.radius)) {
-                    voxel = value;
-                }
+        const auto rasterizer = BrushRasterizer::overlay(centerPos, brush);
+        auto & seg = Segmentation::singleton();
+        if (!brush.inverse || seg.selectedObjectsCount() == 0) {
+            cubeChangeSet = rasterizer.rasterize([value](uint64_t * ids, const int count){
+                std::fill_n(ids, count, value);
             });
-        } else {//circle, inverse and selected
-            cubeChangeSet = processRegion(region.first, region.second, [&brush, centerPos](uint64_t & voxel, Coordinate globalPos){
-                if (isInsideSphere(globalPos.x - centerPos.x, globalPos.y - centerPos.y, globalPos.z - centerPos.z, brush.radius)
-                        && Segmentation::singleton().isSubObjectIdSelected(voxel)) {
-                    voxel = 0;
+        } else {//inverse but selected: only erase the selected objects, runs of one id share the lookup
+            cubeChangeSet = rasterizer.rasterize([&seg, lastId = uint64_t{0}, lastSelected = seg.isSubObjectIdSelected(0)](uint64_t * ids, const int count) mutable {
+                for (int i = 0; i < count; ++i) {
+                    if (ids[i] != lastId) {
+                        lastId = ids[i];
+                        lastSelected = seg.isSubObjectIdSelected(lastId);
+                    }
+                    if (lastSelected) {
+                        ids[i] = 0;
+                    }
                 }
             });
         }
     }
     if (isMarkChanged) {
-        for (auto &elem : cubeChangeSetWholeCube) {
-            cubeChangeSet.emplace(elem);
-        }
         coordCubesMarkChanged(cubeChangeSet);
     }
 }
 
 CubeCoordSet processRegionByStridedBuf(const Coordinate & globalFirst, const Coordinate &  globalLast, char * data, const Coordinate & strides, bool isWrite, bool markChanged) {
-    CubeCoordSet cubeChangeSet;
-    if (isWrite) {
-        cubeChangeSet = processRegion(globalFirst, globalLast,
-                [globalFirst,data,strides](uint64_t & voxel, Coordinate globalPos){
-                voxel = reinterpret_cast<const uint64_t &>(data[(globalPos - globalFirst).componentMul(strides).sum()]);
-            });
-        if (markChanged) {
-            coordCubesMarkChanged(cubeChangeSet);
-        }
+    auto pin = pinOverlay();
+    auto cubeChangeSet = stridedBufRegion(globalFirst, globalLast, Dataset::current().cubeEdgeLength, Dataset::current().magnification, overlayCube, data, strides, isWrite);
+    pin.reset();
+    if (isWrite && markChanged) {
+        coordCubesMarkChanged(cubeChangeSet);
     }
-    else {
-        cubeChangeSet = processRegion(globalFirst, globalLast,
-                [globalFirst,data,strides](uint64_t & voxel, Coordinate globalPos){
-                reinterpret_cast<uint64_t &>(data[(globalPos - globalFirst).componentMul(strides).sum()]) = voxel;
-            });
+    return cubeChangeSet;
+}
+
+CubeCoordSet processRegionByStridedBuf(const Coordinate & globalFirst, const Coordinate &  globalLast, const int cubeEdgeLen, const int mag, const std::function<uint64_t *(const CoordOfCube &)> & lookup, char * data, const Coordinate & strides, bool isWrite) {
+    return stridedBufRegion(globalFirst, globalLast, cubeEdgeLen, mag, lookup, data, strides, isWrite);
+}
+
+CubeCoordSet fillRegion(const Coordinate & globalFirst, const Coordinate & globalLast, const uint64_t value, bool markChanged) {
+    auto pin = pinOverlay();
+    auto cubeChangeSet = processRegionRuns(globalFirst, globalLast, Dataset::current().cubeEdgeLength, Dataset::current().magnification, overlayCube, [value](uint64_t * run, const int length, const Coordinate &){
+        std::fill_n(run, length, value);
+    });
+    pin.reset();
+    if (markChanged) {
+        coordCubesMarkChanged(cubeChangeSet);
     }
     return cubeChangeSet;
 }
 
-void listFill(const Coordinate & centerPos, const brush_t & brush, const uint64_t fillsoid, const std::unordered_set<Coordinate> & voxels) {
-    const auto region = getRegion(centerPos, brush);
-    auto cubeChangeSet = processRegion(region.first, region.second, [fillsoid, &voxels](uint64_t & voxel, Coordinate globalPos){
-        if (voxels.find(globalPos) != std::end(voxels)) {
-            voxel = fillsoid;
+namespace {
+// the per voxel traversal processRegionByStridedBuf used before
+template<typename Lookup, typename Func>
+void referenceRegion(const Coordinate & globalFirst, const Coordinate & globalLast, const int cubeEdgeLen, Lookup lookup, Func func) {
+    const auto cubeBegin = globalFirst.cube(cubeEdgeLen, 1);
+    const auto cubeEnd = globalLast.cube(cubeEdgeLen, 1) + 1;
+    for (int z = cubeBegin.z; z < cubeEnd.z; ++z)
+    for (int y = cubeBegin.y; y < cubeEnd.y; ++y)
+    for (int x = cubeBegin.x; x < cubeEnd.x; ++x) {
+        const auto cubeCoord = CoordOfCube(x, y, z);
+        boost::multi_array_ref<uint64_t, 3> cubeRef(lookup(cubeCoord), boost::extents[cubeEdgeLen][cubeEdgeLen][cubeEdgeLen]);
+        const auto globalCubeBegin = cubeCoord.cube2Global(cubeEdgeLen, 1);
+        const auto globalCubeEnd = globalCubeBegin + cubeEdgeLen - 1;
+        const auto localStart = globalFirst.capped(globalCubeBegin, globalCubeEnd).insideCube(cubeEdgeLen, 1);
+        const auto localEnd = globalLast.capped(globalCubeBegin, globalCubeEnd).insideCube(cubeEdgeLen, 1);
+        for (int z = localStart.z; z <= localEnd.z; ++z)
+        for (int y = localStart.y; y <= localEnd.y; ++y)
+        for (int x = localStart.x; x <= localEnd.x; ++x) {
+            func(cubeRef[z][y][x], Coordinate{globalCubeBegin.x + x, globalCubeBegin.y + y, globalCubeBegin.z + z});
+        }
+    }
+}
+}
+
+std::vector<RegionAccessBenchmarkResult> benchmarkRegionAccess(const std::vector<int> & sizes, const int repetitions) {
+    const int edge = 64;
+    const int grid = 4;
+    const auto cubeVoxels = static_cast<std::size_t>(edge) * edge * edge;
+    std::vector<std::vector<uint64_t>> cubes(grid * grid * grid, std::vector<uint64_t>(cubeVoxels));
+    for (std::size_t i = 0; i < cubes.size(); ++i) {
+        std::iota(std::begin(cubes[i]), std::end(cubes[i]), i * cubeVoxels);
+    }
+    const auto lookup = [&cubes, grid](const CoordOfCube & coord) -> uint64_t * {
+        if (coord.x < 0 || coord.y < 0 || coord.z < 0 || coord.x >= grid || coord.y >= grid || coord.z >= grid) {
+            return nullptr;
         }
+        return cubes[coord.x + grid * (coord.y + grid * coord.z)].data();
+    };
+    std::vector<RegionAccessBenchmarkResult> results;
+    for (const auto size : sizes) {
+        const auto clamped = std::min(size, grid * edge - 2);
+        const Coordinate first{1, 1, 1};// not cube aligned
+        const auto last = first + clamped - 1;
+        const auto voxels = static_cast<std::size_t>(clamped) * clamped * clamped;
+        std::vector<uint64_t> buffer(voxels);
+        auto * data = reinterpret_cast<char *>(buffer.data());
+        const auto element = static_cast<int>(sizeof(uint64_t));
+        const Coordinate xFastest{element, element * clamped, element * clamped * clamped};// Fortran order or a (z, y, x) shape
+        const Coordinate xSlowest{element * clamped * clamped, element * clamped, element};// C order (x, y, z) shape
+        const auto measure = [&](const QString & method, const QString & operation, auto run){
+            QElapsedTimer timer;
+            timer.start();
+            for (int i{0}; i < repetitions; ++i) {
+                run();
+            }
+            results.push_back({clamped, method, operation, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions) / voxels});
+        };
+        for (const auto & layout : {std::make_pair(QString{"x fastest"}, xFastest), std::make_pair(QString{"x slowest"}, xSlowest)}) {
+            const auto strides = layout.second;
+            measure("per voxel", "read " + layout.first, [&](){
+                referenceRegion(first, last, edge, lookup, [first, data, strides](uint64_t & voxel, const Coordinate & globalPos){
+                    reinterpret_cast<uint64_t &>(data[(globalPos - first).componentMul(strides).sum()]) = voxel;
+                });
+            });
+            measure("runs", "read " + layout.first, [&](){
+                stridedBufRegion(first, last, edge, 1, lookup, data, strides, false);
+            });
+            measure("per voxel", "write " + layout.first, [&](){
+                referenceRegion(first, last, edge, lookup, [first, data, strides](uint64_t & voxel, const Coordinate & globalPos){
+                    voxel = reinterpret_cast<const uint64_t &>(data[(globalPos - first).componentMul(strides).sum()]);
+                });
+            });
+            measure("runs", "write " + layout.first, [&](){
+                stridedBufRegion(first, last, edge, 1, lookup, data, strides, true);
+            });
+        }
+        measure("per voxel", "fill", [&](){
+            referenceRegion(first, last, edge, lookup, [](uint64_t & voxel, const Coordinate &){
+                voxel = 42;
+            });
+        });
+        measure("runs", "fill", [&](){
+            processRegionRuns(first, last, edge, 1, lookup, [](uint64_t * run, const int length, const Coordinate &){
+                std::fill_n(run, length, 42);
+            });
+        });
+    }
+    return results;
+}
+
+namespace {
+// writes a pattern into a region crossing cube borders through an x fastest buffer and reads it back through an x slowest one
+QVariantList checkRegionAccess() {
+    const int edge = 32;
+    KernelBench::SyntheticCubes cubes(edge, 3);
+    const auto original = [](const Coordinate & pos){
+        return KernelBench::mix(pos.x + 1000 * (pos.y + 1000 * pos.z));
+    };
+    const auto pattern = [&original](const Coordinate & pos){
+        return ~original(pos);
+    };
+    cubes.forEach([&original](const Coordinate & pos, std::uint64_t & id){
+        id = original(pos);
     });
-    coordCubesMarkChanged(cubeChangeSet);
+    const Coordinate first{5, 30, 17};
+    const Coordinate last{70, 37, 80};
+    const auto size = last - first + 1;
+    const auto voxels = static_cast<std::size_t>(size.x) * size.y * size.z;
+    const int element = sizeof(std::uint64_t);
+    const Coordinate xFastest{element, element * size.x, element * size.x * size.y};
+    const Coordinate xSlowest{element * size.z * size.y, element * size.z, element};
+    std::vector<std::uint64_t> buffer(voxels);
+    auto * data = reinterpret_cast<char *>(buffer.data());
+    for (int z = first.z; z <= last.z; ++z)
+    for (int y = first.y; y <= last.y; ++y)
+    for (int x = first.x; x <= last.x; ++x) {
+        const auto value = pattern({x, y, z});
+        std::memcpy(data + (Coordinate{x, y, z} - first).componentMul(xFastest).sum(), &value, sizeof(value));
+    }
+    QVariantList results;
+    processRegionByStridedBuf(first, last, edge, 1, cubes.lookup(), data, xFastest, true);
+    std::size_t failures{0};
+    std::size_t total{0};
+    cubes.forEach([&](const Coordinate & pos, const std::uint64_t id){
+        failures += id != (KernelBench::inside(pos, first, last) ? pattern(pos) : original(pos));
+        ++total;
+    });
+    results.append(KernelBench::voxelCheckResult("region access", "strided write", failures, total));
+
+    std::fill(std::begin(buffer), std::end(buffer), 0);
+    processRegionByStridedBuf(first, last, edge, 1, cubes.lookup(), data, xSlowest, false);
+    failures = 0;
+    for (int z = first.z; z <= last.z; ++z)
+    for (int y = first.y; y <= last.y; ++y)
+    for (int x = first.x; x <= last.x; ++x) {
+        std::uint64_t value;
+        std::memcpy(&value, data + (Coordinate{x, y, z} - first).componentMul(xSlowest).sum(), sizeof(value));
+        failures += value != pattern({x, y, z});
+    }
+    results.append(KernelBench::voxelCheckResult("region access", "strided read", failures, voxels));
+    return results;
+}
+
+const KernelBench::Registration registration{"region access", 5, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : benchmarkRegionAccess({32, 128, 250}, repetitions)) {
+        results.append(QVariantMap{{"size", result.size}
+            , {"method", result.method}
+            , {"operation", result.operation}
+            , {"ns_per_voxel", result.nsPerVoxel}});
+    }
+    return results;
+}, checkRegionAccess};
 }
@@ -24,23 +24,46 @@
 #define CUBELOADER_H
 
 #include "coordinate.h"
+#include "hashtable.h"
+
+#include <QString>
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <unordered_set>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 class brush_t;
 using CubeCoordSet = std::unordered_set<CoordOfCube>;
 using subobjectRetrievalMap = std::unordered_map<uint64_t, Coordinate>;
 
+std::pair<Coordinate, Coordinate> getRegion(const floatCoordinate & centerPos, const brush_t & brush);// global AABB of the brush
 bool isInsideSphere(const double xi, const double yi, const double zi, const double radius);
 
 void coordCubesMarkChanged(const CubeCoordSet & cubeChangeSet);
+std::pair<bool, void *> getRawCube(const Coordinate & pos);// loaded overlay cube containing pos
+// keeps the overlay slots of the current magnification from being reused (see CubeHash::Pin), nullptr if the segmentation is disabled
+std::unique_ptr<CubeHash::Pin> pinOverlay();
 uint64_t readVoxel(const Coordinate & pos);
 subobjectRetrievalMap readVoxels(const Coordinate & centerPos, const brush_t &);
 bool writeVoxel(const Coordinate & pos, const uint64_t value, bool isMarkChanged = true);
 void writeVoxels(const Coordinate & centerPos, const uint64_t value, const brush_t &, bool isMarkChanged = true);
+// copies between the overlay and a buffer with byte strides (counted in global coordinates), contiguous x-runs are memcpy’d
 CubeCoordSet processRegionByStridedBuf(const Coordinate & globalFirst, const Coordinate &  globalLast, char * data, const Coordinate & strides, bool isWrite, bool markChanged);
-void listFill(const Coordinate & centerPos, const brush_t & brush, const uint64_t fillsoid, const std::unordered_set<Coordinate> & voxels);
+// the same on the cubes of lookup (nullptr if a cube isn’t loaded) instead of the overlay, nothing is marked changed
+CubeCoordSet processRegionByStridedBuf(const Coordinate & globalFirst, const Coordinate &  globalLast, const int cubeEdgeLen, const int mag, const std::function<uint64_t *(const CoordOfCube &)> & lookup, char * data, const Coordinate & strides, bool isWrite);
+CubeCoordSet fillRegion(const Coordinate & globalFirst, const Coordinate & globalLast, const uint64_t value, bool markChanged = true);
+
+struct RegionAccessBenchmarkResult {
+    int size;// edge length of the region
+    QString method;// "per voxel" callbacks like before or "runs"
+    QString operation;// "read", "write" (both for x fastest and x slowest buffers) or "fill"
+    double nsPerVoxel;
+};
+// accesses regions of a synthetic grid of 64³ cubes
+std::vector<RegionAccessBenchmarkResult> benchmarkRegionAccess(const std::vector<int> & sizes, const int repetitions);
 
 #endif//CUBELOADER_H
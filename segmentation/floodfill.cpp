@@ -0,0 +1,200 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+#include "floodfill.h"
+
+#include "cubeloader.h"
+#include "dataset.h"
+#include "hashtable.h"
+#include "kernelbench.h"
+#include "segmentation.h"
+#include "session.h"
+#include "stateInfo.h"
+
+#include <QElapsedTimer>
+
+#include <unordered_set>
+#include <utility>
+
+FloodFill::FloodFill(CubeLookup lookup, const int cubeEdgeLength, const int magnification, const Coordinate & globalMin, const Coordinate & globalMax, const int axes)
+        : lookup{std::move(lookup)}, cubeEdge{cubeEdgeLength}, magnification{magnification}
+        , min{{globalMin.x / magnification, globalMin.y / magnification, globalMin.z / magnification}}
+        , max{{globalMax.x / magnification, globalMax.y / magnification, globalMax.z / magnification}} {
+    scanAxis = -1;
+    for (int axis = 0; axis < 3; ++axis) {
+        if ((axes & (1 << axis)) != 0) {
+            if (scanAxis == -1) {
+                scanAxis = axis;
+            } else {
+                rowAxes.emplace_back(axis);
+            }
+        }
+    }
+    scanAxis = std::max(0, scanAxis);// spans need an axis
+    scanStride = scanAxis == 0 ? 1 : scanAxis == 1 ? cubeEdge : static_cast<std::size_t>(cubeEdge) * cubeEdge;
+}
+
+FloodFill FloodFill::overlay(const Coordinate & globalMin, const Coordinate & globalMax, const int axes) {
+    const auto magnification = Dataset::current().magnification;
+    const auto lookup = [magnification](const CoordOfCube & cubeCoord) -> std::uint64_t * {
+        if (!Segmentation::singleton().enabled) {
+            return nullptr;
+        }
+        auto & cubes = state->cube2Pointer[Segmentation::singleton().layerId][int_log(magnification)];
+        return reinterpret_cast<std::uint64_t *>(Coordinate2BytePtr_hash_get_or_fail(cubes, cubeCoord));
+    };
+    const auto & session = Session::singleton();
+    const Coordinate min{std::max(globalMin.x, session.movementAreaMin.x), std::max(globalMin.y, session.movementAreaMin.y), std::max(globalMin.z, session.movementAreaMin.z)};
+    const Coordinate max{std::min(globalMax.x, session.movementAreaMax.x), std::min(globalMax.y, session.movementAreaMax.y), std::min(globalMax.z, session.movementAreaMax.z)};
+    auto pin = pinOverlay();// the spans are visited after the lookup
+    FloodFill fill(lookup, Dataset::current().cubeEdgeLength, magnification, min, max, axes);
+    fill.pin = std::move(pin);
+    return fill;
+}
+
+void FloodFill::unpin() {
+    cubes.clear();
+    recentCubes.fill({});
+    lastCube = nullptr;
+    pin.reset();
+}
+
+FloodFill::Cube * FloodFill::switchCube(const Voxel & voxel) {
+    const CoordOfCube cubeCoord{voxel[0] / cubeEdge, voxel[1] / cubeEdge, voxel[2] / cubeEdge};
+    // spans and their neighbour rows alternate between adjacent cubes, which never share a slot
+    auto & recent = recentCubes[(cubeCoord.x & 1) | (cubeCoord.y & 1) << 1 | (cubeCoord.z & 1) << 2];
+    if (recent.second == nullptr || !(recent.first == cubeCoord)) {
+        auto it = cubes.find(cubeCoord);
+        if (it == std::end(cubes)) {
+            auto * ids = lookup(cubeCoord);
+            const auto bits = static_cast<std::size_t>(cubeEdge) * cubeEdge * cubeEdge;
+            it = cubes.emplace(cubeCoord, Cube{ids, ids != nullptr ? std::vector<std::uint64_t>((bits + 63) / 64) : std::vector<std::uint64_t>{}}).first;
+        }
+        recent = {cubeCoord, &it->second};// nodes of unordered_map stay where they are
+    }
+    if (recent.second->ids == nullptr) {
+        return nullptr;
+    }
+    lastCube = recent.second;
+    lastCubeMin = {{cubeCoord.x * cubeEdge, cubeCoord.y * cubeEdge, cubeCoord.z * cubeEdge}};
+    lastCubeMax = {{lastCubeMin[0] + cubeEdge - 1, lastCubeMin[1] + cubeEdge - 1, lastCubeMin[2] + cubeEdge - 1}};
+    return lastCube;
+}
+
+namespace {
+// the fill this replaced: a voxel stack, a hash set of visited voxels and a cube lookup per voxel
+std::size_t referenceFill(const FloodFill::CubeLookup & lookup, const int edge, const Coordinate & seed, const std::uint64_t id, const std::uint64_t newId) {
+    std::vector<Coordinate> work{seed};
+    std::unordered_set<Coordinate> visitedVoxels;
+    std::size_t count{0};
+    while (!work.empty()) {
+        const auto pos = work.back();
+        work.pop_back();
+        auto * cube = lookup(pos.cube(edge, 1));
+        if (cube == nullptr || visitedVoxels.find(pos) != std::end(visitedVoxels)) {
+            continue;
+        }
+        const auto inCube = pos.insideCube(edge, 1);
+        auto & voxel = cube[inCube.x + edge * (inCube.y + edge * inCube.z)];
+        if (voxel == id) {
+            voxel = newId;
+            ++count;
+            visitedVoxels.emplace(pos);
+            for (const auto & step : {Coordinate{1, 0, 0}, Coordinate{-1, 0, 0}, Coordinate{0, 1, 0}, Coordinate{0, -1, 0}, Coordinate{0, 0, 1}, Coordinate{0, 0, -1}}) {
+                const auto next = pos + step;
+                if (next.x >= 0 && next.y >= 0 && next.z >= 0 && visitedVoxels.find(next) == std::end(visitedVoxels)) {
+                    work.emplace_back(next);
+                }
+            }
+        }
+    }
+    return count;
+}
+}
+
+std::vector<FloodFill::BenchmarkResult> FloodFill::benchmark(const std::vector<int> & radii, const int repetitions) {
+    const int edge = 64;
+    const int grid = 3;
+    const auto cubeVoxels = static_cast<std::size_t>(edge) * edge * edge;
+    std::vector<std::vector<std::uint64_t>> cubes(grid * grid * grid, std::vector<std::uint64_t>(cubeVoxels));
+    const CubeLookup lookup = [&cubes, grid](const CoordOfCube & coord) -> std::uint64_t * {
+        if (coord.x < 0 || coord.y < 0 || coord.z < 0 || coord.x >= grid || coord.y >= grid || coord.z >= grid) {
+            return nullptr;
+        }
+        return cubes[coord.x + grid * (coord.y + grid * coord.z)].data();
+    };
+    const Coordinate center{grid * edge / 2, grid * edge / 2, grid * edge / 2};
+    std::vector<BenchmarkResult> results;
+    for (const auto radius : radii) {
+        // a ball of 1s in a noise of distinct ids
+        for (int z = 0; z < grid * edge; ++z)
+        for (int y = 0; y < grid * edge; ++y)
+        for (int x = 0; x < grid * edge; ++x) {
+            const Coordinate pos{x, y, z};
+            const auto offset = pos - center;
+            const auto inCube = pos.insideCube(edge, 1);
+            const auto i = static_cast<std::size_t>(inCube.x) + edge * (inCube.y + edge * inCube.z);
+            const bool inside = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z <= radius * radius;
+            lookup(pos.cube(edge, 1))[i] = inside ? 1 : 3 + (i * 2654435761u >> 8) % 1000;
+        }
+        const auto measure = [&](const QString & method, auto run){
+            std::size_t voxels{0};
+            QElapsedTimer timer;
+            timer.start();
+            for (int i{0}; i < repetitions; ++i) {
+                voxels = run(i % 2 == 0 ? 1 : 2, i % 2 == 0 ? 2 : 1);// fill back and forth
+            }
+            const auto ns = static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions);
+            results.push_back({radius, method, voxels, ns / std::max<std::size_t>(1, voxels)});
+            if (repetitions % 2 != 0) {
+                run(2, 1);
+            }
+        };
+        measure("reference", [&](const std::uint64_t id, const std::uint64_t newId){
+            return referenceFill(lookup, edge, center, id, newId);
+        });
+        measure("scanline", [&](const std::uint64_t id, const std::uint64_t newId){
+            FloodFill fill(lookup, edge, 1, {0, 0, 0}, Coordinate{1, 1, 1} * (grid * edge - 1));
+            return fill.fill(center, [id](const std::uint64_t voxel){
+                return voxel == id;
+            }, [newId](std::uint64_t * ids, const std::size_t stride, const int count, const Coordinate &){
+                for (int i = 0; i < count; ++i) {
+                    ids[i * stride] = newId;
+                }
+            });
+        });
+    }
+    return results;
+}
+
+namespace {
+const KernelBench::Registration registration{"flood fill", 5, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : FloodFill::benchmark({8, 24, 64, 95}, repetitions)) {
+        results.append(QVariantMap{{"radius", result.radius}
+            , {"method", result.method}
+            , {"voxels", static_cast<qulonglong>(result.voxels)}
+            , {"ns_per_voxel", result.nsPerVoxel}});
+    }
+    return results;
+}};
+}
@@ -42,10 +42,18 @@
 #include <unordered_map>
 #include <vector>
 
+/**
+ * @brief Segmentation holds the objects and subobjects of the overlay.
+ *
+ * It is only modified on the main thread. Other threads may read it while the main thread waits for them
+ * (the ortho overlay slicing does), but not from work which outlives that wait.
+ */
 class Segmentation : public QObject {
 Q_OBJECT
     friend void connectedComponent(const Coordinate & seed);
     friend void verticalSplittingPlane(const Coordinate & seed);
+    friend std::vector<uint64_t> splitIntoConnectedComponents(uint64_t objectIndex);
+    friend std::size_t splitDisconnectedSubobjects();
     friend auto & objectFromId(const quint64 objId);
     friend class SegmentationObjectModel;
     friend class TouchedObjectModel;
@@ -58,6 +66,8 @@ Q_OBJECT
     class SubObject {
         friend void connectedComponent(const Coordinate & seed);
         friend void verticalSplittingPlane(const Coordinate & seed);
+        friend std::vector<uint64_t> splitIntoConnectedComponents(uint64_t objectIndex);
+        friend std::size_t splitDisconnectedSubobjects();
         friend class SegmentationObjectModel;
         friend class Segmentation;
         static uint64_t highestId;
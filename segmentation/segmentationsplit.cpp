@@ -23,88 +23,110 @@
 #include "segmentationsplit.h"
 
 #include "coordinate.h"
+#include "connectedcomponents.h"
 #include "cubeloader.h"
+#include "dataset.h"
+#include "floodfill.h"
 #include "loader.h"
 #include "segmentation.h"
+#include "session.h"
 
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
-void subobjectBucketFill(const Coordinate & seed, const Coordinate & center, const uint64_t fillsoid, const brush_t & brush, const Coordinate & areaMin, const Coordinate & areaMax) {
-    std::vector<Coordinate> work = {seed};
-    std::unordered_set<Coordinate> visitedVoxels;
+namespace {
+// ids of the object to split which aren’t already split off, decided once per id
+auto splitPredicate(const Coordinate & location, const uint64_t objIndexToSplit, const uint64_t newSubObjId) {
+    return [location, objIndexToSplit, newSubObjId, decisions = std::unordered_map<uint64_t, bool>{}](const uint64_t subobjectId) mutable {
+        auto it = decisions.find(subobjectId);
+        if (it == std::end(decisions)) {
+            bool inside{false};
+            if (subobjectId != Segmentation::singleton().getBackgroundId() && subobjectId != newSubObjId) {
+                auto & subobject = Segmentation::singleton().subobjectFromId(subobjectId, location);
+                inside = Segmentation::singleton().largestObjectContainingSubobject(subobject) == objIndexToSplit;
+            }
+            it = decisions.emplace(subobjectId, inside).first;
+        }
+        return it->second;
+    };
+}
+}
 
+void subobjectBucketFill(const Coordinate & seed, const Coordinate & center, const uint64_t fillsoid, const brush_t & brush, const Coordinate & areaMin, const Coordinate & areaMax) {
+    int axes{0};
+    if (brush.view != brush_t::view_t::zy || brush.mode == brush_t::mode_t::three_dim) {
+        axes |= FloodFill::X;
+    }
+    if (brush.view != brush_t::view_t::xz || brush.mode == brush_t::mode_t::three_dim) {
+        axes |= FloodFill::Y;
+    }
+    if (brush.view != brush_t::view_t::xy || brush.mode == brush_t::mode_t::three_dim) {
+        axes |= FloodFill::Z;
+    }
     const auto clickedsoid = readVoxel(seed);
-
-    while (!work.empty()) {
-        const auto pos = work.back();
-        work.pop_back();
-
-        if (readVoxel(pos) == clickedsoid) {
-            const auto walk = [&center, &visitedVoxels, &work](const auto x, const auto y, const auto z){
-                const bool wasntVisitedBefore = visitedVoxels.emplace(x, y, z).second;
-                if (wasntVisitedBefore && currentlyVisibleWrapWrap(center, {x, y, z})) {
-                    work.emplace_back(x, y, z);
-                }
-            };
-
-            const auto posDec = (pos - 1).capped(areaMin, areaMax);
-            const auto posInc = (pos + 1).capped(areaMin, areaMax);
-
-            if (brush.view != brush_t::view_t::zy || brush.mode == brush_t::mode_t::three_dim) {
-                walk(posInc.x, pos.y, pos.z);
-                walk(posDec.x, pos.y, pos.z);
+    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
+    const auto mag = Dataset::current().magnification;
+    CubeCoordSet cubeChangeSet;
+    auto fill = FloodFill::overlay(areaMin, areaMax, axes);
+    // the fill may leave the brush region and come back into it, but only the brush region gets written
+    const auto region = getRegion(center, brush);
+    const auto axis = fill.spanAxis();
+    const Coordinate step{axis == 0 ? mag : 0, axis == 1 ? mag : 0, axis == 2 ? mag : 0};
+    fill.fill(seed, [clickedsoid](const uint64_t subobjectId){
+        return subobjectId == clickedsoid;
+    }, [&](uint64_t * ids, const std::size_t stride, const int count, const Coordinate & globalFirst){
+        bool changed{false};
+        auto pos = globalFirst;
+        for (int i = 0; i < count; ++i, pos = pos + step) {
+            if (pos.x >= region.first.x && pos.y >= region.first.y && pos.z >= region.first.z
+                    && pos.x <= region.second.x && pos.y <= region.second.y && pos.z <= region.second.z) {
+                ids[i * stride] = fillsoid;
+                changed = true;
             }
-            if (brush.view != brush_t::view_t::xz || brush.mode == brush_t::mode_t::three_dim) {
-                walk(pos.x, posInc.y, pos.z);
-                walk(pos.x, posDec.y, pos.z);
-            }
-            if (brush.view != brush_t::view_t::xy || brush.mode == brush_t::mode_t::three_dim) {
-                walk(pos.x, pos.y, posInc.z);
-                walk(pos.x, pos.y, posDec.z);
-            }
-        } else {
-            visitedVoxels.erase(pos);
         }
-    }
-
-    listFill(center, brush, fillsoid, visitedVoxels);
+        if (changed) {
+            cubeChangeSet.emplace(globalFirst.cube(cubeEdgeLen, mag));
+        }
+    });
+    fill.unpin();
+    coordCubesMarkChanged(cubeChangeSet);
 }
 
 std::unordered_set<uint64_t> bucketFill(const Coordinate & seed, const uint64_t objIndexToSplit, const uint64_t newSubObjId, const std::unordered_set<uint64_t> & subObjectsToFill) {
-    std::vector<Coordinate> work = {seed};
-    std::unordered_set<Coordinate> visitedVoxels;
     std::unordered_set<uint64_t> visitedSubObjects;
-    while (!work.empty()) {
-        auto pos = work.back();
-        work.pop_back();
-
-        auto subobjectId = readVoxel(pos);
-        if (subobjectId != Segmentation::singleton().getBackgroundId() && subobjectId != newSubObjId) {
-            auto & subobject = Segmentation::singleton().subobjectFromId(subobjectId, seed);
-            auto objIndex = Segmentation::singleton().largestObjectContainingSubobject(subobject);
-            if (objIndex == objIndexToSplit) {
-                if (subObjectsToFill.find(subobjectId) != std::end(subObjectsToFill)) {
-                    //only write to cubes which were hit by the splitting plane
-                    writeVoxel(pos, newSubObjId);//write to cube
-                } else {
-                    visitedSubObjects.emplace(subobject.id);//accumulate visited subobjects
+    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
+    const auto mag = Dataset::current().magnification;
+    CubeCoordSet cubeChangeSet;
+    uint64_t lastId{Segmentation::singleton().getBackgroundId()};
+    bool lastIdFilled{false};
+    auto fill = FloodFill::overlay(Session::singleton().movementAreaMin, Session::singleton().movementAreaMax);
+    fill.fill(seed, splitPredicate(seed, objIndexToSplit, newSubObjId), [&](uint64_t * ids, const std::size_t stride, const int count, const Coordinate & globalFirst){
+        bool changed{false};
+        for (int i = 0; i < count; ++i) {
+            auto & subobjectId = ids[i * stride];
+            if (subobjectId != lastId) {
+                lastId = subobjectId;
+                lastIdFilled = subObjectsToFill.find(subobjectId) != std::end(subObjectsToFill);
+                if (!lastIdFilled) {
+                    visitedSubObjects.emplace(subobjectId);//accumulate visited subobjects
                 }
-
-                visitedVoxels.emplace(pos.x, pos.y, pos.z);
-                auto walk = [&](const Coordinate & newPos){
-                    if (visitedVoxels.find(newPos) == std::end(visitedVoxels)) {
-                        work.emplace_back(newPos);
-                    }
-                };
-                walk({pos.x + 1, pos.y, pos.z});
-                walk({pos.x - 1, pos.y, pos.z});
-                walk({pos.x, pos.y + 1, pos.z});
-                walk({pos.x, pos.y - 1, pos.z});
-                walk({pos.x, pos.y, pos.z + 1});
-                walk({pos.x, pos.y, pos.z - 1});
+            }
+            if (lastIdFilled) {
+                //only write to cubes which were hit by the splitting plane
+                subobjectId = newSubObjId;
+                changed = true;
             }
         }
-    }
+        if (changed) {
+            cubeChangeSet.emplace(globalFirst.cube(cubeEdgeLen, mag));
+        }
+    });
+    fill.unpin();
+    coordCubesMarkChanged(cubeChangeSet);
     return visitedSubObjects;
 }
 
@@ -136,34 +158,25 @@ void connectedComponent(const Coordinate & seed) {
 }
 
 std::unordered_set<uint64_t> verticalSplittingPlane(const Coordinate & pos, const uint64_t objIndexToSplit, const uint64_t newSubObjId) {
-    std::vector<Coordinate> work = {pos};
-    std::unordered_set<Coordinate> visitedVoxels;
     std::unordered_set<uint64_t> visitedSubObjects;
-    while (!work.empty()) {
-        auto pos = work.back();
-        work.pop_back();
-
-        auto subobjectId = readVoxel(pos);
-        if (subobjectId != Segmentation::singleton().getBackgroundId() && subobjectId != newSubObjId) {
-            auto & subobject = Segmentation::singleton().subobjectFromId(subobjectId, pos);
-            auto objIndex = Segmentation::singleton().largestObjectContainingSubobject(subobject);
-            if (objIndex == objIndexToSplit) {
-                writeVoxel(pos, newSubObjId);//write to cube
-                visitedSubObjects.emplace(subobject.id);//accumulate visited subobjects
-
-                visitedVoxels.emplace(pos.x, pos.y, pos.z);
-                auto walk = [&](const Coordinate & newPos){
-                    if (visitedVoxels.find(newPos) == std::end(visitedVoxels)) {
-                        work.emplace_back(newPos);
-                    }
-                };
-                walk({pos.x, pos.y + 1, pos.z});
-                walk({pos.x, pos.y - 1, pos.z});
-                walk({pos.x, pos.y, pos.z + 1});
-                walk({pos.x, pos.y, pos.z - 1});
+    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
+    const auto mag = Dataset::current().magnification;
+    CubeCoordSet cubeChangeSet;
+    auto fill = FloodFill::overlay(Session::singleton().movementAreaMin, Session::singleton().movementAreaMax, FloodFill::Y | FloodFill::Z);
+    fill.fill(pos, splitPredicate(pos, objIndexToSplit, newSubObjId), [&](uint64_t * ids, const std::size_t stride, const int count, const Coordinate & globalFirst){
+        uint64_t lastId{newSubObjId};
+        for (int i = 0; i < count; ++i) {
+            auto & subobjectId = ids[i * stride];
+            if (subobjectId != lastId) {
+                lastId = subobjectId;
+                visitedSubObjects.emplace(subobjectId);//accumulate visited subobjects
             }
+            subobjectId = newSubObjId;
         }
-    }
+        cubeChangeSet.emplace(globalFirst.cube(cubeEdgeLen, mag));
+    });
+    fill.unpin();
+    coordCubesMarkChanged(cubeChangeSet);
     return visitedSubObjects;
 }
 
@@ -206,3 +219,151 @@ void verticalSplittingPlane(const Coordinate & seed) {
         Segmentation::singleton().unmergeSelectedObjects(seed);
     }
 }
+
+std::vector<uint64_t> splitIntoConnectedComponents(uint64_t objectIndex) {
+    auto & seg = Segmentation::singleton();
+    std::unordered_set<uint64_t> members;
+    for (const auto & subobject : seg.objects[objectIndex].subobjects) {
+        members.emplace(subobject.get().id);
+    }
+    auto labelling = ConnectedComponents::overlay();
+    const auto & components = labelling.label([&members](const uint64_t subobjectId) -> uint64_t {
+        return members.find(subobjectId) != std::end(members);
+    });
+    std::vector<uint64_t> newObjectIndices;
+    if (components.size() < 2) {
+        return newObjectIndices;
+    }
+    //the largest component stays in the object
+    const auto kept = static_cast<std::size_t>(std::distance(std::begin(components), std::max_element(std::begin(components), std::end(components), [](const auto & lhs, const auto & rhs){
+        return lhs.voxels < rhs.voxels;
+    })));
+    //supervoxels reaching into several components keep their id in one of them (the kept one if they reach into it)
+    //and get a new id in the others
+    std::unordered_map<uint64_t, std::size_t> componentCount;
+    for (const auto & component : components) {
+        for (const auto id : component.ids) {
+            ++componentCount[id];
+        }
+    }
+    const auto & keptIds = components[kept].ids;
+    std::unordered_set<uint64_t> originalTaken;
+    std::map<std::pair<std::size_t, uint64_t>, uint64_t> splitIds;
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        for (const auto id : components[i].ids) {
+            if (i != kept && componentCount[id] > 1
+                    && (std::binary_search(std::begin(keptIds), std::end(keptIds), id) || !originalTaken.emplace(id).second)) {
+                splitIds.emplace(std::make_pair(i, id), ++Segmentation::SubObject::highestId);
+            }
+        }
+    }
+    if (!splitIds.empty()) {
+        const auto changedCubes = labelling.relabel([&splitIds](const std::size_t component, const uint64_t subobjectId){
+            const auto it = splitIds.find(std::make_pair(component, subobjectId));
+            return it != std::end(splitIds) ? it->second : subobjectId;
+        });
+        labelling.unpin();
+        coordCubesMarkChanged(changedCubes);
+    }
+    //objects besides the split one which contain a split supervoxel, before the pieces move into new objects
+    std::unordered_map<uint64_t, std::vector<uint64_t>> otherObjects;
+    for (const auto & split : splitIds) {
+        const auto id = split.first.second;
+        if (otherObjects.find(id) == std::end(otherObjects)) {
+            auto & objects = otherObjects[id];
+            for (const auto objIndex : seg.subobjects.at(id).objects) {
+                if (objIndex != objectIndex) {
+                    objects.emplace_back(objIndex);
+                }
+            }
+        }
+    }
+    const auto subobjectWithoutObject = [&seg](const uint64_t id) -> auto & {
+        return seg.subobjects.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id)).first->second;
+    };
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        if (i == kept) {
+            continue;
+        }
+        const auto & component = components[i];
+        std::vector<uint64_t> ids;
+        for (const auto id : component.ids) {
+            const auto it = splitIds.find(std::make_pair(i, id));
+            ids.emplace_back(it != std::end(splitIds) ? it->second : id);
+        }
+        const auto newObjectIndex = seg.createObjectFromSubobjectId(ids.front(), component.location).index;
+        for (auto it = std::next(std::begin(ids)); it != std::end(ids); ++it) {
+            seg.objects[newObjectIndex].addExistingSubObject(subobjectWithoutObject(*it));
+        }
+        std::sort(std::begin(seg.objects[newObjectIndex].subobjects), std::end(seg.objects[newObjectIndex].subobjects));
+        //add the new pieces to all other objects containing the split supervoxel
+        for (const auto id : component.ids) {
+            const auto it = splitIds.find(std::make_pair(i, id));
+            if (it == std::end(splitIds)) {
+                continue;
+            }
+            for (const auto objIndex : otherObjects[id]) {
+                auto & object = seg.objects[objIndex];
+                object.addExistingSubObject(subobjectWithoutObject(it->second));
+                std::sort(std::begin(object.subobjects), std::end(object.subobjects));
+            }
+        }
+        const auto objectCount = seg.objects.size();
+        seg.unmergeObject(seg.objects[objectIndex], seg.objects[newObjectIndex], component.location);
+        if (seg.objects.size() > objectCount) {//immutable objects leave the remainder in a new object
+            objectIndex = seg.objects.size() - 1;
+        }
+        newObjectIndices.emplace_back(newObjectIndex);
+    }
+    emit seg.todosLeftChanged();
+    return newObjectIndices;
+}
+
+std::size_t splitDisconnectedSubobjects() {
+    auto & seg = Segmentation::singleton();
+    const auto backgroundId = seg.getBackgroundId();
+    auto labelling = ConnectedComponents::overlay();
+    const auto & components = labelling.label([backgroundId](const uint64_t subobjectId){
+        return subobjectId != backgroundId ? subobjectId : 0;
+    });
+    //the largest piece of every supervoxel keeps its id
+    std::unordered_map<uint64_t, std::size_t> largestPiece;
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        const auto it = largestPiece.emplace(components[i].key, i).first;
+        if (components[i].voxels > components[it->second].voxels) {
+            it->second = i;
+        }
+    }
+    std::unordered_map<std::size_t, uint64_t> pieceIds;
+    for (std::size_t i = 0; i < components.size(); ++i) {
+        if (largestPiece[components[i].key] != i) {
+            pieceIds.emplace(i, ++Segmentation::SubObject::highestId);
+        }
+    }
+    if (pieceIds.empty()) {
+        return 0;
+    }
+    const auto changedCubes = labelling.relabel([&pieceIds](const std::size_t component, const uint64_t subobjectId){
+        const auto it = pieceIds.find(component);
+        return it != std::end(pieceIds) ? it->second : subobjectId;
+    });
+    labelling.unpin();
+    coordCubesMarkChanged(changedCubes);
+    //pieces stay part of the objects of their supervoxel
+    for (const auto & piece : pieceIds) {
+        const auto & component = components[piece.first];
+        const auto it = seg.subobjects.find(component.key);
+        if (it == std::end(seg.subobjects)) {
+            continue;
+        }
+        const auto objectIndices = it->second.objects;
+        auto & subobject = seg.subobjects.emplace(std::piecewise_construct, std::forward_as_tuple(piece.second), std::forward_as_tuple(piece.second)).first->second;
+        for (const auto objIndex : objectIndices) {
+            auto & object = seg.objects[objIndex];
+            object.addExistingSubObject(subobject);
+            std::sort(std::begin(object.subobjects), std::end(object.subobjects));
+            emit seg.changedRow(objIndex);
+        }
+    }
+    return pieceIds.size();
+}
@@ -27,7 +27,9 @@
 
 #include <QObject>
 
+#include <cstddef>
 #include <unordered_set>
+#include <vector>
 
 class brush_t {
 public:
@@ -104,5 +106,9 @@ signals:
 void subobjectBucketFill(const Coordinate & seed, const Coordinate & center, const uint64_t fillsoid, const brush_t & brush, const Coordinate & areaMin, const Coordinate & areaMax);
 void connectedComponent(const Coordinate & seed);
 void verticalSplittingPlane(const Coordinate & seed);
+// splits the object into its connected components within the loaded cubes, the largest one remains, returns the indices of the new objects
+std::vector<uint64_t> splitIntoConnectedComponents(uint64_t objectIndex);
+// gives all but the largest piece of every disconnected supervoxel a new id, returns the number of new supervoxels
+std::size_t splitDisconnectedSubobjects();
 
 #endif//SEGMENTATIONSPLIT_H
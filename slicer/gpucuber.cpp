@@ -24,88 +24,249 @@
 
 #include "segmentation/segmentation.h"
 
-#include <boost/multi_array.hpp>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 
 gpu_raw_cube::gpu_raw_cube(const int gpucubeedge, const bool index) {
+    allocateCube(gpucubeedge, index ? QOpenGLTexture::R16_UNorm : QOpenGLTexture::R8_UNorm, index ? QOpenGLTexture::Nearest : QOpenGLTexture::Linear);
+}
+
+void gpu_raw_cube::allocateCube(const int gpucubeedge, const QOpenGLTexture::TextureFormat format, const QOpenGLTexture::Filter filter) {
     cube.setAutoMipMapGenerationEnabled(false);
     cube.setSize(gpucubeedge, gpucubeedge, gpucubeedge);
     cube.setMipLevels(1);
-    cube.setMinificationFilter(index ? QOpenGLTexture::Nearest : QOpenGLTexture::Linear);
-    cube.setMagnificationFilter(index ? QOpenGLTexture::Nearest : QOpenGLTexture::Linear);
-    cube.setFormat(index ? QOpenGLTexture::R16_UNorm : QOpenGLTexture::R8_UNorm);
+    cube.setMinificationFilter(filter);
+    cube.setMagnificationFilter(filter);
+    cube.setFormat(format);
     cube.setWrapMode(QOpenGLTexture::ClampToEdge);
     cube.allocateStorage();
 }
 
-std::vector<char> gpu_raw_cube::prepare(boost::multi_array_ref<uint8_t, 3>::const_array_view<3>::type view) {
-    std::vector<char> data;
-    for (const auto & d2 : view)
-    for (const auto & d1 : d2)
-    for (const auto & elem : d1) {
-        data.emplace_back(elem);
+void gpu_raw_cube::reset() {
+    vertices.clear();
+}
+
+void gpu_raw_cube::prepare(const std::uint8_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset, std::uint8_t * dst) {
+    const std::size_t cpuedge = cpucubeedge;
+    for (std::size_t z = 0; z < static_cast<std::size_t>(gpucubeedge); ++z)
+    for (std::size_t y = 0; y < static_cast<std::size_t>(gpucubeedge); ++y, dst += gpucubeedge) {
+        std::memcpy(dst, cube + offset.x + (offset.y + y) * cpuedge + (offset.z + z) * cpuedge * cpuedge, gpucubeedge);
     }
-    return data;
 }
 
-void gpu_raw_cube::upload(const std::vector<char> & data) {
-    cube.setData(QOpenGLTexture::Red, QOpenGLTexture::UInt8, data.data());
+void gpu_raw_cube::upload(const void * data) {
+    cube.setData(QOpenGLTexture::Red, QOpenGLTexture::UInt8, data);
+}
+
+void gpu_raw_cube::generate(const std::uint8_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset) {
+    std::vector<std::uint8_t> data(static_cast<std::size_t>(gpucubeedge) * gpucubeedge * gpucubeedge);
+    prepare(cube, cpucubeedge, gpucubeedge, offset, data.data());
+    upload(data.data());
 }
 
-void gpu_raw_cube::generate(boost::multi_array_ref<uint8_t, 3>::const_array_view<3>::type view) {
-    upload(prepare(view));
+std::array<std::uint8_t, 4> OverlayColorTable::color(const std::uint64_t subobjectId) {
+    const auto color = Segmentation::singleton().colorObjectFromSubobjectId(subobjectId);
+    return {{std::get<0>(color), std::get<1>(color), std::get<2>(color), std::get<3>(color)}};
 }
 
-gpu_lut_cube::gpu_lut_cube(const int gpucubeedge) : gpu_raw_cube(gpucubeedge, true) {
-    lut.setAutoMipMapGenerationEnabled(false);
-    lut.setMipLevels(1);
-    lut.setMinificationFilter(QOpenGLTexture::Nearest);
-    lut.setMagnificationFilter(QOpenGLTexture::Nearest);
-    lut.setFormat(QOpenGLTexture::RGBA8_UNorm);
+std::uint32_t OverlayColorTable::slot(const std::uint64_t subobjectId) {
+    const auto it = slots.find(subobjectId);
+    if (it != std::end(slots)) {
+        ++references[it->second];
+        return it->second;
+    }
+    std::uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        ids[slot] = subobjectId;
+    } else {
+        slot = static_cast<std::uint32_t>(ids.size());
+        ids.emplace_back(subobjectId);
+        references.emplace_back();
+        if (colors.size() < ids.size()) {
+            colors.resize(colors.size() + width);
+        }
+    }
+    slots.emplace(subobjectId, slot);
+    references[slot] = 1;
+    colors[slot] = color(subobjectId);
+    const int row = slot / width;
+    dirtyBegin = dirtyBegin < dirtyEnd ? std::min(dirtyBegin, row) : row;
+    dirtyEnd = std::max(dirtyEnd, row + 1);
+    return slot;
 }
 
-std::vector<gpu_lut_cube::gpu_index> gpu_lut_cube::prepare(boost::multi_array_ref<uint64_t, 3>::const_array_view<3>::type view) {
+void OverlayColorTable::release(const std::uint32_t slot) {
+    if (--references[slot] == 0) {// the color stays until the slot is taken again
+        slots.erase(ids[slot]);
+        freeSlots.emplace_back(slot);
+    }
+}
+
+void OverlayColorTable::clear() {
+    slots.clear();
+    ids.clear();
+    references.clear();
+    freeSlots.clear();
+    colors.clear();
+    dirtyBegin = dirtyEnd = 0;
+    stale = false;
+}
+
+void OverlayColorTable::upload() {
+    if (stale) {
+        stale = false;
+        for (std::size_t slot = 0; slot < ids.size(); ++slot) {
+            if (references[slot] == 0) {
+                continue;
+            }
+            const auto current = color(ids[slot]);
+            if (current != colors[slot]) {
+                colors[slot] = current;
+                const int row = slot / width;
+                dirtyBegin = dirtyBegin < dirtyEnd ? std::min(dirtyBegin, row) : row;
+                dirtyEnd = std::max(dirtyEnd, row + 1);
+            }
+        }
+    }
+    const int rows = colors.size() / width;
+    if (!texture.isStorageAllocated() || rows > allocatedRows) {
+        allocatedRows = 16;
+        while (allocatedRows < rows) {
+            allocatedRows *= 2;
+        }
+        texture.destroy();
+        texture.setAutoMipMapGenerationEnabled(false);
+        texture.setSize(width, allocatedRows);
+        texture.setMipLevels(1);
+        texture.setMinificationFilter(QOpenGLTexture::Nearest);
+        texture.setMagnificationFilter(QOpenGLTexture::Nearest);
+        texture.setFormat(QOpenGLTexture::RGBA8_UNorm);
+        texture.setWrapMode(QOpenGLTexture::ClampToEdge);
+        texture.allocateStorage();
+        dirtyBegin = 0;
+        dirtyEnd = rows;
+    }
+    if (dirtyBegin < dirtyEnd) {
+        texture.bind();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirtyBegin, width, dirtyEnd - dirtyBegin, GL_RGBA, GL_UNSIGNED_BYTE, colors.data() + static_cast<std::size_t>(dirtyBegin) * width);
+        texture.release();
+    }
+    dirtyBegin = dirtyEnd = 0;
+}
+
+gpu_lut_cube::gpu_lut_cube(const int gpucubeedge) : gpu_raw_cube(gpucubeedge, true) {}
+
+void gpu_lut_cube::reset() {
+    gpu_raw_cube::reset();
+    if (colorTable != nullptr) {
+        for (const auto slot : slots) {
+            colorTable->release(slot);
+        }
+        colorTable = nullptr;
+    }
+    slots.clear();
+}
+
+gpu_lut_cube::Indexed gpu_lut_cube::prepare(const std::uint64_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset) {
     bool lastValid{false};
     uint64_t lastElem{0};
-    uint64_t lastIndex{0};
-    std::array<std::uint8_t, 4> lastColor{{}};
-
-    std::vector<gpu_index> data;
-    for (const auto & d2 : view)
-    for (const auto & d1 : d2)
-    for (const auto & elem : d1) {
-        if (lastValid && elem == lastElem) {
-            data.emplace_back(lastIndex);
-        } else {
-            const auto it = id_to_lut_index.find(elem);
-            const auto existing = it != std::end(id_to_lut_index);
-            const auto index = existing ? it->second : (id_to_lut_index[elem] = highest_index++);//increment after assignment
-            data.emplace_back(index);
-            if (!existing) {
-                const auto color = Segmentation::singleton().colorObjectFromSubobjectId(elem);
-                lastColor = {{std::get<0>(color), std::get<1>(color), std::get<2>(color), std::get<3>(color)}};
-                colors.push_back(lastColor);
+    std::uint32_t lastIndex{0};
+
+    std::unordered_map<std::uint64_t, std::uint32_t> id_to_lut_index;
+    const std::size_t cpuedge = cpucubeedge;
+    Indexed indexed;
+    indexed.indices.resize(static_cast<std::size_t>(gpucubeedge) * gpucubeedge * gpucubeedge);
+    auto * dst = indexed.indices.data();
+    for (std::size_t z = 0; z < static_cast<std::size_t>(gpucubeedge); ++z)
+    for (std::size_t y = 0; y < static_cast<std::size_t>(gpucubeedge); ++y) {
+        const auto * row = cube + offset.x + (offset.y + y) * cpuedge + (offset.z + z) * cpuedge * cpuedge;
+        for (const auto * elem = row; elem != row + gpucubeedge; ++elem, ++dst) {
+            if (!lastValid || *elem != lastElem) {
+                const auto it = id_to_lut_index.find(*elem);
+                if (it != std::end(id_to_lut_index)) {
+                    lastIndex = it->second;
+                } else {
+                    lastIndex = id_to_lut_index[*elem] = indexed.ids.size();
+                    indexed.ids.emplace_back(*elem);
+                }
+                lastElem = *elem;
+                lastValid = true;
             }
-            lastElem = elem;
-            lastIndex = index;
-            lastColor = colors[index];
-            lastValid = true;
+            *dst = lastIndex;
         }
     }
-    const auto lutSize = std::pow(2, std::ceil(std::log2(colors.size())));
-    colors.resize(lutSize);
-    return data;
+    return indexed;
 }
 
-void gpu_lut_cube::upload(const std::vector<gpu_index> & data) {
-    lut.setSize(colors.size());
-    lut.allocateStorage();
+void gpu_lut_cube::upload(const Indexed & indexed, OverlayColorTable & colorTable) {
+    this->colorTable = &colorTable;
+    for (const auto id : indexed.ids) {
+        slots.emplace_back(colorTable.slot(id));
+    }
+    const auto & data = indexed.indices;
+    indexBytes = slots.size() <= 256 ? 1 : slots.size() <= 65536 ? 2 : 4;
+    const auto format = indexBytes == 1 ? QOpenGLTexture::R8_UNorm : indexBytes == 2 ? QOpenGLTexture::R16_UNorm : QOpenGLTexture::RG16_UNorm;
+    if (cube.format() != format) {// reused for a cube with a different index size
+        const auto gpucubeedge = cube.width();
+        cube.destroy();
+        allocateCube(gpucubeedge, format, QOpenGLTexture::Nearest);
+    }
+    if (indexBytes == 1) {
+        const std::vector<std::uint8_t> indices(std::begin(data), std::end(data));
+        cube.setData(QOpenGLTexture::Red, QOpenGLTexture::UInt8, indices.data());
+    } else if (indexBytes == 2) {
+        const std::vector<std::uint16_t> indices(std::begin(data), std::end(data));
+        cube.setData(QOpenGLTexture::Red, QOpenGLTexture::UInt16, indices.data());
+    } else {// low and high half in red and green
+        std::vector<std::uint16_t> indices;
+        indices.reserve(2 * data.size());
+        for (const auto index : data) {
+            indices.emplace_back(index & 0xFFFF);
+            indices.emplace_back(index >> 16);
+        }
+        cube.setData(QOpenGLTexture::RG, QOpenGLTexture::UInt16, indices.data());
+    }
+
+    int lutSize = 1;
+    while (lutSize < static_cast<int>(slots.size())) {
+        lutSize *= 2;
+    }
+    const int width = std::min(lutSize, int{lutWidth});
+    const auto height = lutSize / width;
+    if (lut.isStorageAllocated() && (lut.width() != width || lut.height() != height)) {// reused with a different lut size
+        lut.destroy();
+    }
+    if (!lut.isStorageAllocated()) {
+        lut.setAutoMipMapGenerationEnabled(false);
+        lut.setSize(width, height);
+        lut.setMipLevels(1);
+        lut.setMinificationFilter(QOpenGLTexture::Nearest);
+        lut.setMagnificationFilter(QOpenGLTexture::Nearest);
+        lut.setFormat(QOpenGLTexture::RGBA8_UNorm);
+        lut.setWrapMode(QOpenGLTexture::ClampToEdge);
+        lut.allocateStorage();
+    }
+    std::vector<std::array<std::uint8_t, 4>> texels(lutSize);
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        texels[i] = {{static_cast<std::uint8_t>(slots[i]), static_cast<std::uint8_t>(slots[i] >> 8), static_cast<std::uint8_t>(slots[i] >> 16), 255}};
+    }
+    lut.setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, texels.data());
+}
 
-    cube.setData(QOpenGLTexture::Red, QOpenGLTexture::UInt16, data.data());
-    lut.setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt32_RGBA8_Rev, colors.data());
+void gpu_lut_cube::generate(const std::uint64_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset, OverlayColorTable & colorTable) {
+    upload(prepare(cube, cpucubeedge, gpucubeedge, offset), colorTable);
 }
 
-void gpu_lut_cube::generate(boost::multi_array_ref<uint64_t, 3>::const_array_view<3>::type view) {
-    upload(prepare(view));
+std::array<float, 2> gpu_lut_cube::indexFactor() const {
+    const float max8 = std::numeric_limits<std::uint8_t>::max();
+    const float max16 = std::numeric_limits<std::uint16_t>::max();
+    return indexBytes == 1 ? std::array<float, 2>{{max8, 0}} : indexBytes == 2 ? std::array<float, 2>{{max16, 0}} : std::array<float, 2>{{max16, max16 * 65536}};
 }
 
 TextureLayer::TextureLayer(QOpenGLContext & sharectx) {
@@ -116,43 +277,212 @@ TextureLayer::TextureLayer(QOpenGLContext & sharectx) {
 }
 TextureLayer::~TextureLayer() {
     ctx.makeCurrent(&surface);//QOpenGLTexture dtor needs a current ctx
+    for (auto & stage : uploadStages) {
+        stage.preparation.waitForFinished();
+        if (stage.mapped != nullptr && stage.buffer.isCreated()) {
+            stage.buffer.bind();
+            stage.buffer.unmap();
+            stage.buffer.release();
+        }
+        stage.buffer.destroy();
+    }
 }
 
-template<typename cube_type, typename elem_type>
-void TextureLayer::createBogusCube(const int cpucubeedge, const int gpucubeedge) {
-    ctx.makeCurrent(&surface);
-    std::vector<char> data;
-    data.resize(std::pow(cpucubeedge, 3) * sizeof(elem_type));
-    std::fill(std::begin(data), std::end(data), 0);
-    bogusCube.reset(new cube_type(gpucubeedge));
-    boost::multi_array_ref<elem_type, 3> cube(reinterpret_cast<elem_type*>(data.data()), boost::extents[cpucubeedge][cpucubeedge][cpucubeedge]);
-    using range = boost::multi_array_types::index_range;
-    static_cast<cube_type*>(bogusCube.get())->generate(cube[boost::indices[range(0,gpucubeedge)][range(cpucubeedge-gpucubeedge,cpucubeedge-0)][range(0,gpucubeedge)]]);
+decltype(TextureLayer::textures)::iterator TextureLayer::evictionCandidate(const CoordOfGPUCube * keep) {
+    const auto distance = [this](const CoordOfGPUCube & pos){
+        const auto diff = pos - center;
+        return static_cast<std::int64_t>(diff.x) * diff.x + static_cast<std::int64_t>(diff.y) * diff.y + static_cast<std::int64_t>(diff.z) * diff.z;
+    };
+    auto candidate = std::end(textures);
+    for (auto it = std::begin(textures); it != std::end(textures); ++it) {
+        if (keep != nullptr && it->first == *keep) {
+            continue;
+        }
+        if (candidate == std::end(textures) || it->second->lastUse < candidate->second->lastUse
+                || (it->second->lastUse == candidate->second->lastUse && distance(it->first) > distance(candidate->first))) {
+            candidate = it;
+        }
+    }
+    return candidate;
+}
+
+template<typename cube_type>
+cube_type & TextureLayer::residentCube(const CoordOfGPUCube & gpuCoord, const int gpucubeedge) {
+    auto & slot = textures[gpuCoord];
+    if (slot == nullptr) {
+        if (!freeCubes.empty()) {
+            slot = std::move(freeCubes.back());
+            freeCubes.pop_back();
+            ++residencyMetrics.reuses;
+        } else if (textures.size() > textureCapacity) {
+            const auto victim = evictionCandidate(&gpuCoord);
+            slot = std::move(victim->second);
+            textures.erase(victim);
+            ++residencyMetrics.evictions;
+        } else {
+            slot.reset(new cube_type(gpucubeedge));
+            ++residencyMetrics.allocations;
+        }
+    }
+    slot->reset();
+    slot->lastUse = frame;
+    return static_cast<cube_type &>(*slot);
 }
 
 void TextureLayer::createBogusCube(const int cpucubeedge, const int gpucubeedge) {
+    ctx.makeCurrent(&surface);
+    const Coordinate offset{0, cpucubeedge - gpucubeedge, 0};
+    const auto cpuCubeVoxels = static_cast<std::size_t>(cpucubeedge) * cpucubeedge * cpucubeedge;
+    if (bogusCube) {
+        bogusCube->reset();
+    }
     if (isOverlayData) {
-        createBogusCube<gpu_lut_cube, std::uint64_t>(cpucubeedge, gpucubeedge);
+        const std::vector<std::uint64_t> data(cpuCubeVoxels);
+        auto * cube = new gpu_lut_cube(gpucubeedge);
+        bogusCube.reset(cube);
+        cube->generate(data.data(), cpucubeedge, gpucubeedge, offset, colorTable);
+        colorTable.upload();
     } else {
-        createBogusCube<gpu_raw_cube, std::uint8_t>(cpucubeedge, gpucubeedge);
+        const std::vector<std::uint8_t> data(cpuCubeVoxels);
+        bogusCube.reset(new gpu_raw_cube(gpucubeedge));
+        bogusCube->generate(data.data(), cpucubeedge, gpucubeedge, offset);
     }
 }
 
-template<typename cube_type, typename elem_type>
-void TextureLayer::cubeSubArray(const boost::const_multi_array_ref<elem_type, 3> cube, const int gpucubeedge, const CoordOfGPUCube gpuCoord, const Coordinate offset) {
+void TextureLayer::indexCubes(const std::vector<StreamedCube> & cubes, const int cpucubeedge, const int gpucubeedge) {
+    std::vector<gpu_lut_cube::Indexed> indexed(cubes.size());
+    QtConcurrent::blockingMap(indexed, [&cubes, cpucubeedge, gpucubeedge, first = indexed.data()](gpu_lut_cube::Indexed & result){
+        const auto & cube = cubes[&result - first];
+        result = gpu_lut_cube::prepare(reinterpret_cast<const std::uint64_t *>(cube.cube), cpucubeedge, gpucubeedge, cube.offset);
+    });
     ctx.makeCurrent(&surface);
-    using range = boost::multi_array_types::index_range;
-    const auto view = cube[boost::indices[range(0+offset.z,gpucubeedge+offset.z)][range(0+offset.y,gpucubeedge+offset.y)][range(0+offset.x,gpucubeedge+offset.x)]];
-    textures[gpuCoord].reset(new cube_type(gpucubeedge));
-    static_cast<cube_type*>(textures[gpuCoord].get())->generate(view);
+    for (std::size_t i = 0; i < cubes.size(); ++i) {
+        if (colorTable.size() + indexed[i].ids.size() > OverlayColorTable::maxSlots) {// start over before the slots run out, all cubes are prepared again
+            while (!textures.empty()) {
+                recycle(std::begin(textures)->first);
+            }
+            if (bogusCube) {
+                bogusCube->reset();
+            }
+            colorTable.clear();
+            createBogusCube(cpucubeedge, gpucubeedge);
+        }
+        residentCube<gpu_lut_cube>(cubes[i].gpuCoord, gpucubeedge).upload(indexed[i], colorTable);
+    }
 }
 
-void TextureLayer::cubeSubArray(const void * data, const int cpucubeedge, const int gpucubeedge, const CoordOfGPUCube gpuCoord, const Coordinate offset) {
-    if (isOverlayData) {
-        boost::const_multi_array_ref<std::uint64_t, 3> cube(reinterpret_cast<const std::uint64_t *>(data), boost::extents[cpucubeedge][cpucubeedge][cpucubeedge]);
-        cubeSubArray<gpu_lut_cube>(cube, gpucubeedge, gpuCoord, offset);
-    } else {
-        boost::const_multi_array_ref<std::uint8_t, 3> cube(reinterpret_cast<const std::uint8_t *>(data), boost::extents[cpucubeedge][cpucubeedge][cpucubeedge]);
-        cubeSubArray<gpu_raw_cube>(cube, gpucubeedge, gpuCoord, offset);
+void TextureLayer::updateColorTable() {
+    ctx.makeCurrent(&surface);
+    colorTable.upload();
+}
+
+void TextureLayer::setTextureCapacity(const std::size_t capacity) {
+    textureCapacity = std::max<std::size_t>(1, capacity);
+    ctx.makeCurrent(&surface);
+    while (!freeCubes.empty() && textures.size() + freeCubes.size() > textureCapacity) {
+        freeCubes.pop_back();
+    }
+    while (textures.size() > textureCapacity) {
+        const auto victim = evictionCandidate(nullptr);
+        victim->second->reset();
+        textures.erase(victim);
+        ++residencyMetrics.evictions;
+    }
+}
+
+void TextureLayer::advanceFrame(const CoordOfGPUCube & center) {
+    ++frame;
+    this->center = center;
+}
+
+void TextureLayer::recycle(const CoordOfGPUCube & gpuCoord) {
+    auto it = textures.find(gpuCoord);
+    if (it != std::end(textures)) {
+        it->second->reset();// frees its color table slots
+        freeCubes.emplace_back(std::move(it->second));
+        textures.erase(it);
+        ++residencyMetrics.recycled;
+    }
+}
+
+void TextureLayer::streamCubes(std::shared_ptr<CubeHash::Pin> pin, std::vector<StreamedCube> cubes, const int cpucubeedge, const int gpucubeedge) {
+    if (cubes.empty()) {
+        return;
+    }
+    ctx.makeCurrent(&surface);
+    auto & stage = uploadStages[currentStage];
+    const auto cubeBytes = static_cast<std::size_t>(gpucubeedge) * gpucubeedge * gpucubeedge;
+    const auto stageBytes = cubeBytes * cubesPerStage;
+    if (!stage.buffer.isCreated() && stage.buffer.create()) {
+        stage.buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+    stage.mapped = nullptr;
+    if (stage.buffer.isCreated()) {
+        stage.buffer.bind();
+        stage.buffer.allocate(static_cast<int>(stageBytes));// orphan the storage the gpu may still read from
+        stage.mapped = static_cast<std::uint8_t *>(stage.buffer.map(QOpenGLBuffer::WriteOnly));
+        stage.buffer.release();
+    }
+    uploadMetrics.pixelBuffers = stage.mapped != nullptr;
+    auto * dst = stage.mapped;
+    if (dst == nullptr) {
+        stage.hostBuffer.resize(stageBytes);
+        dst = stage.hostBuffer.data();
+    }
+    stage.cubes = std::move(cubes);
+    stage.gpucubeedge = gpucubeedge;
+    stage.sinceDispatch.start();
+    // the map functor holds the pin until the preparation is done
+    stage.preparation = QtConcurrent::map(stage.cubes, [pin, dst, cubeBytes, cpucubeedge, gpucubeedge, first = stage.cubes.data()](StreamedCube & cube){
+        QElapsedTimer timer;
+        timer.start();
+        gpu_raw_cube::prepare(cube.cube, cpucubeedge, gpucubeedge, cube.offset, dst + cubeBytes * static_cast<std::size_t>(&cube - first));
+        cube.prepareNs = timer.nsecsElapsed();
+    });
+    stageInFlight = true;
+}
+
+void TextureLayer::finishStreamedCubes(const std::function<bool(const StreamedCube &)> & stillLoaded) {
+    if (!stageInFlight) {
+        return;
+    }
+    stageInFlight = false;
+    auto & stage = uploadStages[currentStage];
+    currentStage = (currentStage + 1) % uploadStages.size();
+    stage.preparation.waitForFinished();
+    ctx.makeCurrent(&surface);
+    QElapsedTimer timer;
+    timer.start();
+    const auto cubeBytes = static_cast<std::size_t>(stage.gpucubeedge) * stage.gpucubeedge * stage.gpucubeedge;
+    const bool pixelBuffer = stage.mapped != nullptr;
+    if (pixelBuffer) {
+        stage.mapped = nullptr;
+        stage.buffer.bind();
+        const auto intact = stage.buffer.unmap();
+        stage.buffer.release();
+        if (!intact) {// the buffer contents got lost, the cubes are requested again in the next frame
+            stage.cubes.clear();
+            return;
+        }
+    }
+    for (std::size_t i = 0; i < stage.cubes.size(); ++i) {
+        const auto & cube = stage.cubes[i];
+        uploadMetrics.prepareNs += cube.prepareNs;
+        if (textures.find(cube.gpuCoord) != std::end(textures) || !stillLoaded(cube)) {
+            ++uploadMetrics.dropped;
+            continue;
+        }
+        auto & texture = residentCube<gpu_raw_cube>(cube.gpuCoord, stage.gpucubeedge);// may allocate storage, the buffer mustn’t be bound yet
+        if (pixelBuffer) {// with a bound pixel unpack buffer the data pointer is an offset into it
+            stage.buffer.bind();
+            texture.upload(reinterpret_cast<const void *>(cubeBytes * i));
+            stage.buffer.release();
+        } else {
+            texture.upload(stage.hostBuffer.data() + cubeBytes * i);
+        }
+        ++uploadMetrics.cubes;
     }
+    stage.cubes.clear();
+    uploadMetrics.uploadNs += timer.nsecsElapsed();
+    uploadMetrics.streamingNs += stage.sinceDispatch.nsecsElapsed();
 }
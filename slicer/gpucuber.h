@@ -24,15 +24,19 @@
 #define GPUCUBER_H
 
 #include "coordinate.h"
+#include "hashtable.h"
 
+#include <QElapsedTimer>
+#include <QFuture>
 #include <QOffscreenSurface>
+#include <QOpenGLBuffer>
 #include <QOpenGLContext>
 #include <QOpenGLTexture>
 #include <QVector3D>
 
 #include <boost/functional/hash.hpp>
-#include <boost/multi_array/multi_array_ref.hpp>
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -49,29 +53,77 @@ struct hash<QVector3D> {
 }
 
 class gpu_raw_cube {
+protected:
+    void allocateCube(const int gpucubeedge, const QOpenGLTexture::TextureFormat format, const QOpenGLTexture::Filter filter);
 public:
     QOpenGLTexture cube{QOpenGLTexture::Target3D};
     std::vector<floatCoordinate> vertices;
+    std::uint64_t lastUse{0};// frame in which the cube was last drawn or filled
     gpu_raw_cube(const int gpucubeedge, const bool index = false);
     virtual ~gpu_raw_cube() {}
-    std::vector<char> prepare(boost::multi_array_ref<std::uint8_t, 3>::const_array_view<3>::type view);
-    void upload(const std::vector<char> & data);
-    void generate(boost::multi_array_ref<std::uint8_t, 3>::const_array_view<3>::type view);
+    virtual void reset();// before the texture is reused for another cube
+    // copies the gpucubeedge³ sub cube at offset into dst, row by row
+    static void prepare(const std::uint8_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset, std::uint8_t * dst);
+    void upload(const void * data);// host memory or an offset into the bound pixel unpack buffer
+    void generate(const std::uint8_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset);
 };
 
-class gpu_lut_cube : public gpu_raw_cube {
+/**
+ * @brief OverlayColorTable is the color lookup shared by all overlay cubes of a layer.
+ *
+ * Every subobject id shown in a cube gets a slot, the texture holds the current color of each slot
+ * in rows of width texels. When the segmentation changes, the colors of all slots are computed again
+ * and only rows with different colors are uploaded, the cubes stay as they are.
+ * Slots are counted per resident cube and handed out again once no cube shows their id anymore.
+ */
+class OverlayColorTable {
+    std::unordered_map<std::uint64_t, std::uint32_t> slots;
+    std::vector<std::uint64_t> ids;// per slot
+    std::vector<std::uint32_t> references;// per slot, cubes containing its id
+    std::vector<std::uint32_t> freeSlots;
+    std::vector<std::array<std::uint8_t, 4>> colors;// per slot, padded to whole rows
+    int allocatedRows{0};
+    int dirtyBegin{0}, dirtyEnd{0};// rows
+    bool stale{false};
+    static std::array<std::uint8_t, 4> color(const std::uint64_t subobjectId);
 public:
-    using gpu_index = std::uint16_t;
-private:
-    std::unordered_map<std::uint64_t, gpu_index> id_to_lut_index;
-    gpu_index highest_index = 0;
-    std::vector<std::array<std::uint8_t, 4>> colors;
+    static constexpr int width = 1024;
+    // the luts could address 24 bit, but the texture is limited to 4096 rows (the usual max texture size)
+    static constexpr std::uint32_t maxSlots = width * 4096;
+    QOpenGLTexture texture{QOpenGLTexture::Target2D};
+
+    std::uint32_t slot(const std::uint64_t subobjectId);// takes a reference
+    void release(const std::uint32_t slot);
+    std::size_t size() const {// slots in use
+        return ids.size() - freeSlots.size();
+    }
+    void clear();
+    void invalidate() {// recompute all colors before the next upload
+        stale = true;
+    }
+    void upload();// needs a current ctx
+};
+
+class gpu_lut_cube : public gpu_raw_cube {
+    std::vector<std::uint32_t> slots;// color table slot per index
+    OverlayColorTable * colorTable{nullptr};// holding the slots
+    int indexBytes{2};
 public:
-    QOpenGLTexture lut{QOpenGLTexture::Target1D};
+    QOpenGLTexture lut{QOpenGLTexture::Target2D};// index → color table slot in rgb
+    static constexpr int lutWidth = 1024;
     gpu_lut_cube(const int gpucubeedge);
-    std::vector<gpu_index> prepare(boost::multi_array_ref<uint64_t, 3>::const_array_view<3>::type view);
-    void upload(const std::vector<gpu_index> & data);
-    void generate(boost::multi_array_ref<std::uint64_t, 3>::const_array_view<3>::type view);
+    void reset() override;// releases the color table slots
+    // the cube holds indices into its own lut, which are 8, 16 or 32 bit depending on how many ids it contains
+    struct Indexed {
+        std::vector<std::uint32_t> indices;// per voxel
+        std::vector<std::uint64_t> ids;// per index
+    };
+    // touches neither the color table nor the segmentation, so it may run on any thread
+    static Indexed prepare(const std::uint64_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset);
+    void upload(const Indexed & indexed, OverlayColorTable & colorTable);// takes the color table slots of the ids
+    void generate(const std::uint64_t * cube, const int cpucubeedge, const int gpucubeedge, const Coordinate & offset, OverlayColorTable & colorTable);
+    // turns the normalized red and green channels of the cube back into an index
+    std::array<float, 2> indexFactor() const;
 };
 
 class TextureLayer {
@@ -87,12 +139,78 @@ public:
     std::vector<std::pair<CoordOfGPUCube, Coordinate>> pendingArbCubes;
     TextureLayer(QOpenGLContext & sharectx);
     ~TextureLayer();
-    template<typename cube_type, typename elem_type>
-    void createBogusCube(const int cpucubeedge, const int gpucubeedge);
+    OverlayColorTable colorTable;// for overlay layers
     void createBogusCube(const int cpucubeedge, const int gpucubeedge);
-    template<typename cube_type, typename elem_type>
-    void cubeSubArray(const boost::const_multi_array_ref<elem_type, 3> cube, const int gpucubeedge, const CoordOfGPUCube gpuCoord, const Coordinate offset);
-    void cubeSubArray(const void * data, const int cpucubeedge, const int gpucubeedge, const CoordOfGPUCube gpuCoord, const Coordinate offset);
+    void updateColorTable();
+
+    // raw cubes are streamed: one frame prepares them on the thread pool into a mapped pixel unpack buffer,
+    // the next one uploads them from there while the following batch is prepared in the other buffer
+    struct StreamedCube {
+        CoordOfGPUCube gpuCoord;
+        CoordOfCube cubeCoord;
+        int magnification;
+        const std::uint8_t * cube;
+        Coordinate offset;
+        qint64 prepareNs;
+    };
+    static constexpr std::size_t cubesPerStage = 32;
+    // pin was taken before the cubes were looked up, the preparation holds it until they are copied
+    void streamCubes(std::shared_ptr<CubeHash::Pin> pin, std::vector<StreamedCube> cubes, const int cpucubeedge, const int gpucubeedge);
+    // stillLoaded tells whether the cube wasn’t unloaded or replaced during the preparation
+    void finishStreamedCubes(const std::function<bool(const StreamedCube &)> & stillLoaded);
+    // overlay cubes are indexed on the thread pool while the caller waits, the colors of their ids
+    // are then looked up on the calling thread, which owns the color table
+    void indexCubes(const std::vector<StreamedCube> & cubes, const int cpucubeedge, const int gpucubeedge);
+
+    // textures are pooled: cubes leaving the supercube are recycled and at capacity
+    // the least recently drawn resident cube (the farthest one of those) is evicted for a new one
+    std::size_t textureCapacity{2048};
+    void setTextureCapacity(const std::size_t capacity);
+    void advanceFrame(const CoordOfGPUCube & center);
+    void touch(gpu_raw_cube & cube) const {
+        cube.lastUse = frame;
+    }
+    void recycle(const CoordOfGPUCube & gpuCoord);
+    std::size_t pooledTextures() const {
+        return freeCubes.size();
+    }
+    struct ResidencyMetrics {
+        std::size_t allocations{0};// new texture objects
+        std::size_t reuses{0};// pooled texture objects filled with another cube
+        std::size_t evictions{0};// resident cubes replaced at capacity
+        std::size_t recycled{0};// cubes which left the supercube
+    } residencyMetrics;
+
+    struct UploadMetrics {
+        std::size_t cubes{0};// uploaded through the stages
+        std::size_t dropped{0};// unloaded before their upload
+        qint64 streamingNs{0};// from dispatching stages until their upload, cubes per second is cubes / streamingNs
+        qint64 prepareNs{0};// summed over the pool threads
+        qint64 uploadNs{0};// on the gl thread
+        bool pixelBuffers{false};// false if the stages fell back to host memory
+    } uploadMetrics;
+private:
+    std::uint64_t frame{0};
+    CoordOfGPUCube center;
+    std::vector<std::unique_ptr<gpu_raw_cube>> freeCubes;
+    decltype(textures)::iterator evictionCandidate(const CoordOfGPUCube * keep);// nullptr to consider all
+    template<typename cube_type>
+    cube_type & residentCube(const CoordOfGPUCube & gpuCoord, const int gpucubeedge);
+
+    struct UploadStage {
+        QOpenGLBuffer buffer{QOpenGLBuffer::PixelUnpackBuffer};
+        std::vector<std::uint8_t> hostBuffer;// if pixel buffer objects aren’t available
+        std::uint8_t * mapped{nullptr};
+        std::vector<StreamedCube> cubes;
+        int gpucubeedge;
+        QFuture<void> preparation;
+        QElapsedTimer sinceDispatch;
+    };
+    // double buffered: only one stage is in flight while the other one is uploaded,
+    // the buffer storage is orphaned before mapping so the gpu may still read the previous contents
+    std::array<UploadStage, 2> uploadStages;
+    std::size_t currentStage{0};
+    bool stageInFlight{false};
 };
 
 #endif//GPUCUBER_H
@@ -0,0 +1,326 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "obliqueslicer.h"
+
+#include "functions.h"
+#include "kernelbench.h"
+
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+constexpr int fractionBits = 24;
+constexpr std::int64_t one = std::int64_t{1} << fractionBits;
+constexpr int rowsPerJob = 16;
+
+using Fixed = std::array<std::int64_t, 3>;
+
+std::array<double, 3> components(const floatCoordinate & coord) {
+    return {{coord.x, coord.y, coord.z}};
+}
+
+Fixed toFixed(const std::array<double, 3> & coord, const std::int64_t offset = 0) {
+    return {{std::llround(coord[0] * one) + offset, std::llround(coord[1] * one) + offset, std::llround(coord[2] * one) + offset}};
+}
+
+std::int64_t floorDiv(const std::int64_t value, const std::int64_t divisor) {
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+std::uint32_t black() {
+    std::uint32_t pixel;
+    const std::uint8_t bytes[] = {0, 0, 0, 255};
+    std::memcpy(&pixel, bytes, sizeof(pixel));
+    return pixel;
+}
+
+void fill(std::uint8_t * dst, const std::uint32_t pixel, const std::int64_t n) {
+    for (std::int64_t i{0}; i < n; ++i, dst += 4) {
+        std::memcpy(dst, &pixel, 4);
+    }
+}
+
+// remembers the last cube, runs and interpolation neighborhoods mostly stay in it
+class CachedLookup {
+    const ObliqueSlicer::CubeLookup & lookup;
+    std::array<std::int64_t, 3> cube;
+    const std::uint8_t * data{nullptr};
+    bool valid{false};
+public:
+    CachedLookup(const ObliqueSlicer::CubeLookup & lookup) : lookup(lookup) {}
+    const std::uint8_t * operator()(const std::array<std::int64_t, 3> & cubeCoord) {
+        if (!valid || cubeCoord != cube) {
+            cube = cubeCoord;
+            data = lookup(CoordOfCube(static_cast<int>(cube[0]), static_cast<int>(cube[1]), static_cast<int>(cube[2])));
+            valid = true;
+        }
+        return data;
+    }
+};
+
+// the per pixel loop ObliqueSlicer replaced, slices column by column with float stepping
+void referenceSliceExtract(const std::uint8_t * datacube, floatCoordinate & currentPxInDc_float, std::uint8_t * slice, const int s, int & t, const floatCoordinate & v2, const int cubeEdgeLen, const int size) {
+    Coordinate currentPxInDc = {roundFloat(currentPxInDc_float.x), roundFloat(currentPxInDc_float.y), roundFloat(currentPxInDc_float.z)};
+    if ((currentPxInDc.x < 0) || (currentPxInDc.y < 0) || (currentPxInDc.z < 0) ||
+        (currentPxInDc.x >= cubeEdgeLen) || (currentPxInDc.y >= cubeEdgeLen) || (currentPxInDc.z >= cubeEdgeLen)) {
+        const int sliceIndex = 4 * (s + t * size);
+        slice[sliceIndex] = slice[sliceIndex + 1] = slice[sliceIndex + 2] = 0;
+        slice[sliceIndex + 3] = 255;
+        ++t;
+        currentPxInDc_float -= v2;
+        return;
+    }
+    while ((0 <= currentPxInDc.x && currentPxInDc.x < cubeEdgeLen)
+           && (0 <= currentPxInDc.y && currentPxInDc.y < cubeEdgeLen)
+           && (0 <= currentPxInDc.z && currentPxInDc.z < cubeEdgeLen)) {
+        const int sliceIndex = 4 * (s + t * size);
+        const int dcIndex = currentPxInDc.x + currentPxInDc.y * cubeEdgeLen + currentPxInDc.z * cubeEdgeLen * cubeEdgeLen;
+        if (datacube == nullptr) {
+            slice[sliceIndex] = slice[sliceIndex + 1] = slice[sliceIndex + 2] = 0;
+        } else {
+            slice[sliceIndex] = slice[sliceIndex + 1] = slice[sliceIndex + 2] = datacube[dcIndex];
+        }
+        slice[sliceIndex + 3] = 255;
+        ++t;
+        if (t >= size) {
+            break;
+        }
+        currentPxInDc_float -= v2;
+        currentPxInDc = {roundFloat(currentPxInDc_float.x), roundFloat(currentPxInDc_float.y), roundFloat(currentPxInDc_float.z)};
+    }
+}
+
+void referenceSlice(const ObliqueSlicer::CubeLookup & lookup, const ObliqueSlicer::Plane & plane, std::uint8_t * slice, const int size, const int cubeEdgeLen) {
+    const auto v1 = plane.right;
+    const auto v2 = plane.down * -1.f;
+    auto rowPx_float = plane.origin;
+    for (int s{0}; s < size; ++s, rowPx_float += v1) {
+        auto currentPx_float = rowPx_float;
+        for (int t{0}; t < size;) {
+            const Coordinate currentPx = {roundFloat(currentPx_float.x), roundFloat(currentPx_float.y), roundFloat(currentPx_float.z)};
+            Coordinate currentDc = currentPx / cubeEdgeLen;
+            if (currentPx.x < 0) { currentDc.x -= 1; }
+            if (currentPx.y < 0) { currentDc.y -= 1; }
+            if (currentPx.z < 0) { currentDc.z -= 1; }
+            const auto * datacube = lookup({currentDc.x, currentDc.y, currentDc.z});
+            auto currentPxInDc_float = currentPx_float - currentDc * cubeEdgeLen;
+            const auto t_old = t;
+            referenceSliceExtract(datacube, currentPxInDc_float, slice, s, t, v2, cubeEdgeLen, size);
+            currentPx_float = currentPx_float - v2 * (t - t_old);
+        }
+    }
+}
+}
+
+ObliqueSlicer::ObliqueSlicer(CubeLookup lookup, const int cubeEdgeLength)
+    : lookup(std::move(lookup)), cubeEdge(cubeEdgeLength), cubeSliceArea(static_cast<std::size_t>(cubeEdgeLength) * cubeEdgeLength) {}
+
+void ObliqueSlicer::extractSlice(const Plane & plane, std::uint8_t * dst, const std::size_t dstPitch, const int size, const SliceKernels::Lut & lut, const bool trilinear) const {
+    std::vector<std::pair<int, int>> jobs;
+    for (int row{0}; row < size; row += rowsPerJob) {
+        jobs.emplace_back(row, std::min(size, row + rowsPerJob));
+    }
+    QtConcurrent::blockingMap(jobs, [&](const std::pair<int, int> & job){
+        extractRows(plane, dst, dstPitch, size, lut, trilinear, job.first, job.second);
+    });
+}
+
+void ObliqueSlicer::extractRows(const Plane & plane, std::uint8_t * dst, const std::size_t dstPitch, const int size, const SliceKernels::Lut & lut, const bool trilinear, const int rowBegin, const int rowEnd) const {
+    for (int row{rowBegin}; row < rowEnd; ++row) {
+        if (trilinear) {
+            trilinearRow(plane, row, dst + row * dstPitch, size, lut);
+        } else {
+            nearestRow(plane, row, dst + row * dstPitch, size, lut);
+        }
+    }
+}
+
+void ObliqueSlicer::nearestRow(const Plane & plane, const int row, std::uint8_t * dst, const int size, const SliceKernels::Lut & lut) const {
+    const auto origin = components(plane.origin);
+    const auto down = components(plane.down);
+    const auto step = toFixed(components(plane.right));
+    // + ½ so truncating yields the nearest voxel
+    auto pos = toFixed({{origin[0] + down[0] * row, origin[1] + down[1] * row, origin[2] + down[2] * row}}, one / 2);
+    const std::array<std::int64_t, 3> strides{{1, cubeEdge, static_cast<std::int64_t>(cubeSliceArea)}};
+    const auto cubeSize = cubeEdge * one;
+    CachedLookup cachedLookup(lookup);
+    for (std::int64_t s{0}; s < size;) {
+        std::array<std::int64_t, 3> cube;
+        auto run = size - s;
+        for (std::size_t axis{0}; axis < 3; ++axis) {
+            cube[axis] = floorDiv(pos[axis], cubeSize);
+            // steps until the voxel leaves the cube through a face of this axis
+            if (step[axis] > 0) {
+                run = std::min(run, ((cube[axis] + 1) * cubeSize - pos[axis] + step[axis] - 1) / step[axis]);
+            } else if (step[axis] < 0) {
+                run = std::min(run, (pos[axis] - cube[axis] * cubeSize) / -step[axis] + 1);
+            }
+        }
+        const auto * data = cachedLookup(cube);
+        if (data == nullptr) {
+            fill(dst + 4 * s, black(), run);
+        } else {
+            Fixed local;
+            bool wholeSteps{true};
+            std::int64_t stride{0};
+            for (std::size_t axis{0}; axis < 3; ++axis) {
+                local[axis] = pos[axis] - cube[axis] * cubeSize;
+                wholeSteps = wholeSteps && step[axis] % one == 0;
+                stride += step[axis] / one * strides[axis];
+            }
+            const auto * src = data + (local[0] >> fractionBits) + (local[1] >> fractionBits) * strides[1] + (local[2] >> fractionBits) * strides[2];
+            if (wholeSteps && stride >= 0) {// axis aligned
+                SliceKernels::expandLut(src, static_cast<std::size_t>(stride), dst + 4 * s, static_cast<std::size_t>(run), lut);
+            } else {
+                auto * out = dst + 4 * s;
+                for (std::int64_t i{0}; i < run; ++i, out += 4) {
+                    const auto index = (local[0] >> fractionBits) + (local[1] >> fractionBits) * strides[1] + (local[2] >> fractionBits) * strides[2];
+                    std::memcpy(out, &lut[data[index]], 4);
+                    local[0] += step[0];
+                    local[1] += step[1];
+                    local[2] += step[2];
+                }
+            }
+        }
+        for (std::size_t axis{0}; axis < 3; ++axis) {
+            pos[axis] += run * step[axis];
+        }
+        s += run;
+    }
+}
+
+void ObliqueSlicer::trilinearRow(const Plane & plane, const int row, std::uint8_t * dst, const int size, const SliceKernels::Lut & lut) const {
+    const auto origin = components(plane.origin);
+    const auto down = components(plane.down);
+    const auto step = toFixed(components(plane.right));
+    auto pos = toFixed({{origin[0] + down[0] * row, origin[1] + down[1] * row, origin[2] + down[2] * row}});
+    const std::array<std::int64_t, 3> strides{{1, cubeEdge, static_cast<std::int64_t>(cubeSliceArea)}};
+    CachedLookup cachedLookup(lookup);
+    CachedLookup neighborLookup(lookup);
+    for (int s{0}; s < size; ++s, dst += 4) {
+        std::array<std::int64_t, 3> voxel, cube, inCube, weight;
+        bool interior{true};// all 8 neighbors are in the same cube
+        for (std::size_t axis{0}; axis < 3; ++axis) {
+            voxel[axis] = floorDiv(pos[axis], one);
+            weight[axis] = (pos[axis] - voxel[axis] * one) >> (fractionBits - 8);// 0 … 255
+            cube[axis] = floorDiv(voxel[axis], cubeEdge);
+            inCube[axis] = voxel[axis] - cube[axis] * cubeEdge;
+            interior = interior && inCube[axis] + 1 < cubeEdge;
+            pos[axis] += step[axis];
+        }
+        const auto * data = cachedLookup(cube);
+        if (data == nullptr) {
+            fill(dst, black(), 1);
+            continue;
+        }
+        const auto * base = data + inCube[0] + inCube[1] * strides[1] + inCube[2] * strides[2];
+        std::array<std::uint32_t, 8> values;// x varies fastest
+        if (interior) {
+            const auto y = strides[1];
+            const auto z = strides[2];
+            values = {{base[0], base[1], base[y], base[y + 1], base[z], base[z + 1], base[z + y], base[z + y + 1]}};
+        } else {// neighbors in unloaded cubes repeat the base voxel
+            for (std::size_t corner{0}; corner < values.size(); ++corner) {
+                std::array<std::int64_t, 3> neighbor, neighborCube;
+                for (std::size_t axis{0}; axis < 3; ++axis) {
+                    neighbor[axis] = voxel[axis] + ((corner >> axis) & 1);
+                    neighborCube[axis] = floorDiv(neighbor[axis], cubeEdge);
+                    neighbor[axis] -= neighborCube[axis] * cubeEdge;
+                }
+                const auto * neighborData = neighborCube == cube ? data : neighborLookup(neighborCube);
+                values[corner] = neighborData != nullptr ? neighborData[neighbor[0] + neighbor[1] * strides[1] + neighbor[2] * strides[2]] : *base;
+            }
+        }
+        const auto lerp = [](const std::uint32_t lhs, const std::uint32_t rhs, const std::uint32_t weight){
+            return lhs * (256 - weight) + rhs * weight;
+        };
+        const auto wx = static_cast<std::uint32_t>(weight[0]);
+        const auto wy = static_cast<std::uint32_t>(weight[1]);
+        const auto wz = static_cast<std::uint32_t>(weight[2]);
+        const auto front = lerp(lerp(values[0], values[1], wx), lerp(values[2], values[3], wx), wy);
+        const auto back = lerp(lerp(values[4], values[5], wx), lerp(values[6], values[7], wx), wy);
+        const auto sum = lerp(front, back, wz);// 255 · 2²⁴ at most
+        std::memcpy(dst, &lut[(sum + (1u << 23)) >> 24], 4);
+    }
+}
+
+std::vector<ObliqueSlicer::BenchmarkResult> ObliqueSlicer::benchmark(const std::vector<int> & sizes, const int repetitions) {
+    const int edge = 128;
+    std::vector<std::uint8_t> cube(static_cast<std::size_t>(edge) * edge * edge);
+    for (std::size_t i{0}; i < cube.size(); ++i) {
+        cube[i] = static_cast<std::uint8_t>(i * 2654435761u >> 24);
+    }
+    const CubeLookup lookup = [&cube](const CoordOfCube & coord) -> const std::uint8_t * {// every loaded cube has the same content
+        return (coord.x + coord.y) % 4 != 3 ? cube.data() : nullptr;
+    };
+    const ObliqueSlicer slicer(lookup, edge);
+    const auto lut = SliceKernels::grayLut();
+    const std::vector<std::pair<QString, Plane>> planes{
+        {"XY", {{1000.3f, 2000.7f, 3000.2f}, {1, 0, 0}, {0, 1, 0}}},
+        {"oblique", {{1000.3f, 2000.7f, 3000.2f}, {.8f, .36f, .48f}, {-.6f, .48f, .64f}}}
+    };
+    std::vector<BenchmarkResult> results;
+    for (const auto size : sizes) {
+        std::vector<std::uint8_t> texture(4 * static_cast<std::size_t>(size) * size);
+        for (const auto & plane : planes) {
+            const auto measure = [&](const QString & kernel, auto run){
+                QElapsedTimer timer;
+                timer.start();
+                for (int i{0}; i < repetitions; ++i) {
+                    run();
+                }
+                results.push_back({size, kernel, plane.first, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions)});
+            };
+            measure("reference", [&](){
+                referenceSlice(lookup, plane.second, texture.data(), size, edge);
+            });
+            measure("nearest", [&](){
+                slicer.extractSlice(plane.second, texture.data(), 4 * size, size, lut, false);
+            });
+            measure("trilinear", [&](){
+                slicer.extractSlice(plane.second, texture.data(), 4 * size, size, lut, true);
+            });
+        }
+    }
+    return results;
+}
+
+namespace {
+const KernelBench::Registration registration{"oblique slicing", 100, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : ObliqueSlicer::benchmark({256, 512, 1024}, repetitions)) {
+        results.append(QVariantMap{{"size", result.size}
+            , {"kernel", result.kernel}
+            , {"plane", result.plane}
+            , {"ns_per_slice", result.nsPerSlice}});
+    }
+    return results;
+}};
+}
@@ -0,0 +1,77 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef OBLIQUESLICER_H
+#define OBLIQUESLICER_H
+
+#include "coordinate.h"
+#include "slicer/slicekernels.h"
+
+#include <QString>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief ObliqueSlicer resamples 8 bit cubes along an arbitrary plane into RGBA textures.
+ *
+ * Positions are stepped in 40.24 fixed point. Each texture row is split into runs that stay inside one cube
+ * (the points where the row crosses a cube face are computed up front), so every run needs one cube lookup
+ * and no per pixel bounds checks. Rows are sliced in parallel, the lookup has to be thread-safe.
+ */
+class ObliqueSlicer {
+public:
+    using CubeLookup = std::function<const std::uint8_t *(const CoordOfCube &)>;// nullptr if the cube isn’t loaded
+
+    struct Plane {
+        floatCoordinate origin;// sampled by pixel (0, 0), in voxels of the sliced mag
+        floatCoordinate right;// step per column
+        floatCoordinate down;// step per row
+    };
+
+    ObliqueSlicer(CubeLookup lookup, const int cubeEdgeLength);
+
+    // fills a size² RGBA texture with dstPitch bytes per row, pixels in missing cubes are black
+    void extractSlice(const Plane & plane, std::uint8_t * dst, const std::size_t dstPitch, const int size, const SliceKernels::Lut & lut, const bool trilinear) const;
+    void extractRows(const Plane & plane, std::uint8_t * dst, const std::size_t dstPitch, const int size, const SliceKernels::Lut & lut, const bool trilinear, const int rowBegin, const int rowEnd) const;
+
+    struct BenchmarkResult {
+        int size;// texture edge length
+        QString kernel;// "reference" for the per pixel loop this replaced, "nearest" or "trilinear"
+        QString plane;// "XY" (axis aligned) or "oblique"
+        double nsPerSlice;
+    };
+    // slices a synthetic cube grid with cube edge length 128
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & sizes, const int repetitions);
+private:
+    CubeLookup lookup;
+    int cubeEdge;
+    std::size_t cubeSliceArea;
+
+    void nearestRow(const Plane & plane, const int row, std::uint8_t * dst, const int size, const SliceKernels::Lut & lut) const;
+    void trilinearRow(const Plane & plane, const int row, std::uint8_t * dst, const int size, const SliceKernels::Lut & lut) const;
+};
+
+#endif//OBLIQUESLICER_H
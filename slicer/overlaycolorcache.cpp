@@ -0,0 +1,252 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "overlaycolorcache.h"
+
+#include "kernelbench.h"
+#include "segmentation/segmentation.h"
+#include "slicekernels.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstring>
+
+const OverlayColorCache::Entry & OverlayColorCache::lookup(const std::uint64_t subobjectId) {
+    auto it = entries.find(subobjectId);
+    if (it == std::end(entries)) {
+        const auto & seg = Segmentation::singleton();
+        const auto color = seg.colorObjectFromSubobjectId(subobjectId);
+        const std::uint8_t bytes[] = {std::get<0>(color), std::get<1>(color), std::get<2>(color), std::get<3>(color)};
+        Entry entry{0, seg.isSubObjectIdSelected(subobjectId), seg.tryLargestObjectContainingSubobject(subobjectId)};
+        std::memcpy(&entry.rgba, bytes, sizeof(entry.rgba));
+        it = entries.emplace(subobjectId, entry).first;
+    }
+    return it->second;
+}
+
+std::atomic<std::uint64_t> OverlayColorCache::generation{0};
+
+void OverlayColorCache::invalidate() {
+    ++generation;
+}
+
+void OverlayColorCache::clear() {
+    validGeneration = generation;
+    recentEntries.fill({});
+    entries.clear();
+}
+
+std::size_t OverlayColorCache::size() const {
+    return entries.size();
+}
+
+void OverlayColorCache::extractSlice(const std::uint64_t * cube, const std::size_t rowStride, const std::size_t voxelStride, std::uint8_t * dst, const std::size_t dstPitch, const int edge
+                                     , const int rowBegin, const int rowEnd, const int colBegin, const int colEnd, const SliceKernels::Isa isa) {
+    if (validGeneration != generation || entries.size() > maxEntries) {
+        clear();
+    }
+    const auto & seg = Segmentation::singleton();
+    const std::size_t width = edge;
+    const std::size_t area = width * width;
+    // ids of the tile in texture order
+    const std::uint64_t * tile = cube;
+    if (rowStride != width || voxelStride != 1) {
+        ids.resize(area);
+        for (std::size_t row{0}; row < width; ++row) {
+            const auto * src = cube + row * rowStride;
+            auto * out = ids.data() + row * width;
+            if (voxelStride == 1) {
+                std::copy(src, src + width, out);
+            } else {
+                for (std::size_t col{0}; col < width; ++col, src += voxelStride) {
+                    out[col] = *src;
+                }
+            }
+        }
+        tile = ids.data();
+    }
+
+    const bool objectBorders = seg.highlightBorder && seg.hoverVersion;
+    if (objectBorders) {
+        objectIds.resize(area);
+    }
+    // runs of equal ids are common, so only look up changes
+    auto previousId = tile[0];
+    const Entry * entry = &(*this)[previousId];
+    for (std::size_t row{0}, i{0}; row < width; ++row) {
+        auto * line = dst + row * dstPitch;
+        for (std::size_t col{0}; col < width; ++col, ++i) {
+            if (tile[i] != previousId) {
+                previousId = tile[i];
+                entry = &(*this)[previousId];
+            }
+            std::memcpy(line + 4 * col, &entry->rgba, sizeof(entry->rgba));
+            if (objectBorders) {
+                objectIds[i] = entry->objectId;
+            }
+        }
+    }
+
+    // enhance alpha of selected voxels if any of the surrounding voxels belong to another subobject (or object in hover mode)
+    if (seg.highlightBorder) {
+        const auto * compared = objectBorders ? objectIds.data() : tile;
+        borders.resize(width);
+        for (std::size_t row{1}; row + 1 < width; ++row) {
+            SliceKernels::rowBorders(compared + (row - 1) * width, compared + row * width, compared + (row + 1) * width, borders.data(), width, isa);
+            for (std::size_t col{1}; col + 1 < width; ++col) {
+                if (!borders[col]) {
+                    continue;
+                }
+                const auto i = row * width + col;
+                if (tile[i] != previousId) {
+                    previousId = tile[i];
+                    entry = &(*this)[previousId];
+                }
+                if (entry->selected && (!objectBorders || entry->objectId == seg.mouseFocusedObjectId)) {
+                    auto & alpha = dst[row * dstPitch + 4 * col + 3];
+                    alpha = std::min(255, alpha * 4);
+                }
+            }
+        }
+    }
+
+    // hide everything outside of the movement area
+    for (int row{0}; row < edge; ++row) {
+        auto * line = dst + dstPitch * row;
+        if (row < rowBegin || row >= rowEnd || colBegin >= colEnd) {
+            std::fill(line, line + 4 * width, 0);
+            continue;
+        }
+        std::fill(line, line + 4 * colBegin, 0);
+        std::fill(line + 4 * colEnd, line + 4 * width, 0);
+    }
+}
+
+namespace {
+// the per voxel lookups the cache replaced, for comparison
+void referenceSliceExtract(const std::uint64_t * datacube, std::uint8_t * slice, const int cubeEdgeLen, const bool zy) {
+    auto & seg = Segmentation::singleton();
+    const std::size_t cubeSliceArea = cubeEdgeLen * cubeEdgeLen;
+    const std::size_t voxelIncrement = zy ? cubeEdgeLen : 1;
+    const std::size_t sliceIncrement = zy ? cubeSliceArea : cubeEdgeLen;
+    const std::size_t texNextLine = zy ? cubeEdgeLen * 4 : 4;
+    const std::size_t texRevertToFirstLine = zy ? (cubeSliceArea - 1) * 4 : 0;
+    uint64_t subobjectIdCache = seg.getBackgroundId();
+    bool selectedCache = seg.isSubObjectIdSelected(subobjectIdCache);
+    auto colorCache = seg.colorObjectFromSubobjectId(subobjectIdCache);
+    const std::size_t min = cubeEdgeLen;
+    const std::size_t max = cubeEdgeLen * (cubeEdgeLen - 1);
+    std::size_t counter = 0;
+    for (auto y = cubeEdgeLen; y != 0; --y) {
+        for (auto x = cubeEdgeLen; x != 0; --x) {
+            const uint64_t subobjectId = datacube[0];
+            const auto color = (subobjectIdCache == subobjectId) ? colorCache : seg.colorObjectFromSubobjectId(subobjectId);
+            slice[0] = std::get<0>(color);
+            slice[1] = std::get<1>(color);
+            slice[2] = std::get<2>(color);
+            slice[3] = std::get<3>(color);
+            const bool selected = (subobjectIdCache == subobjectId) ? selectedCache : seg.isSubObjectIdSelected(subobjectId);
+            const bool inside = counter >= min && counter < max && counter % cubeEdgeLen != 0 && (counter + 1) % cubeEdgeLen != 0;
+            if (seg.highlightBorder && inside) {
+                if (seg.hoverVersion) {
+                    const auto objectId = seg.tryLargestObjectContainingSubobject(subobjectId);
+                    if (selected && seg.mouseFocusedObjectId == objectId) {
+                        if (objectId != seg.tryLargestObjectContainingSubobject(*(datacube - voxelIncrement))
+                                || objectId != seg.tryLargestObjectContainingSubobject(*(datacube + voxelIncrement))
+                                || objectId != seg.tryLargestObjectContainingSubobject(*(datacube - sliceIncrement))
+                                || objectId != seg.tryLargestObjectContainingSubobject(*(datacube + sliceIncrement))) {
+                            slice[3] = std::min(255, slice[3] * 4);
+                        }
+                    }
+                } else if (selected) {
+                    if (subobjectId != *(datacube - voxelIncrement) || subobjectId != *(datacube + voxelIncrement)
+                            || subobjectId != *(datacube - sliceIncrement) || subobjectId != *(datacube + sliceIncrement)) {
+                        slice[3] = std::min(255, slice[3] * 4);
+                    }
+                }
+            }
+            subobjectIdCache = subobjectId;
+            colorCache = color;
+            selectedCache = selected;
+            ++counter;
+            datacube += voxelIncrement;
+            slice += texNextLine;
+        }
+        slice -= texRevertToFirstLine;
+    }
+}
+}
+
+std::vector<OverlayColorCache::BenchmarkResult> OverlayColorCache::benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions) {
+    std::vector<BenchmarkResult> results;
+    for (const auto edge : cubeEdgeLengths) {
+        const std::size_t width = edge;
+        std::vector<std::uint64_t> cube(width * width * width);
+        std::vector<std::uint8_t> tile(4 * width * width);
+        for (const int distinctIds : {16, 4096}) {
+            // supervoxels of 4³ voxels
+            for (std::size_t i{0}; i < cube.size(); ++i) {
+                const std::uint64_t block = (i % width) / 4 + (i / width % width) / 4 * width + (i / width / width) / 4 * width * width;
+                cube[i] = 1 + (block * 2654435761u >> 8) % distinctIds;
+            }
+            for (const bool zy : {false, true}) {
+                const auto measure = [&](const QString & kernel, auto run){
+                    QElapsedTimer timer;
+                    timer.start();
+                    for (int i{0}; i < repetitions; ++i) {
+                        run();
+                    }
+                    results.push_back({edge, kernel, zy ? "ZY" : "XY", distinctIds, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions)});
+                };
+                measure("reference", [&](){
+                    referenceSliceExtract(cube.data(), tile.data(), edge, zy);
+                });
+                for (const auto isa : {SliceKernels::Isa::Scalar, SliceKernels::Isa::SSE2, SliceKernels::Isa::AVX2}) {
+                    if (isa > SliceKernels::detected()) {
+                        continue;
+                    }
+                    OverlayColorCache colors;// filled by the first repetition, like by the first cube of a frame
+                    measure(SliceKernels::name(isa), [&](){
+                        colors.extractSlice(cube.data(), width, zy ? width * width : 1, tile.data(), 4 * width, edge, 0, edge, 0, edge, isa);
+                    });
+                }
+            }
+        }
+    }
+    return results;
+}
+
+namespace {
+const KernelBench::Registration registration{"overlay slicing", 100, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : OverlayColorCache::benchmark({32, 64, 128, 256}, repetitions)) {
+        results.append(QVariantMap{{"cube_edge_length", result.cubeEdgeLength}
+            , {"kernel", result.kernel}
+            , {"plane", result.plane}
+            , {"distinct_ids", result.distinctIds}
+            , {"ns_per_cube", result.nsPerCube}});
+    }
+    return results;
+}};
+}
@@ -0,0 +1,96 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef OVERLAYCOLORCACHE_H
+#define OVERLAYCOLORCACHE_H
+
+#include "slicekernels.h"
+
+#include <QString>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief OverlayColorCache holds what the overlay slicing needs to know about each subobject id
+ * and turns cube slices of segmentation ids into RGBA tiles with it.
+ *
+ * Entries are valid until the segmentation changes (Viewer::segmentation_changed invalidates all caches),
+ * so a frame only asks the Segmentation once for every id it shows.
+ * Instances aren’t thread-safe, slicing threads each use their own while Viewer::sliceOrthoViewports waits for them.
+ */
+class OverlayColorCache {
+public:
+    struct Entry {
+        std::uint32_t rgba;// in memory order
+        bool selected;
+        std::uint64_t objectId;// largest object containing the subobject, 0 if there is none
+    };
+    // cleared before the next slice, noisy supervoxel data can touch a lot of ids
+    static constexpr std::size_t maxEntries = 1 << 20;
+    // all instances are cleared before their next slice
+    static void invalidate();
+
+    const Entry & operator[](const std::uint64_t subobjectId) {
+        auto & recent = recentEntries[(subobjectId * 0x9E3779B97F4A7C15ull) >> (64 - recentBits)];
+        if (recent.first != subobjectId || recent.second == nullptr) {
+            recent = {subobjectId, &lookup(subobjectId)};
+        }
+        return *recent.second;
+    }
+    void clear();
+    std::size_t size() const;
+
+    // fills an edge² RGBA tile with dstPitch bytes per row, voxels outside rows/columns [begin, end) are transparent
+    void extractSlice(const std::uint64_t * cube, const std::size_t rowStride, const std::size_t voxelStride, std::uint8_t * dst, const std::size_t dstPitch, const int edge
+                      , const int rowBegin, const int rowEnd, const int colBegin, const int colEnd, const SliceKernels::Isa isa = SliceKernels::active());
+
+    struct BenchmarkResult {
+        int cubeEdgeLength;
+        QString kernel;// the isa or "reference" for the per voxel lookups the cache replaced
+        QString plane;// "XY" (contiguous rows) or "ZY" (strided rows)
+        int distinctIds;// per cube slice
+        double nsPerCube;
+    };
+    // uses the current segmentation with synthetic cubes
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions);
+private:
+    static std::atomic<std::uint64_t> generation;
+    std::uint64_t validGeneration{generation};
+    std::unordered_map<std::uint64_t, Entry> entries;
+    // direct mapped in front of entries, a hash map lookup per voxel would be as slow as asking the Segmentation
+    static constexpr int recentBits = 12;
+    std::array<std::pair<std::uint64_t, const Entry *>, 1 << recentBits> recentEntries{};
+    const Entry & lookup(const std::uint64_t subobjectId);
+    // per tile scratch
+    std::vector<std::uint64_t> ids;
+    std::vector<std::uint64_t> objectIds;
+    std::vector<std::uint8_t> borders;
+};
+
+#endif//OVERLAYCOLORCACHE_H
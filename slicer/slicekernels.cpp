@@ -0,0 +1,352 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "slicekernels.h"
+
+#include "kernelbench.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SLICEKERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+std::atomic<SliceKernels::Isa> activeIsa{SliceKernels::detected()};// set from the main thread, read by the slicing threads
+
+std::uint32_t rgba(const std::uint8_t r, const std::uint8_t g, const std::uint8_t b) {
+    std::uint32_t pixel;
+    const std::uint8_t bytes[] = {r, g, b, 255};
+    std::memcpy(&pixel, bytes, sizeof(pixel));
+    return pixel;
+}
+
+void expandGrayScalar(const std::uint8_t * src, const std::size_t stride, std::uint8_t * dst, const std::size_t n) {
+    for (std::size_t i{0}; i < n; ++i, src += stride, dst += 4) {
+        dst[0] = dst[1] = dst[2] = *src;
+        dst[3] = 255;
+    }
+}
+
+void expandLutScalar(const std::uint8_t * src, const std::size_t stride, std::uint8_t * dst, const std::size_t n, const SliceKernels::Lut & lut) {
+    for (std::size_t i{0}; i < n; ++i, src += stride, dst += 4) {
+        std::memcpy(dst, &lut[*src], 4);
+    }
+}
+
+void rowBordersScalar(const std::uint64_t * above, const std::uint64_t * row, const std::uint64_t * below, std::uint8_t * borders, std::size_t i, const std::size_t end) {
+    for (; i < end; ++i) {
+        borders[i] = row[i] != row[i - 1] || row[i] != row[i + 1] || row[i] != above[i] || row[i] != below[i];
+    }
+}
+
+#ifdef SLICEKERNELS_X86
+__attribute__((target("sse2")))
+void expandGraySSE2(const std::uint8_t * src, std::uint8_t * dst, const std::size_t n) {
+    const auto alpha = _mm_set1_epi8(-1);
+    std::size_t i{0};
+    for (; i + 16 <= n; i += 16) {
+        const auto gray = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const auto grayGrayLow = _mm_unpacklo_epi8(gray, gray);// g0 g0 g1 g1 …
+        const auto grayGrayHigh = _mm_unpackhi_epi8(gray, gray);
+        const auto grayAlphaLow = _mm_unpacklo_epi8(gray, alpha);// g0 ff g1 ff …
+        const auto grayAlphaHigh = _mm_unpackhi_epi8(gray, alpha);
+        auto * out = reinterpret_cast<__m128i *>(dst + 4 * i);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(grayGrayLow, grayAlphaLow));// g0 g0 g0 ff g1 g1 g1 ff …
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(grayGrayLow, grayAlphaLow));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(grayGrayHigh, grayAlphaHigh));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(grayGrayHigh, grayAlphaHigh));
+    }
+    expandGrayScalar(src + i, 1, dst + 4 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+void expandGrayAVX2(const std::uint8_t * src, std::uint8_t * dst, const std::size_t n) {
+    const auto alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const auto gray = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        const auto pixels = _mm256_or_si256(_mm256_or_si256(gray, _mm256_slli_epi32(gray, 8)), _mm256_or_si256(_mm256_slli_epi32(gray, 16), alpha));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * i), pixels);
+    }
+    expandGrayScalar(src + i, 1, dst + 4 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+void expandLutAVX2(const std::uint8_t * src, std::uint8_t * dst, const std::size_t n, const SliceKernels::Lut & lut) {
+    std::size_t i{0};
+    for (; i + 8 <= n; i += 8) {
+        const auto indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+        const auto pixels = _mm256_i32gather_epi32(reinterpret_cast<const int *>(lut.data()), indices, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * i), pixels);
+    }
+    expandLutScalar(src + i, 1, dst + 4 * i, n - i, lut);
+}
+
+__attribute__((target("sse2")))
+__m128i equal64SSE2(const __m128i lhs, const __m128i rhs) {// SSE2 only compares 32 bit lanes
+    const auto equal32 = _mm_cmpeq_epi32(lhs, rhs);
+    return _mm_and_si128(equal32, _mm_shuffle_epi32(equal32, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+__attribute__((target("sse2")))
+void rowBordersSSE2(const std::uint64_t * above, const std::uint64_t * row, const std::uint64_t * below, std::uint8_t * borders, const std::size_t end) {
+    std::size_t i{1};
+    for (; i + 2 <= end; i += 2) {
+        const auto center = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        const auto left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i - 1));
+        const auto right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i + 1));
+        const auto top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + i));
+        const auto bottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(below + i));
+        const auto equal = _mm_and_si128(_mm_and_si128(equal64SSE2(center, left), equal64SSE2(center, right))
+                                       , _mm_and_si128(equal64SSE2(center, top), equal64SSE2(center, bottom)));
+        const auto mask = _mm_movemask_pd(_mm_castsi128_pd(equal));
+        borders[i] = (mask & 1) == 0;
+        borders[i + 1] = (mask & 2) == 0;
+    }
+    rowBordersScalar(above, row, below, borders, i, end);
+}
+
+__attribute__((target("avx2")))
+void rowBordersAVX2(const std::uint64_t * above, const std::uint64_t * row, const std::uint64_t * below, std::uint8_t * borders, const std::size_t end) {
+    std::size_t i{1};
+    for (; i + 4 <= end; i += 4) {
+        const auto center = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+        const auto left = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i - 1));
+        const auto right = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i + 1));
+        const auto top = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(above + i));
+        const auto bottom = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(below + i));
+        const auto equal = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi64(center, left), _mm256_cmpeq_epi64(center, right))
+                                          , _mm256_and_si256(_mm256_cmpeq_epi64(center, top), _mm256_cmpeq_epi64(center, bottom)));
+        const auto mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+        for (int lane{0}; lane < 4; ++lane) {
+            borders[i + lane] = (mask & (1 << lane)) == 0;
+        }
+    }
+    rowBordersScalar(above, row, below, borders, i, end);
+}
+#endif
+}
+
+SliceKernels::Isa SliceKernels::detected() {
+#ifdef SLICEKERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Isa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return Isa::SSE2;
+    }
+#endif
+    return Isa::Scalar;
+}
+
+SliceKernels::Isa SliceKernels::active() {
+    return activeIsa;
+}
+
+void SliceKernels::setActive(const Isa isa) {
+    activeIsa = std::min(isa, detected());
+}
+
+QString SliceKernels::name(const Isa isa) {
+    switch (isa) {
+    case Isa::AVX2: return "avx2";
+    case Isa::SSE2: return "sse2";
+    case Isa::Scalar: break;
+    }
+    return "scalar";
+}
+
+SliceKernels::Lut SliceKernels::grayLut() {
+    Lut lut;
+    for (std::size_t i{0}; i < lut.size(); ++i) {
+        lut[i] = rgba(i, i, i);
+    }
+    return lut;
+}
+
+SliceKernels::Lut SliceKernels::lut(const std::vector<std::tuple<std::uint8_t, std::uint8_t, std::uint8_t>> & table) {
+    Lut lut;
+    for (std::size_t i{0}; i < lut.size(); ++i) {
+        lut[i] = rgba(std::get<0>(table[i]), std::get<1>(table[i]), std::get<2>(table[i]));
+    }
+    return lut;
+}
+
+SliceKernels::Lut SliceKernels::darkened(const Lut & lut, const float factor) {
+    Lut dark;
+    for (std::size_t i{0}; i < lut.size(); ++i) {
+        std::uint8_t bytes[4];
+        std::memcpy(bytes, &lut[i], sizeof(bytes));
+        for (std::size_t channel{0}; channel < 3; ++channel) {
+            bytes[channel] *= factor;
+        }
+        std::memcpy(&dark[i], bytes, sizeof(bytes));
+    }
+    return dark;
+}
+
+void SliceKernels::expandGray(const std::uint8_t * src, const std::size_t stride, std::uint8_t * dst, const std::size_t n, const Isa isa) {
+#ifdef SLICEKERNELS_X86
+    if (stride == 1 && isa == Isa::AVX2) {
+        return expandGrayAVX2(src, dst, n);
+    } else if (stride == 1 && isa == Isa::SSE2) {
+        return expandGraySSE2(src, dst, n);
+    }
+#endif
+    expandGrayScalar(src, stride, dst, n);
+}
+
+void SliceKernels::expandLut(const std::uint8_t * src, const std::size_t stride, std::uint8_t * dst, const std::size_t n, const Lut & lut, const Isa isa) {
+#ifdef SLICEKERNELS_X86
+    if (stride == 1 && isa == Isa::AVX2) {// SSE2 has no gather
+        return expandLutAVX2(src, dst, n, lut);
+    }
+#endif
+    expandLutScalar(src, stride, dst, n, lut);
+}
+
+void SliceKernels::extractSlice(const std::uint8_t * cube, const std::size_t rowStride, const std::size_t voxelStride, std::uint8_t * dst, const std::size_t dstPitch, const int edge
+                                , const Lut * lut, const Lut & dark, const int rowBegin, const int rowEnd, const int colBegin, const int colEnd, const Isa isa) {
+    const auto inside = [voxelStride, lut, isa](const std::uint8_t * src, std::uint8_t * dst, const int n){
+        if (lut != nullptr) {
+            expandLut(src, voxelStride, dst, n, *lut, isa);
+        } else {
+            expandGray(src, voxelStride, dst, n, isa);
+        }
+    };
+    for (int row{0}; row < edge; ++row, cube += rowStride, dst += dstPitch) {
+        if (row < rowBegin || row >= rowEnd || colBegin >= colEnd) {
+            expandLut(cube, voxelStride, dst, edge, dark, isa);
+            continue;
+        }
+        expandLut(cube, voxelStride, dst, colBegin, dark, isa);
+        inside(cube + colBegin * voxelStride, dst + 4 * colBegin, colEnd - colBegin);
+        expandLut(cube + colEnd * voxelStride, voxelStride, dst + 4 * colEnd, edge - colEnd, dark, isa);
+    }
+}
+
+void SliceKernels::rowBorders(const std::uint64_t * above, const std::uint64_t * row, const std::uint64_t * below, std::uint8_t * borders, const std::size_t n, const Isa isa) {
+    if (n == 0) {
+        return;
+    }
+    borders[0] = borders[n - 1] = false;
+    if (n < 3) {
+        return;
+    }
+#ifdef SLICEKERNELS_X86
+    if (isa == Isa::AVX2) {
+        return rowBordersAVX2(above, row, below, borders, n - 1);
+    } else if (isa == Isa::SSE2) {
+        return rowBordersSSE2(above, row, below, borders, n - 1);
+    }
+#endif
+    rowBordersScalar(above, row, below, borders, 1, n - 1);
+}
+
+namespace {
+// the per voxel loop the kernels replaced, for comparison
+void referenceSliceExtract(const std::uint8_t * datacube, std::uint8_t * slice, const int cubeEdgeLen, const bool zy, const bool partlyInMovementArea, const int areaMin, const int areaMax, const float factor) {
+    const std::size_t cubeSliceArea = cubeEdgeLen * cubeEdgeLen;
+    const std::size_t voxelIncrement = zy ? cubeEdgeLen : 1;
+    const std::size_t texNextLine = zy ? cubeEdgeLen * 4 : 4;
+    const std::size_t texRevertToFirstLine = zy ? (cubeSliceArea - 1) * 4 : 0;
+    int offsetX = 0, offsetY = 0;
+    for (auto y = cubeEdgeLen; y != 0; --y) {
+        for (auto x = cubeEdgeLen; x != 0; --x) {
+            std::uint8_t r, g, b;
+            r = g = b = datacube[0];
+            if (partlyInMovementArea && (offsetY < areaMin || offsetY > areaMax || offsetX < areaMin || offsetX > areaMax)) {
+                r *= factor; g *= factor; b *= factor;
+            }
+            slice[0] = r;
+            slice[1] = g;
+            slice[2] = b;
+            slice[3] = 255;
+            datacube += voxelIncrement;
+            slice += texNextLine;
+            offsetX = (offsetX + 1) % cubeEdgeLen;
+            offsetY += (offsetX == 0) ? 1 : 0;
+        }
+        slice -= texRevertToFirstLine;
+    }
+}
+}
+
+std::vector<SliceKernels::BenchmarkResult> SliceKernels::benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions) {
+    std::vector<BenchmarkResult> results;
+    const auto dark = darkened(grayLut(), .8f);
+    for (const auto edge : cubeEdgeLengths) {
+        std::vector<std::uint8_t> cube(static_cast<std::size_t>(edge) * edge * edge);
+        for (std::size_t i{0}; i < cube.size(); ++i) {
+            cube[i] = static_cast<std::uint8_t>(i * 2654435761u >> 24);
+        }
+        std::vector<std::uint8_t> tile(4 * edge * edge);
+        for (const bool zy : {false, true}) {
+            for (const bool movementArea : {false, true}) {
+                const auto areaMin = movementArea ? edge / 4 : 0;
+                const auto areaMax = movementArea ? edge * 3 / 4 : edge - 1;
+                const auto measure = [&](const QString & kernel, auto run){
+                    QElapsedTimer timer;
+                    timer.start();
+                    for (int i{0}; i < repetitions; ++i) {
+                        run();
+                    }
+                    results.push_back({edge, kernel, zy ? "ZY" : "XY", movementArea, static_cast<double>(timer.nsecsElapsed()) / std::max(1, repetitions)});
+                };
+                measure("reference", [&](){
+                    referenceSliceExtract(cube.data(), tile.data(), edge, zy, movementArea, areaMin, areaMax, .8f);
+                });
+                for (const auto isa : {Isa::Scalar, Isa::SSE2, Isa::AVX2}) {
+                    if (isa > detected()) {
+                        continue;
+                    }
+                    measure(name(isa), [&](){
+                        extractSlice(cube.data(), edge, zy ? edge * edge : 1, tile.data(), 4 * edge, edge, nullptr, dark, areaMin, areaMax + 1, areaMin, areaMax + 1, isa);
+                    });
+                }
+            }
+        }
+    }
+    return results;
+}
+
+namespace {
+const KernelBench::Registration registration{"slice kernels", 100, [](const int repetitions){
+    QVariantList results;
+    for (const auto & result : SliceKernels::benchmark({32, 64, 128, 256}, repetitions)) {
+        results.append(QVariantMap{{"cube_edge_length", result.cubeEdgeLength}
+            , {"kernel", result.kernel}
+            , {"plane", result.plane}
+            , {"movement_area", result.movementArea}
+            , {"ns_per_cube", result.nsPerCube}});
+    }
+    return results;
+}};
+}
@@ -0,0 +1,79 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef SLICEKERNELS_H
+#define SLICEKERNELS_H
+
+#include <QString>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+/**
+ * @brief SliceKernels expand rows of 8 bit voxels into RGBA texture rows
+ * and find the object borders in rows of 64 bit segmentation ids.
+ *
+ * The source stride is constant per row (1 for XY and XZ rows, the cube slice area for ZY rows).
+ * SSE2 and AVX2 variants are picked at runtime, the scalar one is used everywhere else.
+ * The kernels use the active isa unless they are given one, so benchmarks don’t switch it under the slicing threads.
+ */
+class SliceKernels {
+public:
+    enum class Isa {
+        Scalar, SSE2, AVX2
+    };
+    using Lut = std::array<std::uint32_t, 256>;// RGBA pixels in memory order
+
+    static Isa detected();
+    static Isa active();
+    static void setActive(const Isa isa);// clamped to detected()
+    static QString name(const Isa isa);
+
+    static Lut grayLut();
+    static Lut lut(const std::vector<std::tuple<std::uint8_t, std::uint8_t, std::uint8_t>> & table);
+    static Lut darkened(const Lut & lut, const float factor);
+
+    // dst receives n RGBA pixels of the gray values src[0], src[stride], …
+    static void expandGray(const std::uint8_t * src, const std::size_t stride, std::uint8_t * dst, const std::size_t n, const Isa isa = active());
+    // dst receives n pixels lut[src[0]], lut[src[stride]], …
+    static void expandLut(const std::uint8_t * src, const std::size_t stride, std::uint8_t * dst, const std::size_t n, const Lut & lut, const Isa isa = active());
+    // fills an edge² RGBA tile with dstPitch bytes per row, voxels in rows/columns [begin, end) use lut (gray if nullptr), the others dark
+    static void extractSlice(const std::uint8_t * cube, const std::size_t rowStride, const std::size_t voxelStride, std::uint8_t * dst, const std::size_t dstPitch, const int edge
+                             , const Lut * lut, const Lut & dark, const int rowBegin, const int rowEnd, const int colBegin, const int colEnd, const Isa isa = active());
+    // borders[i] is set if row[i] differs from any of its 4 neighbors, the first and last column are never borders
+    static void rowBorders(const std::uint64_t * above, const std::uint64_t * row, const std::uint64_t * below, std::uint8_t * borders, const std::size_t n, const Isa isa = active());
+
+    struct BenchmarkResult {
+        int cubeEdgeLength;
+        QString kernel;// the isa or "reference" for the per voxel loop the kernels replaced
+        QString plane;// "XY" (contiguous rows) or "ZY" (strided rows)
+        bool movementArea;// whether half the cube is outside of the movement area
+        double nsPerCube;
+    };
+    static std::vector<BenchmarkResult> benchmark(const std::vector<int> & cubeEdgeLengths, const int repetitions);
+};
+
+#endif//SLICEKERNELS_H
@@ -0,0 +1,107 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#include "slotarena.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <algorithm>
+#include <new>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr std::size_t hugepageBytes = 2 * 1024 * 1024;
+}
+
+SlotArena::SlotArena(const std::size_t slotBytes, const std::size_t slotCount) : slotBytes{slotBytes}, slotCount{slotCount} {
+    const auto arenaBytes = std::max<std::size_t>(1, bytes());
+#ifdef Q_OS_LINUX
+    const auto roundedBytes = (arenaBytes + hugepageBytes - 1) / hugepageBytes * hugepageBytes;
+    auto * hugetlb = mmap(nullptr, roundedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (hugetlb != MAP_FAILED) {// only succeeds with reserved hugepages (vm.nr_hugepages)
+        memory = static_cast<std::uint8_t *>(hugetlb);
+        mappedBytes = roundedBytes;
+        backing = Backing::HugeTLB;
+    } else {
+        // over-map to align the arena to a hugepage boundary and return the surplus
+        auto * raw = mmap(nullptr, roundedBytes + hugepageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED) {
+            const auto rawAddress = reinterpret_cast<std::uintptr_t>(raw);
+            const auto alignedAddress = (rawAddress + hugepageBytes - 1) / hugepageBytes * hugepageBytes;
+            const auto head = alignedAddress - rawAddress;
+            const auto tail = hugepageBytes - head;
+            if (head > 0) {
+                munmap(raw, head);
+            }
+            if (tail > 0) {
+                munmap(reinterpret_cast<void *>(alignedAddress + roundedBytes), tail);
+            }
+            memory = reinterpret_cast<std::uint8_t *>(alignedAddress);
+            mappedBytes = roundedBytes;
+            backing = madvise(memory, mappedBytes, MADV_HUGEPAGE) == 0 ? Backing::TransparentHugepages : Backing::Regular;
+        }
+    }
+#endif
+    if (memory == nullptr) {
+        memory = new std::uint8_t[arenaBytes]();// zero init
+        backing = Backing::Regular;
+    }
+    qDebug() << "Allocated" << bytes() / 1024. / 1024. << "MiB for" << slotCount << "cubes backed by" << backingName();
+}
+
+SlotArena::~SlotArena() {
+#ifdef Q_OS_LINUX
+    if (mappedBytes != 0) {
+        munmap(memory, mappedBytes);
+        return;
+    }
+#endif
+    delete [] memory;
+}
+
+QString SlotArena::backingName() const {
+    switch (backing) {
+    case Backing::HugeTLB: return "hugetlb pages";
+    case Backing::TransparentHugepages: return "transparent hugepages";
+    case Backing::Regular: break;
+    }
+    return "regular pages";
+}
+
+std::size_t SlotArena::residentBytes() {
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        const auto fields = statm.readAll().split(' ');
+        if (fields.size() > 1) {
+            return fields[1].toULongLong() * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        }
+    }
+#endif
+    return 0;
+}
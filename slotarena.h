@@ -0,0 +1,75 @@
+/*
+ *  This file is a part of KNOSSOS.
+ *
+ *  (C) Copyright 2007-2016
+ *  Max-Planck-Gesellschaft zur Foerderung der Wissenschaften e.V.
+ *
+ *  KNOSSOS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 of
+ *  the License as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  For further information, visit https://knossostool.org
+ *  or contact knossos-team@mpimf-heidelberg.mpg.de
+ */
+
+
+#ifndef SLOTARENA_H
+#define SLOTARENA_H
+
+#include <QString>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief SlotArena is one contiguous, zero initialized allocation which is split into fixed-size cube slots.
+ *
+ * On Linux it tries to back the arena with 2 MiB pages (MAP_HUGETLB, then transparent hugepages via madvise)
+ * to reduce TLB misses while slicing, elsewhere or on failure it falls back to a regular allocation.
+ */
+class SlotArena {
+public:
+    enum class Backing {
+        HugeTLB, TransparentHugepages, Regular
+    };
+private:
+    std::uint8_t * memory{nullptr};
+    std::size_t mappedBytes{0};
+    std::size_t slotBytes;
+    std::size_t slotCount;
+    Backing backing{Backing::Regular};
+public:
+    SlotArena(const std::size_t slotBytes, const std::size_t slotCount);
+    ~SlotArena();
+    SlotArena(const SlotArena &) = delete;
+    SlotArena & operator=(const SlotArena &) = delete;
+
+    bool fits(const std::size_t slotBytes, const std::size_t slotCount) const {
+        return this->slotBytes == slotBytes && this->slotCount == slotCount;
+    }
+    void * slot(const std::size_t index) const {
+        return memory + index * slotBytes;
+    }
+    std::size_t size() const {
+        return slotCount;
+    }
+    std::size_t bytes() const {
+        return slotBytes * slotCount;
+    }
+    Backing backedBy() const {
+        return backing;
+    }
+    QString backingName() const;
+
+    static std::size_t residentBytes();// of the whole process, 0 if unknown
+};
+
+#endif//SLOTARENA_H
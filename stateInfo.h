@@ -84,10 +84,6 @@ public:
 
 // --- Inter-thread communication structures / signals / mutexes, etc. ---
 
-    // ANY access to the Dc2Pointer or Oc2Pointer tables has
-    // to be locked by this mutex.
-    QMutex protectCube2Pointer;
-
  //---  Info about the state of KNOSSOS in general. --------
 
     // Dc2Pointer and Oc2Pointer provide a mappings from cube
@@ -95,7 +91,8 @@ public:
     // into memory.
     // It is a set of key (cube coordinate) / value (pointer) pairs.
     // Whenever we access a datacube in memory, we do so through
-    // this structure.
+    // this structure. It synchronizes itself (see CubeHash), so
+    // no external locking is needed.
     std::vector<std::vector<coord2bytep_map_t>> cube2Pointer;
 
     struct ViewerState * viewerState;
@@ -28,6 +28,9 @@
 #include "segmentation/segmentation.h"
 #include "session.h"
 #include "skeleton/skeletonizer.h"
+#include "slicer/obliqueslicer.h"
+#include "slicer/overlaycolorcache.h"
+#include "slicer/slicekernels.h"
 #include "stateInfo.h"
 #include "widgets/mainwindow.h"
 #include "widgets/viewports/viewportbase.h"
@@ -36,10 +39,13 @@
 #include <QApplication>
 #include <QDebug>
 #include <QDesktopWidget>
+#include <QThread>
 #include <QVector3D>
+#include <QtConcurrent>
 
 #include <boost/container/static_vector.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <cmath>
 
@@ -64,6 +70,7 @@ Viewer::Viewer() : evilHack{[this](){ state->viewer = this; return true; }()} {
     QObject::connect(&Segmentation::singleton(), &Segmentation::resetData, this, &Viewer::segmentation_changed);
     QObject::connect(&Segmentation::singleton(), &Segmentation::resetSelection, this, &Viewer::segmentation_changed);
     QObject::connect(&Segmentation::singleton(), &Segmentation::renderOnlySelectedObjsChanged, this, &Viewer::segmentation_changed);
+    QObject::connect(&Segmentation::singleton(), &Segmentation::backgroundIdChanged, this, &Viewer::segmentation_changed);
 
     QObject::connect(&Session::singleton(), &Session::movementAreaChanged, this, [this](){
         updateCurrentPosition();
@@ -195,119 +202,40 @@ void Viewer::setMagnificationLock(const bool locked) {
     emit magnificationLockChanged(locked);
 }
 
-void Viewer::dcSliceExtract(std::uint8_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, ViewportOrtho & vp, bool useCustomLUT) {
+namespace {
+// voxels inside the movement area form one span per axis,
+// texture rows are y (XY, ZY) or z (XZ), texture columns are x (XY, XZ) or z (ZY)
+std::pair<std::pair<int, int>, std::pair<int, int>> movementAreaSpans(const ViewportOrtho & vp, const Coordinate & cubePosInAbsPx) {
     const auto & session = Session::singleton();
-    const Coordinate areaMinCoord = {session.movementAreaMin.x,
-                                     session.movementAreaMin.y,
-                                     session.movementAreaMin.z};
-    const Coordinate areaMaxCoord = {session.movementAreaMax.x,
-                                     session.movementAreaMax.y,
-                                     session.movementAreaMax.z};
     const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
-    const auto partlyInMovementArea =
-       areaMinCoord.x > cubePosInAbsPx.x || areaMaxCoord.x < cubePosInAbsPx.x + cubeEdgeLen * Dataset::current().magnification ||
-       areaMinCoord.y > cubePosInAbsPx.y || areaMaxCoord.y < cubePosInAbsPx.y + cubeEdgeLen * Dataset::current().magnification ||
-       areaMinCoord.z > cubePosInAbsPx.z || areaMaxCoord.z < cubePosInAbsPx.z + cubeEdgeLen * Dataset::current().magnification;
-
-    const std::size_t voxelIncrement = vp.viewportType == VIEWPORT_ZY ? cubeEdgeLen : 1;
-    const std::size_t sliceIncrement = vp.viewportType == VIEWPORT_XY ? cubeEdgeLen : state->cubeSliceArea;
-    const std::size_t sliceSubLineIncrement = vp.viewportType == VIEWPORT_ZY ? 0 : sliceIncrement - cubeEdgeLen;
-    const std::size_t texNextLine = vp.viewportType == VIEWPORT_ZY ? cubeEdgeLen * 4 : 4;// RGBA per pixel
-    const std::size_t texRevertToFirstLine = vp.viewportType == VIEWPORT_ZY ? (state->cubeSliceArea - 1) * 4 : 0;
-
-    int offsetX = 0, offsetY = 0;
-    const int coordsPerLine = cubeEdgeLen * Dataset::current().magnification;
-    for (auto y = cubeEdgeLen; y != 0; --y) {
-        for (auto x = cubeEdgeLen; x != 0; --x) {// x and y’s values are not used
-            uint8_t r, g, b;
-            if(useCustomLUT) {
-                //extract data as unsigned number from the datacube
-                const uint8_t adjustIndex = datacube[0];
-                r = std::get<0>(state->viewerState->datasetAdjustmentTable[adjustIndex]);
-                g = std::get<1>(state->viewerState->datasetAdjustmentTable[adjustIndex]);
-                b = std::get<2>(state->viewerState->datasetAdjustmentTable[adjustIndex]);
-            } else {
-                r = g = b = datacube[0];
-            }
-            if(partlyInMovementArea) {
-                bool factor = false;
-                if((vp.viewportType == VIEWPORT_XY && (cubePosInAbsPx.y + offsetY < areaMinCoord.y || cubePosInAbsPx.y + offsetY > areaMaxCoord.y)) ||
-                    ((vp.viewportType == VIEWPORT_XZ || vp.viewportType == VIEWPORT_ZY) && (cubePosInAbsPx.z + offsetY < areaMinCoord.z || cubePosInAbsPx.z + offsetY > areaMaxCoord.z))) {
-                    // vertically out of movement area
-                    factor = true;
-                }
-                else if(((vp.viewportType == VIEWPORT_XY || vp.viewportType == VIEWPORT_XZ) && (cubePosInAbsPx.x + offsetX < areaMinCoord.x || cubePosInAbsPx.x + offsetX > areaMaxCoord.x)) ||
-                        (vp.viewportType == VIEWPORT_ZY && (cubePosInAbsPx.y + offsetX < areaMinCoord.y || cubePosInAbsPx.y + offsetX > areaMaxCoord.y))) {
-                    // horizontally out of movement area
-                    factor = true;
-                }
-                if (factor) {
-                    float d = state->viewerState->outsideMovementAreaFactor * 1.0 / 100;
-                    r *= d; g *= d; b *= d;
-                }
-            }
-            slice[0] = r;
-            slice[1] = g;
-            slice[2] = b;
-            slice[3] = 255;
-
-            datacube += voxelIncrement;
-            slice += texNextLine;
-            offsetX = (offsetX + Dataset::current().magnification) % coordsPerLine;
-            offsetY += (offsetX == 0)? Dataset::current().magnification : 0; // at end of line increment to next line
-        }
-        datacube += sliceSubLineIncrement;
-        slice -= texRevertToFirstLine;
-    }
+    const auto magnification = Dataset::current().magnification;
+    const auto insideSpan = [cubeEdgeLen, magnification](const int cubeStart, const int areaMin, const int areaMax){
+        const int begin = std::min(cubeEdgeLen, areaMin <= cubeStart ? 0 : (areaMin - cubeStart + magnification - 1) / magnification);
+        const int end = std::min(cubeEdgeLen, areaMax < cubeStart ? 0 : (areaMax - cubeStart) / magnification + 1);
+        return std::make_pair(begin, std::max(begin, end));
+    };
+    const bool xz = vp.viewportType == VIEWPORT_XZ;
+    const bool zy = vp.viewportType == VIEWPORT_ZY;
+    const auto rows = xz ? insideSpan(cubePosInAbsPx.z, session.movementAreaMin.z, session.movementAreaMax.z)
+                         : insideSpan(cubePosInAbsPx.y, session.movementAreaMin.y, session.movementAreaMax.y);
+    const auto columns = zy ? insideSpan(cubePosInAbsPx.z, session.movementAreaMin.z, session.movementAreaMax.z)
+                            : insideSpan(cubePosInAbsPx.x, session.movementAreaMin.x, session.movementAreaMax.x);
+    return {rows, columns};
+}
 }
 
-void Viewer::dcSliceExtract(std::uint8_t * datacube, floatCoordinate *currentPxInDc_float, std::uint8_t * slice, int s, int *t, const floatCoordinate & v2, bool useCustomLUT, float usedSizeInCubePixels) {
-    Coordinate currentPxInDc = {roundFloat(currentPxInDc_float->x), roundFloat(currentPxInDc_float->y), roundFloat(currentPxInDc_float->z)};
+void Viewer::dcSliceExtract(std::uint8_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, const std::size_t slicePitch, const ViewportOrtho & vp, bool useCustomLUT) {
     const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
-    if((currentPxInDc.x < 0) || (currentPxInDc.y < 0) || (currentPxInDc.z < 0) ||
-       (currentPxInDc.x >= cubeEdgeLen) || (currentPxInDc.y >= cubeEdgeLen) || (currentPxInDc.z >= cubeEdgeLen)) {
-        const int sliceIndex = 3 * ( s + *t  *  cubeEdgeLen * state->M);
-        slice[sliceIndex] = slice[sliceIndex + 1] = slice[sliceIndex + 2] = 0;
-        slice[sliceIndex + 3] = 255;
-        (*t)++;
-        if(*t < usedSizeInCubePixels) {
-            // Actually, although currentPxInDc_float is passed by reference and updated here,
-            // it is totally ignored (i.e. not read, then overwritten) by the calling function.
-            // But to keep the functionality here compatible after this bugfix, we also replicate
-            // this update here - from the originial below
-            *currentPxInDc_float -= v2;
-        }
-        return;
-    }
-
-    while((0 <= currentPxInDc.x && currentPxInDc.x < cubeEdgeLen)
-          && (0 <= currentPxInDc.y && currentPxInDc.y < cubeEdgeLen)
-          && (0 <= currentPxInDc.z && currentPxInDc.z < cubeEdgeLen)) {
-
-        const int sliceIndex = 4 * ( s + *t  *  cubeEdgeLen * state->M);
-        const int dcIndex = currentPxInDc.x + currentPxInDc.y * cubeEdgeLen + currentPxInDc.z * state->cubeSliceArea;
-        if(datacube == NULL) {
-            slice[sliceIndex] = slice[sliceIndex + 1] = slice[sliceIndex + 2] = 0;
-        } else {
-            if(useCustomLUT) {
-                //extract data as unsigned number from the datacube
-                const unsigned char adjustIndex = datacube[dcIndex];
-                slice[sliceIndex + 0] = std::get<0>(state->viewerState->datasetAdjustmentTable[adjustIndex]);
-                slice[sliceIndex + 1] = std::get<1>(state->viewerState->datasetAdjustmentTable[adjustIndex]);
-                slice[sliceIndex + 2] = std::get<2>(state->viewerState->datasetAdjustmentTable[adjustIndex]);
-            }
-            else {
-                slice[sliceIndex] = slice[sliceIndex + 1] = slice[sliceIndex + 2] = datacube[dcIndex];
-            }
-        }
-        slice[sliceIndex + 3] = 255;
-        (*t)++;
-        if(*t >= usedSizeInCubePixels) {
-            break;
-        }
-        *currentPxInDc_float -= v2;
-        currentPxInDc = {roundFloat(currentPxInDc_float->x), roundFloat(currentPxInDc_float->y), roundFloat(currentPxInDc_float->z)};
-    }
+    const std::size_t rowIncrement = vp.viewportType == VIEWPORT_XZ ? state->cubeSliceArea : cubeEdgeLen;
+    const std::size_t voxelIncrement = vp.viewportType == VIEWPORT_ZY ? state->cubeSliceArea : 1;
+    // the rest is darkened
+    const auto spans = movementAreaSpans(vp, cubePosInAbsPx);
+    const auto & rows = spans.first;
+    const auto & columns = spans.second;
+
+    const auto lut = useCustomLUT ? SliceKernels::lut(state->viewerState->datasetAdjustmentTable) : SliceKernels::grayLut();
+    const auto dark = SliceKernels::darkened(lut, state->viewerState->outsideMovementAreaFactor * 1.0 / 100);
+    SliceKernels::extractSlice(datacube, rowIncrement, voxelIncrement, slice, slicePitch, cubeEdgeLen, useCustomLUT ? &lut : nullptr, dark, rows.first, rows.second, columns.first, columns.second);
 }
 
 /**
@@ -316,133 +244,178 @@ void Viewer::dcSliceExtract(std::uint8_t * datacube, floatCoordinate *currentPxI
  * @param datacube pointer to the datacube for data extraction
  * @param cubePosInAbsPx smallest coordinates inside the datacube in dataset pixels
  * @param slice pointer to a slice in which to draw the overlay
+ * @param slicePitch bytes per row of slice
  *
- * In the first pass all pixels are filled with the color corresponding the subObject-ID.
- * In the second pass the datacube is traversed again to find edge voxels, i.e. all voxels
- * where at least one of their neighbors (left, right, top, bot) have a different ID than their own.
- * The opacity of these voxels is slightly increased to highlight the edges.
- *
- * Before extraction we determine if the cube is partly outside of the movement area in which case
- * each pixel is tested for its position and is omitted if outside of the area.
- *
+ * Colors, selection and objects of the IDs come from a per thread OverlayColorCache, which is only cleared when the segmentation changes.
+ * Edge voxels, i.e. all voxels where at least one of their neighbors (left, right, top, bot) has a different ID,
+ * are found row by row and their opacity is increased to highlight the edges.
+ * Pixels outside of the movement area are transparent.
  */
-void Viewer::ocSliceExtract(std::uint64_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, ViewportOrtho & vp) {
-    const auto & session = Session::singleton();
-    const Coordinate areaMinCoord = {session.movementAreaMin.x,
-                                     session.movementAreaMin.y,
-                                     session.movementAreaMin.z};
-    const Coordinate areaMaxCoord = {session.movementAreaMax.x,
-                                     session.movementAreaMax.y,
-                                     session.movementAreaMax.z};
+void Viewer::ocSliceExtract(std::uint64_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, const std::size_t slicePitch, const ViewportOrtho & vp) {
+    thread_local OverlayColorCache overlayColors;
+    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
+    const std::size_t rowIncrement = vp.viewportType == VIEWPORT_XZ ? state->cubeSliceArea : cubeEdgeLen;
+    const std::size_t voxelIncrement = vp.viewportType == VIEWPORT_ZY ? state->cubeSliceArea : 1;
+    const auto spans = movementAreaSpans(vp, cubePosInAbsPx);
+    overlayColors.extractSlice(datacube, rowIncrement, voxelIncrement, slice, slicePitch, cubeEdgeLen, spans.first.first, spans.first.second, spans.second.first, spans.second.second);
+}
+
+namespace {
+// cubes per texture axis of the toroidal ortho textures, 0 if the cubes don’t tile the texture (then the texture starts at leftUpperPxInAbsPx)
+int ringSlots(const ViewportOrtho & vp) {
+    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
+    if (vp.viewportType == VIEWPORT_ARBITRARY || vp.texture.size % cubeEdgeLen != 0 || vp.texture.size / cubeEdgeLen < state->M) {
+        return 0;
+    }
+    return vp.texture.size / cubeEdgeLen;
+}
+}
+
+void Viewer::sliceOrthoViewports(const std::vector<ViewportOrtho *> & vps) {
+    // Extract the slices of all relevant datacubes into the staging buffers of the viewports.
+    // Every slot remembers what it holds, only those whose cube entered the ring, changed or moved to another slice position
+    // are sliced, those of all viewports and layers in parallel.
+    // The upload happens in vpGenerateTexture.
     const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
-    const auto partlyInMovementArea =
-       areaMinCoord.x > cubePosInAbsPx.x || areaMaxCoord.x < cubePosInAbsPx.x + cubeEdgeLen * Dataset::current().magnification ||
-       areaMinCoord.y > cubePosInAbsPx.y || areaMaxCoord.y < cubePosInAbsPx.y + cubeEdgeLen * Dataset::current().magnification ||
-       areaMinCoord.z > cubePosInAbsPx.z || areaMaxCoord.z < cubePosInAbsPx.z + cubeEdgeLen * Dataset::current().magnification;
-
-    const std::size_t voxelIncrement = vp.viewportType == VIEWPORT_ZY ? cubeEdgeLen : 1;
-    const std::size_t sliceIncrement = vp.viewportType == VIEWPORT_XY ? cubeEdgeLen : state->cubeSliceArea;
-    const std::size_t sliceSubLineIncrement = vp.viewportType == VIEWPORT_ZY ? 0 : sliceIncrement - cubeEdgeLen;
-    const std::size_t texNextLine = vp.viewportType == VIEWPORT_ZY ? cubeEdgeLen * 4 : 4;// RGBA per pixel
-    const std::size_t textRevertToFirstLine = vp.viewportType == VIEWPORT_ZY ? (state->cubeSliceArea - 1) * 4 : 0;
-
-    auto & seg = Segmentation::singleton();
-    //cache
-    uint64_t subobjectIdCache = Segmentation::singleton().getBackgroundId();
-    bool selectedCache = seg.isSubObjectIdSelected(subobjectIdCache);
-    std::tuple<uint8_t, uint8_t, uint8_t, uint8_t> colorCache = seg.colorObjectFromSubobjectId(subobjectIdCache);
-    //first and last row boundaries
-    const std::size_t min = cubeEdgeLen;
-    const std::size_t max = cubeEdgeLen * (cubeEdgeLen - 1);
-    std::size_t counter = 0;//slice position
-    int offsetX = 0, offsetY = 0; // current texel's horizontal and vertical dataset pixel offset inside cube
-    const int coordsPerLine = cubeEdgeLen * Dataset::current().magnification;
-    for (auto y = cubeEdgeLen; y != 0; --y) {
-        for (auto x = cubeEdgeLen; x != 0; --x) {// x and y’s values are not used
-            bool hide = false;
-            if(partlyInMovementArea) {
-                if((vp.viewportType == VIEWPORT_XY && (cubePosInAbsPx.y + offsetY < areaMinCoord.y || cubePosInAbsPx.y + offsetY > areaMaxCoord.y)) ||
-                    ((vp.viewportType == VIEWPORT_XZ || vp.viewportType == VIEWPORT_ZY) && (cubePosInAbsPx.z + offsetY < areaMinCoord.z || cubePosInAbsPx.z + offsetY > areaMaxCoord.z))) {
-                    // vertically out of movement area
-                    slice[3] = 0;
-                    hide = true;
+    const CoordInCube currentPosition_dc = state->viewerState->currentPosition.insideCube(cubeEdgeLen, Dataset::current().magnification);
+
+    std::vector<std::pair<std::size_t, CoordOfCube>> changed;
+    std::vector<std::size_t> outdatedLayers;
+    {
+        QMutexLocker locker(&changedCubesMutex);
+        std::swap(changed, changedCubes);
+        std::swap(outdatedLayers, changedLayers);
+    }
+    window->forEachOrthoVPDo([&changed, &outdatedLayers](ViewportOrtho & vp) {// also for viewports which aren’t sliced now
+        for (const auto layerId : outdatedLayers) {
+            if (layerId < vp.staged.size()) {
+                for (auto & slot : vp.staged[layerId].slots) {
+                    slot.sliced = false;
                 }
-                else if(((vp.viewportType == VIEWPORT_XY || vp.viewportType == VIEWPORT_XZ) && (cubePosInAbsPx.x + offsetX < areaMinCoord.x || cubePosInAbsPx.x + offsetX > areaMaxCoord.x)) ||
-                        (vp.viewportType == VIEWPORT_ZY && (cubePosInAbsPx.y + offsetX < areaMinCoord.y || cubePosInAbsPx.y + offsetX > areaMaxCoord.y))) {
-                    // horizontally out of movement area
-                    slice[3] = 0;
-                    hide = true;
+            }
+        }
+        for (const auto & layerCube : changed) {
+            if (layerCube.first < vp.staged.size()) {
+                for (auto & slot : vp.staged[layerCube.first].slots) {
+                    slot.sliced = slot.sliced && slot.cube != layerCube.second;
                 }
             }
+        }
+    });
 
-            if(hide == false) {
-                const uint64_t subobjectId = datacube[0];
-
-                const auto color = (subobjectIdCache == subobjectId) ? colorCache : seg.colorObjectFromSubobjectId(subobjectId);
-                slice[0] = std::get<0>(color);
-                slice[1] = std::get<1>(color);
-                slice[2] = std::get<2>(color);
-                slice[3] = std::get<3>(color);
-
-                const bool selected = (subobjectIdCache == subobjectId) ? selectedCache : seg.isSubObjectIdSelected(subobjectId);
-                const bool isPastFirstRow = counter >= min;
-                const bool isBeforeLastRow = counter < max;
-                const bool isNotFirstColumn = counter % cubeEdgeLen != 0;
-                const bool isNotLastColumn = (counter + 1) % cubeEdgeLen != 0;
-
-                // highlight edges where needed
-                if(seg.highlightBorder) {
-                    if(seg.hoverVersion) {
-                        uint64_t objectId = seg.tryLargestObjectContainingSubobject(subobjectId);
-                        if (selected && seg.mouseFocusedObjectId == objectId) {
-                            if(isPastFirstRow && isBeforeLastRow && isNotFirstColumn && isNotLastColumn) {
-                                const uint64_t left   = seg.tryLargestObjectContainingSubobject(*reinterpret_cast<uint64_t*>(datacube - voxelIncrement));
-                                const uint64_t right  = seg.tryLargestObjectContainingSubobject(*reinterpret_cast<uint64_t*>(datacube + voxelIncrement));
-                                const uint64_t top    = seg.tryLargestObjectContainingSubobject(*reinterpret_cast<uint64_t*>(datacube - sliceIncrement));
-                                const uint64_t bottom = seg.tryLargestObjectContainingSubobject(*reinterpret_cast<uint64_t*>(datacube + sliceIncrement));
-                                //enhance alpha of this voxel if any of the surrounding voxels belong to another object
-                                if (objectId != left || objectId != right || objectId != top || objectId != bottom) {
-                                    slice[3] = std::min(255, slice[3]*4);
-                                }
-                            }
-                        }
+    struct SliceJob {
+        const ViewportOrtho * vp;
+        std::size_t layerId;
+        CoordOfCube currentDc;
+        int slicePositionWithinCube;
+        void * cube;// nullptr clears the slot
+        std::uint8_t * slice;
+        std::size_t slicePitch;
+    };
+    std::vector<SliceJob> jobs;
+    std::vector<std::unique_ptr<CubeHash::Pin>> pins;// the loader mustn’t reuse the slots until they are sliced
+    for (std::size_t layerId{0}; layerId < Dataset::datasets.size(); ++layerId) {
+        pins.emplace_back(new CubeHash::Pin(state->cube2Pointer[layerId][int_log(Dataset::current().magnification)]));
+    }
+    for (auto * vp : vps) {
+        int slicePositionWithinCube;
+        switch(vp->viewportType) {
+        case VIEWPORT_XY:
+            slicePositionWithinCube = state->cubeSliceArea * currentPosition_dc.z;
+            break;
+        case VIEWPORT_XZ:
+            slicePositionWithinCube = cubeEdgeLen * currentPosition_dc.y;
+            break;
+        case VIEWPORT_ZY:
+            slicePositionWithinCube = currentPosition_dc.x;
+            break;
+        default:
+            qDebug("No such slice view: %d.", vp->viewportType);
+            continue;
+        }
+        const auto ring = ringSlots(*vp);
+        const int slotsPerAxis = ring != 0 ? ring : state->M;
+        const int before = (slotsPerAxis - state->M) / 2;// ring cubes in front of the visible ones
+        const std::size_t texEdgeLen = ring != 0 ? vp->texture.size : state->M * cubeEdgeLen;
+        const std::size_t slicePitch = 4 * texEdgeLen;// RGBA
+        vp->staged.resize(Dataset::datasets.size());
+        for (std::size_t layerId{0}; layerId < Dataset::datasets.size(); ++layerId) {
+            auto & staged = vp->staged[layerId];
+            if (staged.slots.size() != static_cast<std::size_t>(slotsPerAxis * slotsPerAxis)) {
+                staged.slots = decltype(staged.slots)(slotsPerAxis * slotsPerAxis);
+            }
+            staged.texels.resize(slicePitch * texEdgeLen);
+            const CoordOfCube upperLeftDc = Coordinate(vp->texture.leftUpperPxInAbsPx).cube(cubeEdgeLen, Dataset::datasets[layerId].magnification);
+            // We iterate over the texture with x and y being in a temporary coordinate
+            // system local to this texture, the visible cubes are [0, M), the remaining ones fill the ring.
+            for(int x_dc = -before; x_dc < slotsPerAxis - before; x_dc++) {
+                for(int y_dc = -before; y_dc < slotsPerAxis - before; y_dc++) {
+                    CoordOfCube currentDc;
+                    // With an x/y-coordinate system in a viewport, we get the following
+                    // mapping from viewport (slice) coordinates to global (dc)
+                    // coordinates:
+                    // XY-slice: x local is x global, y local is y global
+                    // XZ-slice: x local is x global, y local is z global
+                    // ZY-slice: x local is z global, y local is y global.
+                    int texX, texY;
+                    if (vp->viewportType == VIEWPORT_XY) {
+                        currentDc = {upperLeftDc.x + x_dc, upperLeftDc.y + y_dc, upperLeftDc.z};
+                        texX = currentDc.x;
+                        texY = currentDc.y;
+                    } else if (vp->viewportType == VIEWPORT_XZ) {
+                        currentDc = {upperLeftDc.x + x_dc, upperLeftDc.y, upperLeftDc.z + y_dc};
+                        texX = currentDc.x;
+                        texY = currentDc.z;
+                    } else {
+                        currentDc = {upperLeftDc.x, upperLeftDc.y + y_dc, upperLeftDc.z + x_dc};
+                        texX = currentDc.z;
+                        texY = currentDc.y;
                     }
-                    else if (selected && isPastFirstRow && isBeforeLastRow && isNotFirstColumn && isNotLastColumn) {
-                        const uint64_t left   = datacube[-voxelIncrement];
-                        const uint64_t right  = datacube[+voxelIncrement];
-                        const uint64_t top    = datacube[-sliceIncrement];
-                        const uint64_t bottom = datacube[+sliceIncrement];
-                        //enhance alpha of this voxel if any of the surrounding voxels belong to another subobject
-                        if (subobjectId != left || subobjectId != right || subobjectId != top || subobjectId != bottom) {
-                            slice[3] = std::min(255, slice[3]*4);
+                    const int slotX = ring != 0 ? (texX % ring + ring) % ring : x_dc;
+                    const int slotY = ring != 0 ? (texY % ring + ring) % ring : y_dc;
+                    auto & slot = staged.slots[slotY * slotsPerAxis + slotX];
+                    // first texel of the datacube slice in its slot
+                    auto * slice = staged.texels.data() + slotY * cubeEdgeLen * slicePitch + slotX * cubeEdgeLen * 4;
+                    if (x_dc < 0 || y_dc < 0 || x_dc >= state->M || y_dc >= state->M) {
+                        // the repeating texture shows this slot around the visible cubes (e.g. through filtering),
+                        // so it keeps its cube only if that is the one which belongs there
+                        if (!slot.cleared && !(slot.sliced && slot.cube == currentDc && slot.slicePosition == slicePositionWithinCube)) {
+                            slot = {};
+                            slot.cleared = true;
+                            staged.dirty |= QRect(slotX, slotY, 1, 1);
+                            jobs.push_back({vp, layerId, currentDc, slicePositionWithinCube, nullptr, slice, slicePitch});
                         }
+                        continue;
                     }
+                    void * const cube = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[layerId][int_log(Dataset::current().magnification)], currentDc);
+                    if (slot.sliced && slot.cube == currentDc && slot.slicePosition == slicePositionWithinCube && slot.data == cube) {
+                        continue;
+                    }
+                    slot = {true, false, currentDc, slicePositionWithinCube, cube};
+                    staged.dirty |= QRect(slotX, slotY, 1, 1);
+                    jobs.push_back({vp, layerId, currentDc, slicePositionWithinCube, cube, slice, slicePitch});
                 }
-
-                //fill cache
-                subobjectIdCache = subobjectId;
-                colorCache = color;
-                selectedCache = selected;
             }
-            ++counter;
-            datacube += voxelIncrement;
-            slice += texNextLine;
-            offsetX = (offsetX + Dataset::current().magnification) % coordsPerLine;
-            offsetY += (offsetX == 0)? Dataset::current().magnification : 0; // at end of line increment to next line
         }
-        datacube += sliceSubLineIncrement;
-        slice -= textRevertToFirstLine;
     }
-}
-
-static int texIndex(uint x, uint y, uint colorMultiplicationFactor, viewportTexture *texture) {
-    uint index = 0;
 
-    index = x * state->cubeSliceArea + y
-            * (texture->size * Dataset::current().cubeEdgeLength)
-            * colorMultiplicationFactor;
-
-    return index;
+    QtConcurrent::blockingMap(jobs, [this, cubeEdgeLen](SliceJob & job){
+        const auto & dataset = Dataset::datasets[job.layerId];
+        if (job.cube == nullptr) {
+            for (int row{0}; row < cubeEdgeLen; ++row) {
+                std::fill_n(job.slice + row * job.slicePitch, 4 * cubeEdgeLen, 0);
+            }
+            return;
+        }
+        const Coordinate cubePosInAbsPx = {job.currentDc.x * dataset.magnification * cubeEdgeLen,
+                                           job.currentDc.y * dataset.magnification * cubeEdgeLen,
+                                           job.currentDc.z * dataset.magnification * cubeEdgeLen};
+        if (dataset.isOverlay()) {
+            ocSliceExtract(reinterpret_cast<std::uint64_t *>(job.cube) + job.slicePositionWithinCube, cubePosInAbsPx, job.slice, job.slicePitch, *job.vp);
+        } else {
+            dcSliceExtract(reinterpret_cast<std::uint8_t *>(job.cube) + job.slicePositionWithinCube, cubePosInAbsPx, job.slice, job.slicePitch, *job.vp, state->viewerState->datasetAdjustmentOn);
+        }
+    });
 }
 
 bool Viewer::vpGenerateTexture(ViewportOrtho & vp) {
@@ -452,94 +425,24 @@ bool Viewer::vpGenerateTexture(ViewportOrtho & vp) {
         vpGenerateTexture(static_cast<ViewportArb&>(vp));
         return true;
     }
+    sliceOrthoViewports({&vp});// whatever run didn’t slice already
     const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
-    const CoordInCube currentPosition_dc = state->viewerState->currentPosition.insideCube(cubeEdgeLen, Dataset::current().magnification);
-
-    int slicePositionWithinCube;
-    switch(vp.viewportType) {
-    case VIEWPORT_XY:
-        slicePositionWithinCube = state->cubeSliceArea * currentPosition_dc.z;
-        break;
-    case VIEWPORT_XZ:
-        slicePositionWithinCube = cubeEdgeLen * currentPosition_dc.y;
-        break;
-    case VIEWPORT_ZY:
-        slicePositionWithinCube = currentPosition_dc.x;
-        break;
-    default:
-        qDebug("No such slice view: %d.", vp.viewportType);
-        return false;
-    }
-
-    std::vector<std::uint8_t> texData(4 * std::pow(state->viewerState->texEdgeLength, 2));
-    // We iterate over the texture with x and y being in a temporary coordinate
-    // system local to this texture.
-    for (std::size_t layerId{0}; layerId < Dataset::datasets.size(); ++layerId) {
-        if (!vp.resliceNecessary[layerId]) {
+    const auto ring = ringSlots(vp);
+    const auto texEdgeLen = ring != 0 ? vp.texture.size : state->M * cubeEdgeLen;
+    for (std::size_t layerId{0}; layerId < vp.staged.size(); ++layerId) {
+        auto & staged = vp.staged[layerId];
+        if (staged.dirty.isNull()) {
             continue;
         }
-        vp.resliceNecessary[layerId] = false;
-        const CoordOfCube upperLeftDc = Coordinate(vp.texture.leftUpperPxInAbsPx).cube(cubeEdgeLen, Dataset::datasets[layerId].magnification);
-        for(int x_dc = 0; x_dc < state->M; x_dc++) {
-            for(int y_dc = 0; y_dc < state->M; y_dc++) {
-                const int x_px = x_dc * cubeEdgeLen;
-                const int y_px = y_dc * cubeEdgeLen;
-
-                CoordOfCube currentDc;
-
-                switch(vp.viewportType) {
-                // With an x/y-coordinate system in a viewport, we get the following
-                // mapping from viewport (slice) coordinates to global (dc)
-                // coordinates:
-                // XY-slice: x local is x global, y local is y global
-                // XZ-slice: x local is x global, y local is z global
-                // ZY-slice: x local is z global, y local is y global.
-                case VIEWPORT_XY:
-                    currentDc = {upperLeftDc.x + x_dc, upperLeftDc.y + y_dc, upperLeftDc.z};
-                    break;
-                case VIEWPORT_XZ:
-                    currentDc = {upperLeftDc.x + x_dc, upperLeftDc.y, upperLeftDc.z + y_dc};
-                    break;
-                case VIEWPORT_ZY:
-                    currentDc = {upperLeftDc.x, upperLeftDc.y + y_dc, upperLeftDc.z + x_dc};
-                    break;
-                default:
-                    qDebug("No such slice type (%d) in vpGenerateTexture.", vp.viewportType);
-                }
-                state->protectCube2Pointer.lock();
-                void * const cube = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[layerId][int_log(Dataset::current().magnification)], currentDc);
-                state->protectCube2Pointer.unlock();
-
-                // Take care of the data textures.
-                Coordinate cubePosInAbsPx = {currentDc.x * Dataset::datasets[layerId].magnification * cubeEdgeLen,
-                                             currentDc.y * Dataset::datasets[layerId].magnification * cubeEdgeLen,
-                                             currentDc.z * Dataset::datasets[layerId].magnification * cubeEdgeLen};
-                // This is used to index into the texture. overlayData[index] is the first
-                // byte of the datacube slice at position (x_dc, y_dc) in the texture.
-                const int index = texIndex(x_dc, y_dc, 4, &(vp.texture));
-
-                if (cube != nullptr) {
-                    if (Dataset::datasets[layerId].isOverlay()) {
-                        ocSliceExtract(reinterpret_cast<std::uint64_t *>(cube) + slicePositionWithinCube, cubePosInAbsPx, texData.data() + index, vp);
-                    } else {
-                        dcSliceExtract(reinterpret_cast<std::uint8_t *>(cube) + slicePositionWithinCube, cubePosInAbsPx, texData.data() + index, vp, state->viewerState->datasetAdjustmentOn);
-                    }
-                } else {
-                    std::fill(std::begin(texData), std::end(texData), 0);
-                }
-                vp.texture.texHandle[layerId].bind();
-                glTexSubImage2D(GL_TEXTURE_2D,
-                                0,
-                                x_px,
-                                y_px,
-                                cubeEdgeLen,
-                                cubeEdgeLen,
-                                GL_RGBA,
-                                GL_UNSIGNED_BYTE,
-                                texData.data() + index);
-                vp.texture.texHandle[layerId].release();
-            }
-        }
+        // one upload for the bounding rectangle of all sliced cubes of the layer
+        const auto & dirty = staged.dirty;
+        vp.texture.texHandle[layerId].bind();
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, texEdgeLen);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, dirty.x() * cubeEdgeLen, dirty.y() * cubeEdgeLen, dirty.width() * cubeEdgeLen, dirty.height() * cubeEdgeLen
+                        , GL_RGBA, GL_UNSIGNED_BYTE, staged.texels.data() + 4 * (dirty.y() * cubeEdgeLen * texEdgeLen + dirty.x() * cubeEdgeLen));
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        vp.texture.texHandle[layerId].release();
+        staged.dirty = QRect();
     }
     glBindTexture(GL_TEXTURE_2D, 0);
     return true;
@@ -663,50 +566,27 @@ void Viewer::setDefaultVPSizeAndPos(const bool on) {
 }
 
 void Viewer::vpGenerateTexture(ViewportArb &vp) {
+    const auto cubeEdgeLen = Dataset::current().cubeEdgeLength;
+    const auto texEdge = state->M * cubeEdgeLen;
+    const auto size = std::min(texEdge, static_cast<int>(std::ceil(vp.texture.usedSizeInCubePixels)));
+    // pixel (s, t) shows leftUpper + s·v1 - t·v2
+    const ObliqueSlicer::Plane plane{vp.texture.leftUpperPxInAbsPx / Dataset::current().magnification, vp.v1, vp.v2 * -1.f};
+    const auto lut = state->viewerState->datasetAdjustmentOn ? SliceKernels::lut(state->viewerState->datasetAdjustmentTable) : SliceKernels::grayLut();
+    const bool trilinear = viewerState.textureFilter == QOpenGLTexture::Linear;
     for (std::size_t layerId{0}; layerId < Dataset::datasets.size(); ++layerId) {
         if (Dataset::datasets[layerId].isOverlay() || !vp.resliceNecessary[layerId]) {
             continue;
         }
         vp.resliceNecessary[layerId] = false;
 
-        // Load the texture for a viewport by going through all relevant datacubes and copying slices
-        // from those cubes into the texture.
-        floatCoordinate currentPxInDc_float, rowPx_float, currentPx_float;
-
-        rowPx_float = vp.texture.leftUpperPxInAbsPx / Dataset::current().magnification;
-        currentPx_float = rowPx_float;
-
+        const auto & cubes = state->cube2Pointer[layerId][int_log(Dataset::datasets[layerId].magnification)];
+        const ObliqueSlicer slicer([&cubes](const CoordOfCube & cube){
+            return reinterpret_cast<const std::uint8_t *>(Coordinate2BytePtr_hash_get_or_fail(cubes, cube));
+        }, cubeEdgeLen);
         std::vector<std::uint8_t> texData(4 * std::pow(state->viewerState->texEdgeLength, 2));// RGBA
-
-        int s = 0, t = 0, t_old = 0;
-        while(s < vp.texture.usedSizeInCubePixels) {
-            t = 0;
-            while(t < vp.texture.usedSizeInCubePixels) {
-                Coordinate currentPx = {roundFloat(currentPx_float.x), roundFloat(currentPx_float.y), roundFloat(currentPx_float.z)};
-                Coordinate currentDc = currentPx / Dataset::current().cubeEdgeLength;
-
-                if(currentPx.x < 0) { currentDc.x -= 1; }
-                if(currentPx.y < 0) { currentDc.y -= 1; }
-                if(currentPx.z < 0) { currentDc.z -= 1; }
-
-                state->protectCube2Pointer.lock();
-                void * const datacube = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[layerId][int_log(Dataset::datasets[layerId].magnification)], {currentDc.x, currentDc.y, currentDc.z});
-                state->protectCube2Pointer.unlock();
-
-                currentPxInDc_float = currentPx_float - currentDc * Dataset::current().cubeEdgeLength;
-                t_old = t;
-
-                dcSliceExtract(reinterpret_cast<std::uint8_t *>(datacube),
-                               &currentPxInDc_float,
-                               texData.data(),
-                               s, &t,
-                               vp.v2,
-                               state->viewerState->datasetAdjustmentOn, vp.texture.usedSizeInCubePixels);
-                currentPx_float = currentPx_float - vp.v2 * (t - t_old);
-            }
-            s++;
-            rowPx_float += vp.v1;
-            currentPx_float = rowPx_float;
+        {
+            CubeHash::Pin pin(cubes);// the slicer reads the slots after looking them up
+            slicer.extractSlice(plane, texData.data(), 4 * texEdge, size, lut, trilinear);
         }
 
         vp.texture.texHandle[layerId].bind();
@@ -714,8 +594,8 @@ void Viewer::vpGenerateTexture(ViewportArb &vp) {
                         0,
                         0,
                         0,
-                        state->M*Dataset::current().cubeEdgeLength,
-                        state->M*Dataset::current().cubeEdgeLength,
+                        texEdge,
+                        texEdge,
                         GL_RGBA,
                         GL_UNSIGNED_BYTE,
                     texData.data());
@@ -877,30 +757,72 @@ void Viewer::run() {
     // might cancel the current loading process. When all textures
     // have been processed, we go into an idle state, in which we wait for events.
     if (state->gpuSlicer && gpuRendering) {
-        const auto & loadPendingCubes = [&](TextureLayer & layer, std::vector<std::pair<CoordOfGPUCube, Coordinate>> & pendingCubes, QElapsedTimer & timer) {
-            while (!pendingCubes.empty() && !timer.hasExpired(3)) {
-                const auto pair = pendingCubes.back();
-                pendingCubes.pop_back();
-                if (layer.textures.find(pair.first) == std::end(layer.textures)) {
-                    const auto globalCoord = pair.first.cube2Global(gpucubeedge, Dataset::current().magnification);
-                    const auto cubeCoord = globalCoord.cube(Dataset::current().cubeEdgeLength, Dataset::current().magnification);
-                    state->protectCube2Pointer.lock();
-                    const auto * ptr = Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[layer.isOverlayData][int_log(Dataset::current().magnification)], cubeCoord);
-                    state->protectCube2Pointer.unlock();
-                    if (ptr != nullptr) {
-                        layer.cubeSubArray(ptr, Dataset::current().cubeEdgeLength, gpucubeedge, pair.first, pair.second);
+        // pops up to count pending cubes which are loaded but not resident yet, the caller pins cube2Pointer before
+        const auto & takePendingCubes = [&](TextureLayer & layer, const CubeHash & cube2Pointer, const std::size_t count) {
+            std::vector<TextureLayer::StreamedCube> cubes;
+            for (auto * pendingCubes : {&layer.pendingOrthoCubes, &layer.pendingArbCubes}) {
+                while (!pendingCubes->empty() && cubes.size() < count) {
+                    const auto pair = pendingCubes->back();
+                    pendingCubes->pop_back();
+                    const auto queued = std::find_if(std::begin(cubes), std::end(cubes), [&pair](const TextureLayer::StreamedCube & cube){
+                        return cube.gpuCoord == pair.first;
+                    }) != std::end(cubes);
+                    if (!queued && layer.textures.find(pair.first) == std::end(layer.textures)) {
+                        const auto globalCoord = pair.first.cube2Global(gpucubeedge, Dataset::current().magnification);
+                        const auto cubeCoord = globalCoord.cube(Dataset::current().cubeEdgeLength, Dataset::current().magnification);
+                        const auto * ptr = Coordinate2BytePtr_hash_get_or_fail(cube2Pointer, cubeCoord);
+                        if (ptr != nullptr) {
+                            cubes.push_back({pair.first, cubeCoord, Dataset::current().magnification, reinterpret_cast<const std::uint8_t *>(ptr), pair.second, 0});
+                        }
                     }
                 }
             }
+            return cubes;
+        };
+        const auto & indexPendingCubes = [&](TextureLayer & layer, QElapsedTimer & timer) {
+            const auto & cube2Pointer = state->cube2Pointer[layer.isOverlayData][int_log(Dataset::current().magnification)];
+            const auto batch = static_cast<std::size_t>(std::max(1, QThread::idealThreadCount()));
+            while ((!layer.pendingOrthoCubes.empty() || !layer.pendingArbCubes.empty()) && !timer.hasExpired(3)) {
+                CubeHash::Pin pin(cube2Pointer);// until the cubes are indexed
+                layer.indexCubes(takePendingCubes(layer, cube2Pointer, batch), Dataset::current().cubeEdgeLength, gpucubeedge);
+            }
+        };
+        const auto & streamPendingCubes = [&](TextureLayer & layer) {
+            const auto & cube2Pointer = state->cube2Pointer[layer.isOverlayData][int_log(Dataset::current().magnification)];
+            auto pin = std::make_shared<CubeHash::Pin>(cube2Pointer);// before the lookups
+            layer.streamCubes(std::move(pin), takePendingCubes(layer, cube2Pointer, TextureLayer::cubesPerStage), Dataset::current().cubeEdgeLength, gpucubeedge);
+        };
+        const auto & stillLoaded = [](const TextureLayer & layer) {
+            return [&layer](const TextureLayer::StreamedCube & cube) {
+                return cube.magnification == Dataset::current().magnification
+                        && Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[layer.isOverlayData][int_log(cube.magnification)], cube.cubeCoord) == cube.cube;
+            };
         };
 
         QElapsedTimer timer;
         timer.start();
+        const auto center = viewerState.currentPosition.cube(gpucubeedge, Dataset::current().magnification);
         for (auto & layer : layers) {
+            layer.advanceFrame({center.x, center.y, center.z});
+            if (!layer.isOverlayData) {// upload what the last frame prepared before looking for missing cubes
+                layer.finishStreamedCubes(stillLoaded(layer));
+            }
             calculateMissingOrthoGPUCubes(layer);
-            loadPendingCubes(layer, layer.pendingOrthoCubes, timer);
-            loadPendingCubes(layer, layer.pendingArbCubes, timer);
+            if (layer.isOverlayData) {// the color table is filled from the segmentation, so overlay cubes are finished within the frame
+                indexPendingCubes(layer, timer);
+                layer.updateColorTable();
+            } else {
+                streamPendingCubes(layer);
+            }
         }
+    } else {// slice all visible ortho viewports at once before they are painted
+        std::vector<ViewportOrtho *> vps;
+        window->forEachOrthoVPDo([&vps](ViewportOrtho & vp) {
+            if (vp.viewportType != VIEWPORT_ARBITRARY && vp.isVisible()) {
+                vps.emplace_back(&vp);
+            }
+        });
+        sliceOrthoViewports(vps);
     }
 
     window->forEachOrthoVPDo([](ViewportOrtho & vp) {
@@ -916,6 +838,9 @@ void Viewer::applyTextureFilterSetting() {
 
 void Viewer::applyTextureFilterSetting(const QOpenGLTexture::Filter texFiltering) {
     viewerState.textureFilter = texFiltering;
+    for (auto && elem : window->viewportArb->resliceNecessary) {// the cpu arb slicing interpolates with linear filtering
+        elem = true;
+    }
     window->forEachOrthoVPDo([](ViewportOrtho & orthoVP) {
         for (std::size_t layerId{0}; layerId < orthoVP.texture.texHandle.size(); ++layerId) {
             auto & elem = orthoVP.texture.texHandle[layerId];
@@ -990,10 +915,7 @@ void Viewer::userMoveVoxels(const Coordinate & step, UserMoveType userMoveType,
     const auto newPosition_dc = viewerState.currentPosition.cube(Dataset::current().cubeEdgeLength, Dataset::current().magnification);
     const auto newPosition_gpudc = viewerState.currentPosition.cube(gpucubeedge, Dataset::current().magnification);
 
-    if (newPosition_dc != lastPosition_dc) {
-        for (std::size_t layerId{0}; layerId < Dataset::datasets.size(); ++layerId) {
-            reslice_notify_visible(layerId);
-        }
+    if (newPosition_dc != lastPosition_dc) {// cubes which stay visible are kept in their texture slots
         // userMoveType How user movement was generated
         // Direction of user movement in case of drilling,
         // or normal to viewport plane in case of horizontal movement.
@@ -1015,7 +937,7 @@ void Viewer::userMoveVoxels(const Coordinate & step, UserMoveType userMoveType,
                 }
             }
             for (const auto & pos : obsoleteCubes) {
-                layer.textures.erase(pos);
+                layer.recycle(pos);
             }
             calculateMissingOrthoGPUCubes(layer);
         }
@@ -1064,7 +986,10 @@ void Viewer::calculateMissingOrthoGPUCubes(TextureLayer & layer) {
 
 void Viewer::reslice_notify_all(const std::size_t layerId, const Coordinate coord) {
     if (currentlyVisibleWrapWrap(state->viewerState->currentPosition, coord)) {
-        reslice_notify_visible(layerId);
+        {// only this cube has to be sliced again
+            QMutexLocker locker(&changedCubesMutex);
+            changedCubes.emplace_back(layerId, coord.cube(Dataset::datasets[layerId].cubeEdgeLength, Dataset::datasets[layerId].magnification));
+        }
     }
     window->viewportArb->resliceNecessary[layerId] = true;//arb visibility is not tested
     if (layerId == Segmentation::singleton().layerId) {
@@ -1074,12 +999,17 @@ void Viewer::reslice_notify_all(const std::size_t layerId, const Coordinate coor
 }
 
 void Viewer::reslice_notify_visible(const std::size_t layerId) {
-    window->forEachOrthoVPDo([layerId](ViewportOrtho & vpOrtho) {
-        vpOrtho.resliceNecessary[layerId] = true;
-    });
+    QMutexLocker locker(&changedCubesMutex);
+    changedLayers.emplace_back(layerId);
 }
 
 void Viewer::segmentation_changed() {
+    OverlayColorCache::invalidate();
+    for (auto & layer : layers) {// gpu overlay cubes keep their slots, only the colors are updated
+        if (layer.isOverlayData) {
+            layer.colorTable.invalidate();
+        }
+    }
     reslice_notify_visible(Segmentation::singleton().layerId);
 }
 
@@ -1093,15 +1023,22 @@ void Viewer::recalcTextureOffsets() {
         float midY = texture.texUnitsPerDataPx;
         float xFactor = 0.5 * texture.texUsedX;
         float yFactor = 0.5 * texture.texUsedY;
+        const auto & pos = state->viewerState->currentPosition;
+        auto origin = texture.leftUpperPxInAbsPx;
+        if (ringSlots(orthoVP) != 0) {// toroidal textures start at multiples of their size, the quad wraps around
+            const int period = texture.size * Dataset::current().magnification;
+            const auto periodStart = [period](const int px){ return px - (px % period + period) % period; };
+            origin = Coordinate{periodStart(pos.x), periodStart(pos.y), periodStart(pos.z)};
+        }
         if (orthoVP.viewportType == VIEWPORT_XY) {
-            midX *= state->viewerState->currentPosition.x - texture.leftUpperPxInAbsPx.x;
-            midY *= state->viewerState->currentPosition.y - texture.leftUpperPxInAbsPx.y;
+            midX *= pos.x - origin.x;
+            midY *= pos.y - origin.y;
         } else if (orthoVP.viewportType == VIEWPORT_XZ) {
-            midX *= state->viewerState->currentPosition.x - texture.leftUpperPxInAbsPx.x;
-            midY *= state->viewerState->currentPosition.z - texture.leftUpperPxInAbsPx.z;
+            midX *= pos.x - origin.x;
+            midY *= pos.z - origin.z;
         } else if (orthoVP.viewportType == VIEWPORT_ZY) {
-            midX *= state->viewerState->currentPosition.z - texture.leftUpperPxInAbsPx.z;
-            midY *= state->viewerState->currentPosition.y - texture.leftUpperPxInAbsPx.y;
+            midX *= pos.z - origin.z;
+            midY *= pos.y - origin.y;
         } else {
             const auto texUsed = texture.usedSizeInCubePixels / texture.size;
             midX = 0.5 * texUsed;
@@ -36,10 +36,13 @@
 #include <QDebug>
 #include <QElapsedTimer>
 #include <QLineEdit>
+#include <QMutex>
 #include <QObject>
 #include <QQuaternion>
 #include <QTimer>
 
+#include <atomic>
+#include <utility>
 #include <vector>
 
 enum TreeDisplay {
@@ -175,10 +178,13 @@ private:
 
     void vpGenerateTexture(ViewportArb & vp);
 
-    void dcSliceExtract(std::uint8_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, ViewportOrtho & vp, bool useCustomLUT);
-    void dcSliceExtract(std::uint8_t * datacube, floatCoordinate *currentPxInDc_float, std::uint8_t * slice, int s, int *t, const floatCoordinate & v2, bool useCustomLUT, float usedSizeInCubePixels);
+    void dcSliceExtract(std::uint8_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, const std::size_t slicePitch, const ViewportOrtho & vp, bool useCustomLUT);
 
-    void ocSliceExtract(std::uint64_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, ViewportOrtho & vp);
+    void ocSliceExtract(std::uint64_t * datacube, Coordinate cubePosInAbsPx, std::uint8_t * slice, const std::size_t slicePitch, const ViewportOrtho & vp);
+    void sliceOrthoViewports(const std::vector<ViewportOrtho *> & vps);
+    QMutex changedCubesMutex;
+    std::vector<std::pair<std::size_t, CoordOfCube>> changedCubes;// layer and cube, to be sliced again
+    std::vector<std::size_t> changedLayers;// all cubes of these layers have to be sliced again
 
     void calcLeftUpperTexAbsPx();
 
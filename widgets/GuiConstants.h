@@ -55,10 +55,16 @@ const QString PLY_SAVE_AS_BIN = "ply_save_as_bin";
 
 // DataSet Switch
 const QString DATASET_CUBE_EDGE = "cube_edge";
+const QString DATASET_DISK_CACHE_SIZE = "disk_cache_size";
 const QString DATASET_GEOMETRY = "dataset_geometry";
+const QString DATASET_HTTP2 = "http2";
 const QString DATASET_LAST_USED = "dataset_last_used";
+const QString DATASET_MAX_REQUESTS_IN_FLIGHT = "max_requests_in_flight";
 const QString DATASET_MRU = "dataset_mru";
 const QString DATASET_OVERLAY = "overlay";
+const QString DATASET_PREFETCH_BUDGET = "prefetch_budget";
+const QString DATASET_RAM_CACHE_SIZE = "ram_cache_size";
+const QString DATASET_REQUEST_BATCH_SIZE = "request_batch_size";
 const QString DATASET_SUPERCUBE_EDGE = "supercube_edge";
 
 // Zoom and Multires
@@ -45,6 +45,7 @@
 #include <QSignalBlocker>
 #include <QVBoxLayout>
 
+#include <algorithm>
 #include <stdexcept>
 
 DatasetLoadWidget::DatasetLoadWidget(QWidget *parent) : DialogVisibilityNotify(DATASET_WIDGET, parent) {
@@ -369,6 +370,12 @@ void DatasetLoadWidget::saveSettings() {
     settings.setValue(DATASET_CUBE_EDGE, Dataset::current().cubeEdgeLength);
     settings.setValue(DATASET_SUPERCUBE_EDGE, state->M);
     settings.setValue(DATASET_OVERLAY, Segmentation::singleton().enabled);
+    settings.setValue(DATASET_DISK_CACHE_SIZE, Loader::Controller::singleton().diskCache.maxSize() / 1024 / 1024);
+    settings.setValue(DATASET_RAM_CACHE_SIZE, static_cast<qulonglong>(Loader::Controller::singleton().evictedCubesCacheSize / 1024 / 1024));
+    settings.setValue(DATASET_PREFETCH_BUDGET, static_cast<qulonglong>(Loader::Controller::singleton().prefetchBudget.load()));
+    settings.setValue(DATASET_REQUEST_BATCH_SIZE, static_cast<qulonglong>(Loader::Controller::singleton().requestBatchSize.load()));
+    settings.setValue(DATASET_HTTP2, Loader::Controller::singleton().http2.load());
+    settings.setValue(DATASET_MAX_REQUESTS_IN_FLIGHT, static_cast<qulonglong>(Loader::Controller::singleton().maxRequestsInFlight.load()));
 
     settings.endGroup();
 }
@@ -431,6 +438,12 @@ void DatasetLoadWidget::loadSettings() {
     cubeEdgeLen = settings.value(DATASET_CUBE_EDGE, 128).toInt();
     state->M = settings.value(DATASET_SUPERCUBE_EDGE, 3).toInt();
     segmentationOverlayCheckbox.setChecked(settings.value(DATASET_OVERLAY, false).toBool());
+    Loader::Controller::singleton().diskCache.setMaxSize(settings.value(DATASET_DISK_CACHE_SIZE, 2048).toLongLong() * 1024 * 1024);// in MiB, 0 disables it
+    Loader::Controller::singleton().evictedCubesCacheSize = settings.value(DATASET_RAM_CACHE_SIZE, 512).toULongLong() * 1024 * 1024;// in MiB, 0 disables it
+    Loader::Controller::singleton().prefetchBudget = settings.value(DATASET_PREFETCH_BUDGET, 16).toULongLong();// cubes per layer, 0 disables it
+    Loader::Controller::singleton().requestBatchSize = std::max(1ull, settings.value(DATASET_REQUEST_BATCH_SIZE, 8).toULongLong());// cubes per request, 1 disables batching
+    Loader::Controller::singleton().http2 = settings.value(DATASET_HTTP2, false).toBool();
+    Loader::Controller::singleton().maxRequestsInFlight = settings.value(DATASET_MAX_REQUESTS_IN_FLIGHT, 0).toULongLong();// 0 is unlimited
     state->viewer->resizeTexEdgeLength(cubeEdgeLen, state->M, Dataset::datasets.size());
 
     cubeEdgeSpin.setValue(cubeEdgeLen);
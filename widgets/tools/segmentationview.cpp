@@ -452,6 +452,12 @@ SegmentationView::SegmentationView(QWidget * const parent) : QWidget(parent), ca
         copyAction(contextMenu, table);
         addDisabledSeparator(contextMenu);
         QObject::connect(contextMenu.addAction("Merge"), &QAction::triggered, &Segmentation::singleton(), &Segmentation::mergeSelectedObjects);
+        QObject::connect(contextMenu.addAction("Split into connected components"), &QAction::triggered, [](){
+            auto & seg = Segmentation::singleton();
+            if (seg.selectedObjectsCount() == 1) {
+                splitIntoConnectedComponents(seg.selectedObjectIndices.front());
+            }
+        });
         QObject::connect(contextMenu.addAction("Restore default color"), &QAction::triggered, &Segmentation::singleton(), &Segmentation::restoreDefaultColorForSelectedObjects);
         deleteAction(contextMenu, table, "Delete", &Segmentation::singleton(), &Segmentation::deleteSelectedObjects);
         contextMenu.setDefaultAction(contextMenu.actions().front());
@@ -470,6 +476,7 @@ SegmentationView::SegmentationView(QWidget * const parent) : QWidget(parent), ca
         contextMenu.actions().at(copyActionIndex = i++)->setEnabled(Segmentation::singleton().selectedObjectsCount() > 0);// copy selected contents
         ++i;// separator
         contextMenu.actions().at(i++)->setEnabled(Segmentation::singleton().selectedObjectsCount() > 1);// mergeAction
+        contextMenu.actions().at(i++)->setEnabled(Segmentation::singleton().selectedObjectsCount() == 1);// splitAction
         contextMenu.actions().at(i++)->setEnabled(Segmentation::singleton().selectedObjectsCount() > 0);// restoreColorAction
         contextMenu.actions().at(deleteActionIndex = i++)->setEnabled(Segmentation::singleton().selectedObjectsCount() > 0);// deleteAction
         ++i;// separator
@@ -42,6 +42,7 @@
 #include <QOpenGLTimeMonitor>
 #include <QPainter>
 #include <QQuaternion>
+#include <QVector2D>
 #include <QVector3D>
 
 #ifdef Q_OS_MAC
@@ -617,7 +618,7 @@ void ViewportOrtho::renderViewportFast() {
     overlay_data_shader.setUniformValue("projection_matrix", projectionMatrix);
     overlay_data_shader.setUniformValue("indexTexture", 0);
     overlay_data_shader.setUniformValue("textureLUT", 1);
-    overlay_data_shader.setUniformValue("factor", static_cast<float>(std::numeric_limits<gpu_lut_cube::gpu_index>::max()));
+    overlay_data_shader.setUniformValue("colorTable", 2);
 
     glEnable(GL_TEXTURE_3D);
 
@@ -626,6 +627,8 @@ void ViewportOrtho::renderViewportFast() {
             if (layer.isOverlayData) {
                 overlay_data_shader.bind();
                 overlay_data_shader.setUniformValue("textureOpacity", Segmentation::singleton().alpha / 256.0f);
+                layer.colorTable.texture.bind(2);
+                overlay_data_shader.setUniformValue("colorTableSize", QVector2D(layer.colorTable.texture.width(), layer.colorTable.texture.height()));
             } else {
                 raw_data_shader.bind();
                 raw_data_shader.setUniformValue("textureOpacity", layer.opacity);
@@ -637,7 +640,9 @@ void ViewportOrtho::renderViewportFast() {
                     punned.cube.bind(0);
                     punned.lut.bind(1);
                     overlay_data_shader.setUniformValue("model_matrix", modelMatrix);
-                    overlay_data_shader.setUniformValue("lutSize", static_cast<float>(punned.lut.width() * punned.lut.height() * punned.lut.depth()));
+                    overlay_data_shader.setUniformValue("lutSize", QVector2D(punned.lut.width(), punned.lut.height()));
+                    const auto factor = punned.indexFactor();
+                    overlay_data_shader.setUniformValue("factor", QVector2D(factor[0], factor[1]));
                 } else {
                     raw_data_shader.setUniformValue("model_matrix", modelMatrix);
                     cube.cube.bind(0);
@@ -661,6 +666,7 @@ void ViewportOrtho::renderViewportFast() {
                     const auto pos = CoordOfGPUCube(offsetx + x, offsety + y, offsetz + z);
                     auto it = layer.textures.find(pos);
                     auto & ptr = it != std::end(layer.textures) ? *it->second : *layer.bogusCube;
+                    layer.touch(ptr);
 
                     QMatrix4x4 modelMatrix;
                     modelMatrix.translate(pos.x * gpucubeedge, pos.y * gpucubeedge, pos.z * gpucubeedge);
@@ -684,6 +690,7 @@ void ViewportOrtho::renderViewportFast() {
                                                         , static_cast<float>(vertex.y - pos.y * gpucubeedge) / gpucubeedge
                                                         , texR}});
                         }
+                        layer.touch(cube);
                         render(cube);
                     }
                 }
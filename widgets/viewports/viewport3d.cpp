@@ -158,9 +158,9 @@ void Viewport3D::updateVolumeTexture() {
     GLubyte* colcube = new GLubyte[4*texLen*texLen*texLen];
     std::tuple<uint64_t, std::tuple<uint8_t, uint8_t, uint8_t, uint8_t>> lastIdColor;
 
-    state->protectCube2Pointer.lock();
-
     dcfetch_profiler.start(); // ----------------------------------------------------------- profiling
+    const auto & cubeHash = state->cube2Pointer[Segmentation::singleton().layerId][int_log(Dataset::current().magnification)];
+    CubeHash::Pin pin(cubeHash);// the loader mustn’t reuse the slots until the colors are fetched
     uint64_t** rawcubes = new uint64_t*[M*M*M];
     for(int z = 0; z < M; ++z)
     for(int y = 0; y < M; ++y)
@@ -168,7 +168,7 @@ void Viewport3D::updateVolumeTexture() {
         auto cubeIndex = z*M*M + y*M + x;
         Coordinate cubeCoordRelative{x - M_radius, y - M_radius, z - M_radius};
         rawcubes[cubeIndex] = reinterpret_cast<uint64_t*>(
-            Coordinate2BytePtr_hash_get_or_fail(state->cube2Pointer[Segmentation::singleton().layerId][int_log(Dataset::current().magnification)],
+            Coordinate2BytePtr_hash_get_or_fail(cubeHash,
             {currentPosDc.x + cubeCoordRelative.x, currentPosDc.y + cubeCoordRelative.y, currentPosDc.z + cubeCoordRelative.z}));
     }
     dcfetch_profiler.end(); // ----------------------------------------------------------- profiling
@@ -216,8 +216,7 @@ void Viewport3D::updateVolumeTexture() {
     }
 
     delete[] rawcubes;
-
-    state->protectCube2Pointer.unlock();
+    pin.unlock();
 
     colorfetch_profiler.end(); // ----------------------------------------------------------- profiling
 
@@ -29,6 +29,8 @@
 
 #include <QOpenGLPixelTransferOptions>
 
+#include <boost/multi_array.hpp>
+
 ViewportArb::ViewportArb(QWidget *parent, ViewportType viewportType) : ViewportOrtho(parent, viewportType) {
     menuButton.menu()->addAction(&resetAction);
     connect(&resetAction, &QAction::triggered, []() {
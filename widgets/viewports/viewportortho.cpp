@@ -130,11 +130,12 @@ void ViewportOrtho::resetTexture(const std::size_t layerCount) {
         }
         texture.texHandle = decltype(texture.texHandle)(layerCount);
     }
+    staged.clear();
     for (auto & elem : texture.texHandle) {
         elem.destroy();
         elem.setSize(texture.size, texture.size);
         elem.setFormat(QOpenGLTexture::RGBA8_UNorm);
-        elem.setWrapMode(QOpenGLTexture::ClampToEdge);
+        elem.setWrapMode(viewportType == VIEWPORT_ARBITRARY ? QOpenGLTexture::ClampToEdge : QOpenGLTexture::Repeat);// ortho textures wrap around
         elem.allocateStorage();
         std::vector<std::uint8_t> texData(4 * std::pow(texture.size, 2));
         for (std::size_t i = 3; i < texData.size(); i += 4) {
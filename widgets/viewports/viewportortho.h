@@ -28,7 +28,11 @@
 #include "skeleton/node.h"
 #include "viewportbase.h"
 
+#include <QRect>
+
 #include <atomic>
+#include <cstdint>
+#include <vector>
 
 class ViewportOrtho : public ViewportBase {
     Q_OBJECT
@@ -84,7 +88,22 @@ public:
     floatCoordinate v1;// vector in x direction
     floatCoordinate v2;// vector in y direction
     floatCoordinate  n;// faces away from the vp plane towards the camera
-    std::vector<std::atomic_bool> resliceNecessary{decltype(resliceNecessary)(2)};// FIXME legacy;
+    std::vector<std::atomic_bool> resliceNecessary{decltype(resliceNecessary)(2)};// FIXME legacy; ortho slices are tracked per slot in staged
+    // The textures are toroidal, cube c is sliced into slot c mod (texture.size / cube edge) of both texture axes.
+    // Viewer::sliceOrthoViewports only slices slots whose cube changed and Viewer::vpGenerateTexture uploads the dirty ones.
+    struct StagedCube {
+        bool sliced{false};
+        bool cleared{false};// holds no cube, outside of the visible ones
+        CoordOfCube cube;
+        int slicePosition;// within the cube
+        const void * data;// nullptr if it wasn’t loaded
+    };
+    struct StagedLayer {
+        std::vector<std::uint8_t> texels;// RGBA, texture.size²
+        std::vector<StagedCube> slots;
+        QRect dirty;// in slots
+    };
+    std::vector<StagedLayer> staged;
     float displayedIsoPx;
     float screenPxYPerDataPx;
     float displayedlengthInNmY;